@@ -0,0 +1,191 @@
+/*! \file
+ *  \brief Launch configuration tuning test without a device
+ *
+ *  Drives the tuning strategies with a kernel model (time per block
+ *  size and cache preference, the largest block size it can run with,
+ *  noisy trials), checks that the searches find the best configuration
+ *  and settle, that the tuning DB keeps the result through a save and
+ *  load, and that a stored configuration the kernel can no longer run
+ *  with starts a new search.
+ *
+ *  Usage: t_autotune [db_file]
+ *         (default: t_autotune.tune)
+ */
+
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+
+#include "qdp.h"
+
+using namespace QDP;
+
+
+namespace {
+
+  class ModelTimer: public JitLaunchTimer {
+  public:
+    ModelTimer( int optimum , int limit ): optimum(optimum), limit(limit) {}
+
+    bool launch( const JitLaunchConfig& cfg , double* time )
+    {
+      ++launches;
+      if (cfg.block > limit)
+	return false;
+      if (time) {
+	++timed;
+	*time = model( cfg );
+	// Every fifth trial is disturbed
+	if ( timed % 5 == 1 )
+	  *time *= 10.;
+      }
+      last = cfg;
+      return true;
+    }
+
+    double model( const JitLaunchConfig& cfg ) const
+    {
+      double t = 100. + 20. * std::fabs( std::log2( (double)cfg.block / optimum ) );
+      if ( cfg.cache == JitCachePref::l1 )
+	t -= 5.;
+      // A second, better minimum behind a rise, greedy stops at the rise
+      if ( second && cfg.block == 64 )
+	t = 200.;
+      if ( second && cfg.block == 32 )
+	t = 50.;
+      return t;
+    }
+
+    int  optimum;
+    int  limit;
+    bool second = false;
+    int  launches = 0;
+    int  timed = 0;
+    JitLaunchConfig last;
+  };
+
+
+  int fails = 0;
+
+  void check( bool ok , const char* what )
+  {
+    std::cout << ( ok ? "OK   " : "FAIL " ) << what << "\n";
+    if (!ok)
+      ++fails;
+  }
+
+
+  // Launches until the tuning settles, the number of launches
+  int settle( tune_t& tune , JitTuneStrategy& strategy , const JitTuneSpace& space , ModelTimer& timer )
+  {
+    int n = 0;
+    while (!tune.settled && n < 1000) {
+      if (!jit_tune_launch( tune , strategy , space , timer ))
+	return -1;
+      ++n;
+    }
+    return n;
+  }
+
+}
+
+
+int main(int argc, char *argv[])
+{
+  std::string fname = argc > 1 ? argv[1] : "t_autotune.tune";
+
+  const std::string id = "sm_70_8_8_8_16_void function_build(JitFunction&, OLattice<T>&, const Op&)";
+  const int bucket = jit_tune_bucket( 16384 );
+
+  JitTuneSpace space;
+  space.max_block = 1024;
+
+  std::unique_ptr< JitTuneStrategy > greedy( jit_tune_strategy_create( "greedy" ) );
+  std::unique_ptr< JitTuneStrategy > exhaustive( jit_tune_strategy_create( "exhaustive" ) );
+
+  check( greedy && exhaustive && !jit_tune_strategy_create( "none" ) , "strategies" );
+
+  check( jit_tune_bucket( 1 ) == 0 && jit_tune_bucket( 2 ) == 1 && jit_tune_bucket( 3 ) == 2 &&
+	 jit_tune_bucket( 4096 ) == 12 && jit_tune_bucket( 4097 ) == 13 , "thread count buckets" );
+
+  JitTuneResult r;
+  r.times = { 3. , 1000. , 2. };
+  check( r.time() == 3. , "median of the trials" );
+
+  // Kernel runs best with 128 and preferring L1, can't run with more than 512
+  JitTuneDB db;
+  tune_t& tune = db.get( id , bucket );
+  ModelTimer timer( 128 , 512 );
+
+  int n = settle( tune , *greedy , space , timer );
+  check( n > 0 , "greedy search settles" );
+  check( tune.best == JitLaunchConfig( 128 , JitCachePref::l1 ) , "greedy search finds the best configuration despite outliers" );
+  std::cout << "      " << n << " launches, " << timer.launches - n << " failed\n";
+  check( &db.get( id , bucket ) == &tune , "same entry for the same bucket" );
+  check( !db.get( id , jit_tune_bucket( 512 ) ).settled , "new search for another bucket" );
+
+  timer = ModelTimer( 128 , 512 );
+  jit_tune_launch( tune , *greedy , space , timer );
+  check( timer.launches == 1 && timer.timed == 0 && timer.last == tune.best , "settled launch is a single untimed launch" );
+
+  // Exhaustive search finds what greedy misses
+  {
+    tune_t t_greedy, t_exh;
+    ModelTimer tg( 128 , 512 ), te( 128 , 512 );
+    tg.second = te.second = true;
+    settle( t_greedy , *greedy , space , tg );
+    int ne = settle( t_exh , *exhaustive , space , te );
+    check( t_greedy.best.block == 128 && t_exh.best.block == 32 , "exhaustive search finds the second minimum" );
+    std::cout << "      " << ne << " launches\n";
+  }
+
+  // Through a string and through a file
+  std::ostringstream oss;
+  db.write( oss );
+  JitTuneDB db_str;
+  std::istringstream iss( oss.str() );
+  check( db_str.read( iss ) && db_str.size() == 1 && db_str.settled() == 1 , "only settled entries are written" );
+
+  check( db.save( fname ) , "save" );
+  JitTuneDB db_file;
+  check( db_file.load( fname ) , "load" );
+
+  tune_t& loaded = db_file.get( id , bucket );
+  check( loaded.settled && loaded.best == JitLaunchConfig( 128 , JitCachePref::l1 ) , "loaded entry is settled" );
+
+  timer = ModelTimer( 128 , 512 );
+  jit_tune_launch( loaded , *greedy , space , timer );
+  check( timer.launches == 1 && timer.last == loaded.best , "loaded entry launches with its configuration" );
+
+  // The kernel changed and can't run with the stored block size anymore
+  timer = ModelTimer( 64 , 64 );
+  check( jit_tune_launch( loaded , *greedy , space , timer ) && timer.last.block == 64 , "stored block size too large, search again" );
+  settle( loaded , *greedy , space , timer );
+  check( loaded.settled && loaded.best == JitLaunchConfig( 64 , JitCachePref::l1 ) , "new search finds the best configuration" );
+
+  // Nothing runs above the minimum block size
+  {
+    tune_t t;
+    ModelTimer small( 8 , 8 );
+    settle( t , *exhaustive , space , small );
+    check( t.settled && t.best.block == 8 , "search goes below the minimum block size if needed" );
+
+    tune_t none;
+    ModelTimer never( 1 , 0 );
+    check( settle( none , *greedy , space , never ) < 0 , "no configuration runs" );
+  }
+
+  std::istringstream v1( "QDPTUNE 1\n12 256 41.5 " + id + "\n" );
+  JitTuneDB db_v1;
+  check( db_v1.read( v1 ) && db_v1.get( id , 12 ).best == JitLaunchConfig( 256 , JitCachePref::none ) , "version 1 DB read" );
+
+  std::istringstream bad( "QDPTUNE 3\n" );
+  check( !JitTuneDB().read( bad ) , "unknown version rejected" );
+
+  std::remove( fname.c_str() );
+
+  std::cout << ( fails ? "FAILED\n" : "all passed\n" );
+  return fails ? 1 : 0;
+}
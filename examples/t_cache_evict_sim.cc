@@ -0,0 +1,395 @@
+/*! \file
+ *  \brief Device memory replay
+ *
+ *  Replays a trace written with -cache-trace through the pool allocator
+ *  and the eviction policies on the CPU, and compares peak usage,
+ *  fragmentation, spills and transfers. No GPU memory is used, the pool
+ *  only does the address bookkeeping. The transfers the traced run did
+ *  are printed for comparison.
+ *
+ *  Usage: t_cache_evict_sim [options] trace pool_MB [policy ...]
+ *         (default policies: lru cost)
+ *
+ *    -fit next|best   pool placement (default next)
+ *    -arena MB        growable pool with arenas of MB
+ *    -no-compact      spill without compacting first
+ *    -dump            print the trace as text and exit
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+#include "qdp.h"
+
+using namespace QDP;
+
+
+namespace {
+
+  // Address space only
+  class SimAllocator {
+  public:
+    enum { ALIGNMENT_SIZE = 4096 };
+
+    static bool allocate( void** ptr, const size_t n_bytes ) {
+      static size_t next = (size_t)1 << 40;
+      *ptr = (void*)next;
+      next += n_bytes;
+      return true;
+    }
+
+    static void free(const void *mem) {}
+  };
+
+  typedef QDPPoolAllocator<SimAllocator> SimPool;
+
+
+  struct Entry {
+    size_t        size;
+    bool          is_static;
+    QDPCache::Status status;
+    void*         dev;
+    unsigned long last_use;
+  };
+
+
+  struct Result {
+    long   spills = 0;
+    long   victims = 0;
+    long   clean = 0;
+    long   failed = 0;
+    size_t h2d = 0;
+    size_t d2h = 0;
+    size_t peak = 0;
+    double frag = 0.;      // worst when spilling
+    size_t compacted = 0;
+  };
+
+
+  class Sim {
+  public:
+    Sim( QDPEvictionPolicy& policy , bool compact ): policy( policy ), pool( SimPool::Instance() ), do_compact( compact ) {}
+
+    Result run( const std::vector<QDPCacheTraceRecord>& records )
+    {
+      for ( auto& r : records )
+	{
+	  switch (r.ev) {
+	  case 'a':
+	    entries[ r.id ] = Entry{ r.size , false , QDPCache::Status::undef , NULL , tick };
+	    break;
+	  case 's':
+	    entries[ r.id ] = Entry{ r.size , true , QDPCache::Status::device , NULL , tick };
+	    allocate( r.id );
+	    break;
+	  case 'k':
+	    ++tick;
+	    break;
+	  case 'u':
+	    in_kernel = true;
+	    to_device( r.id );
+	    in_kernel = false;
+	    break;
+	  case 'r':
+	    read( r.id );
+	    break;
+	  case 'w':
+	    write( r.id );
+	    break;
+	  case 'd':
+	    release( r.id );
+	    break;
+	  }
+	}
+
+      // Leave the pool empty for the next policy
+      for ( auto& p : entries )
+	if (p.second.dev)
+	  pool.free( p.second.dev );
+      entries.clear();
+
+      return res;
+    }
+
+  private:
+    bool allocate( int id )
+    {
+      Entry& e = entries[id];
+      bool compacted = !do_compact;
+      while (!pool.allocate( &e.dev , e.size )) {
+	if (!compacted) {
+	  compacted = true;
+	  if (compact())
+	    continue;
+	}
+	if (!spill( e.size )) {
+	  ++res.failed;
+	  e.dev = NULL;
+	  return false;
+	}
+      }
+      in_use += qdp_evict_size<SimAllocator>( e.size );
+      res.peak = std::max( res.peak , in_use );
+      return true;
+    }
+
+    void free_dev( Entry& e )
+    {
+      pool.free( e.dev );
+      e.dev = NULL;
+      in_use -= qdp_evict_size<SimAllocator>( e.size );
+    }
+
+    void to_device( int id )
+    {
+      auto it = entries.find( id );
+      if (it == entries.end())
+	return;
+      Entry& e = it->second;
+      e.last_use = tick;
+
+      if (e.is_static)
+	return;
+
+      if (!e.dev && !allocate( id ))
+	return;
+
+      if (e.status == QDPCache::Status::host)
+	res.h2d += e.size;
+      e.status = QDPCache::Status::device;
+    }
+
+    void read( int id )
+    {
+      Entry& e = entries[id];
+      if (e.status == QDPCache::Status::device) {
+	res.d2h += e.size;
+	e.status = QDPCache::Status::shared;
+      } else if (e.status == QDPCache::Status::undef) {
+	e.status = QDPCache::Status::host;
+      }
+    }
+
+    void write( int id )
+    {
+      Entry& e = entries[id];
+      if (e.status == QDPCache::Status::device)
+	res.d2h += e.size;
+      to_host( e );
+    }
+
+    void to_host( Entry& e )
+    {
+      if (e.dev)
+	free_dev( e );
+      e.status = QDPCache::Status::host;
+    }
+
+    void release( int id )
+    {
+      auto it = entries.find( id );
+      if (it == entries.end())
+	return;
+      if (it->second.dev)
+	free_dev( it->second );
+      entries.erase( it );
+    }
+
+    std::map<void*,int> owners()
+    {
+      std::map<void*,int> owner;
+      for ( auto& p : entries )
+	if (p.second.dev)
+	  owner[ p.second.dev ] = p.first;
+      return owner;
+    }
+
+    bool pinned( const Entry& e )
+    {
+      return e.is_static || ( in_kernel && e.last_use == tick );
+    }
+
+    bool compact()
+    {
+      std::map<void*,int> owner = owners();
+
+      size_t bytes = pool.compact( [&]( void* ptr ) {
+	  auto it = owner.find( ptr );
+	  return it != owner.end() && !pinned( entries[ it->second ] );
+	},
+	[]( void* dst , void* src , size_t n ) {},
+	[&]( void* from , void* to ) {
+	  entries[ owner[from] ].dev = to;
+	});
+
+      res.compacted += bytes;
+      return bytes > 0;
+    }
+
+    bool spill( size_t n_bytes )
+    {
+      SimPool::stats_t st = pool.getStats();
+      if (st.free)
+	res.frag = std::max( res.frag , 1. - (double)st.largest_free / st.free );
+
+      std::map<void*,int> owner = owners();
+
+      std::vector<QDPEvictBlock> blocks = qdp_evict_blocks( pool , [&]( void* ptr , QDPEvictBlock& b ) {
+	  auto it = owner.find( ptr );
+	  if (it == owner.end())
+	    return;
+	  Entry& e = entries[ it->second ];
+	  b.id        = it->second;
+	  b.clean     = e.status == QDPCache::Status::shared;
+	  b.age       = tick - e.last_use;
+	  b.evictable = !pinned( e );
+	});
+
+      std::vector<int> victims = policy.victims( blocks , qdp_evict_size<SimAllocator>( n_bytes ) );
+
+      ++res.spills;
+      for ( int id : victims ) {
+	Entry& e = entries[id];
+	if (e.status == QDPCache::Status::shared)
+	  ++res.clean;
+	else
+	  res.d2h += e.size;
+	to_host( e );
+	++res.victims;
+      }
+
+      return !victims.empty();
+    }
+
+    QDPEvictionPolicy&   policy;
+    SimPool&             pool;
+    bool                 do_compact;
+    std::map<int,Entry>  entries;
+    unsigned long        tick = 0;
+    bool                 in_kernel = false;
+    size_t               in_use = 0;
+    Result               res;
+  };
+
+
+  void dump( const std::vector<QDPCacheTraceRecord>& records )
+  {
+    for ( auto& r : records )
+      std::cout << std::setw(14) << r.time << " " << r.ev << " " << r.id << " " << r.size << "\n";
+  }
+
+}
+
+
+int main(int argc, char *argv[])
+{
+  bool   best_fit = false;
+  size_t arena_mb = 0;
+  bool   compact = true;
+  bool   dump_only = false;
+
+  int i = 1;
+  for ( ; i < argc && argv[i][0] == '-' ; ++i ) {
+    if (!strcmp( argv[i] , "-fit" ) && i + 1 < argc)
+      best_fit = !strcmp( argv[++i] , "best" );
+    else if (!strcmp( argv[i] , "-arena" ) && i + 1 < argc)
+      arena_mb = atol( argv[++i] );
+    else if (!strcmp( argv[i] , "-no-compact" ))
+      compact = false;
+    else if (!strcmp( argv[i] , "-dump" ))
+      dump_only = true;
+    else {
+      std::cerr << "unknown option " << argv[i] << "\n";
+      return 1;
+    }
+  }
+
+  if ( argc - i < ( dump_only ? 1 : 2 ) ) {
+    std::cerr << "usage: " << argv[0] << " [-fit next|best] [-arena MB] [-no-compact] [-dump] trace pool_MB [policy ...]\n";
+    return 1;
+  }
+
+  std::vector<QDPCacheTraceRecord> records;
+  if (!qdp_cache_trace_read( argv[i] , records )) {
+    std::cerr << "could not read trace " << argv[i] << "\n";
+    return 1;
+  }
+
+  if (dump_only) {
+    dump( records );
+    return 0;
+  }
+
+  size_t pool_mb = atol( argv[i+1] );
+
+  SimPool& pool = SimPool::Instance();
+  pool.setPoolSize( pool_mb * 1024 * 1024 );
+  pool.setArenaSize( arena_mb * 1024 * 1024 );
+  pool.setBestFit( best_fit );
+
+  std::vector<std::string> names;
+  for ( int j = i + 2 ; j < argc ; ++j )
+    names.push_back( argv[j] );
+  if (names.empty())
+    names = { "lru" , "cost" };
+
+  // What the traced run did
+  size_t rec_h2d = 0, rec_d2h = 0, rec_compacted = 0;
+  long   rec_spills = 0;
+  for ( auto& r : records ) {
+    switch (r.ev) {
+    case '>': rec_h2d += r.size; break;
+    case '<': rec_d2h += r.size; break;
+    case 'S': ++rec_spills; break;
+    case 'C': rec_compacted += r.size; break;
+    }
+  }
+
+  std::cout << records.size() << " records over " << std::fixed << std::setprecision(1)
+	    << ( records.empty() ? 0. : records.back().time * 1e-9 ) << " s, pool " << pool_mb << " MB"
+	    << ( best_fit ? ", best fit" : ", next fit" );
+  if (arena_mb)
+    std::cout << ", arenas of " << arena_mb << " MB";
+  std::cout << ( compact ? "" : ", no compaction" ) << "\n";
+  std::cout << "traced run: " << rec_spills << " spills, D2H " << rec_d2h / 1048576. << " MB, H2D "
+	    << rec_h2d / 1048576. << " MB, compacted " << rec_compacted / 1048576. << " MB\n\n";
+
+  std::cout << std::setw(8)  << "policy"
+	    << std::setw(10) << "spills"
+	    << std::setw(10) << "victims"
+	    << std::setw(10) << "clean"
+	    << std::setw(12) << "D2H MB"
+	    << std::setw(12) << "H2D MB"
+	    << std::setw(12) << "peak MB"
+	    << std::setw(8)  << "frag"
+	    << std::setw(12) << "compact MB"
+	    << std::setw(8)  << "failed" << "\n";
+
+  for ( auto& name : names )
+    {
+      QDPEvictionPolicy* policy = qdp_eviction_policy_create( name );
+      if (!policy) {
+	std::cerr << "unknown policy " << name << "\n";
+	return 1;
+      }
+
+      Result r = Sim( *policy , compact ).run( records );
+
+      std::cout << std::setw(8)  << name
+		<< std::setw(10) << r.spills
+		<< std::setw(10) << r.victims
+		<< std::setw(10) << r.clean
+		<< std::setw(12) << std::setprecision(1) << r.d2h / 1048576.
+		<< std::setw(12) << r.h2d / 1048576.
+		<< std::setw(12) << r.peak / 1048576.
+		<< std::setw(8)  << std::setprecision(2) << r.frag
+		<< std::setw(12) << std::setprecision(1) << r.compacted / 1048576.
+		<< std::setw(8)  << r.failed << "\n";
+
+      delete policy;
+    }
+
+  return 0;
+}
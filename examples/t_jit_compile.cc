@@ -0,0 +1,110 @@
+/*! \file
+ *  \brief JIT compile-time benchmark
+ *
+ *  Builds a set of distinct expression kernels and reports the time
+ *  spent in the first evaluation (IR construction, libdevice import,
+ *  optimization, PTX codegen and launch) against a second evaluation
+ *  of the same expression (launch only). The difference is the
+ *  per-kernel build time.
+ *
+ *  Run without -ptxdb, otherwise kernels are taken from the DB.
+ */
+
+#include <iostream>
+#include <iomanip>
+
+#include "qdp.h"
+
+using namespace QDP;
+
+
+struct BuildTime {
+  std::string name;
+  double first;
+  double second;
+};
+
+std::vector<BuildTime> times;
+
+
+#define TIME_KERNEL(NAME,STATEMENT)			\
+  {							\
+    StopWatch w;					\
+    BuildTime t;					\
+    t.name = NAME;					\
+    w.reset(); w.start(); STATEMENT; CudaDeviceSynchronize(); w.stop();	\
+    t.first = w.getTimeInMicroseconds();		\
+    w.reset(); w.start(); STATEMENT; CudaDeviceSynchronize(); w.stop();	\
+    t.second = w.getTimeInMicroseconds();		\
+    times.push_back(t);					\
+  }
+
+
+int main(int argc, char *argv[])
+{
+  // Put the machine into a known state
+  QDP_initialize(&argc, &argv);
+
+  // Setup the layout
+  const int foo[] = {8,8,8,8};
+  multi1d<int> nrow(Nd);
+  nrow = foo;  // Use only Nd elements
+  Layout::setLattSize(nrow);
+  Layout::create();
+
+  LatticeReal        r1, r2, r3;
+  LatticeComplex     c1, c2;
+  LatticeColorMatrix u1, u2, u3;
+  LatticeFermion     f1, f2, f3;
+
+  gaussian(r2);
+  gaussian(r3);
+  gaussian(c2);
+  gaussian(u2);
+  gaussian(u3);
+  gaussian(f2);
+  gaussian(f3);
+
+  long jitted_start = get_jit_stats_jitted();
+
+  TIME_KERNEL( "real: r2 + r3"       , r1 = r2 + r3 );
+  TIME_KERNEL( "real: sin(r2)"       , r1 = sin(r2) );
+  TIME_KERNEL( "real: exp(r2)*r3"    , r1 = exp(r2) * r3 );
+  TIME_KERNEL( "real: sqrt(r2*r2)"   , r1 = sqrt(r2*r2) );
+  TIME_KERNEL( "real: atan2(r2,r3)"  , r1 = atan2(r2,r3) );
+  TIME_KERNEL( "complex: c2*c2"      , c1 = c2 * c2 );
+  TIME_KERNEL( "complex: log(c2)"    , c1 = cmplx( log(real(c2)) , imag(c2) ) );
+  TIME_KERNEL( "colmat: u2*u3"       , u1 = u2 * u3 );
+  TIME_KERNEL( "colmat: adj(u2)*u3"  , u1 = adj(u2) * u3 );
+  TIME_KERNEL( "colmat: u2*u3 + u3"  , u1 = u2 * u3 + u3 );
+  TIME_KERNEL( "fermion: u2*f2"      , f1 = u2 * f2 );
+  TIME_KERNEL( "fermion: f2 + r2*f3" , f1 = f2 + r2 * f3 );
+
+  long jitted = get_jit_stats_jitted() - jitted_start;
+
+  double total = 0.0;
+
+  QDPIO::cout << "\n";
+  QDPIO::cout << std::setw(24) << std::left << "expression"
+	      << std::setw(16) << std::right << "first (us)"
+	      << std::setw(16) << "second (us)"
+	      << std::setw(16) << "build (us)" << "\n";
+
+  for ( const BuildTime& t : times ) {
+    double build = t.first - t.second;
+    total += build;
+    QDPIO::cout << std::setw(24) << std::left << t.name
+		<< std::setw(16) << std::right << t.first
+		<< std::setw(16) << t.second
+		<< std::setw(16) << build << "\n";
+  }
+
+  QDPIO::cout << "\n";
+  QDPIO::cout << "kernels jit-compiled:        " << jitted << "\n";
+  if (jitted > 0)
+    QDPIO::cout << "mean build time per kernel:  " << total / jitted << " us\n";
+
+  QDP_finalize();
+
+  exit(0);
+}
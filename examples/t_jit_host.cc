@@ -0,0 +1,94 @@
+/*! \file
+ *  \brief JIT host backend check
+ *
+ *  Builds an expression kernel with the LLVM builder calls, runs it
+ *  through the host CPU backend on plain host arrays and compares
+ *  against the same expression evaluated in C++.
+ *
+ *  Doesn't initialize QDP, so it runs on machines without a GPU.
+ *
+ *  Usage: t_jit_host [nthreads]
+ */
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+
+#include "qdp.h"
+
+using namespace QDP;
+
+
+int main(int argc, char *argv[])
+{
+  llvm_host_init( argc > 1 ? atoi(argv[1]) : 0 );
+
+  const int n = 1 << 22;
+
+  std::vector<float> r(n), a(n), b(n), ref(n);
+  for ( int i = 0 ; i < n ; ++i ) {
+    a[i] = (float)(i % 1000) / 100.f;
+    b[i] = (float)(i % 37) - 18.f;
+  }
+
+  // r = sin(a) * b + sqrt(a)
+  llvm_start_new_host_function();
+
+  ParamRef p_th_count = llvm_add_param<int>();
+  ParamRef p_r        = llvm_add_param<float*>();
+  ParamRef p_a        = llvm_add_param<float*>();
+  ParamRef p_b        = llvm_add_param<float*>();
+
+  llvm::Value * r_th_count = llvm_derefParam( p_th_count );
+  llvm::Value * r_idx      = llvm_thread_idx();
+
+  llvm_cond_exit( llvm_ge( r_idx , r_th_count ) );
+
+  llvm::Value * r_a = llvm_load_ptr_idx( llvm_derefParam( p_a ) , r_idx );
+  llvm::Value * r_b = llvm_load_ptr_idx( llvm_derefParam( p_b ) , r_idx );
+
+  llvm::Value * r_val = llvm_add( llvm_mul( llvm_sin_f32( r_a ) , r_b ) , llvm_sqrt_f32( r_a ) );
+
+  llvm_store_ptr_idx( r_val , llvm_derefParam( p_r ) , r_idx );
+
+  llvm_exit();
+
+  StopWatch w;
+  w.reset(); w.start();
+  JitHostFunction* func = llvm_get_hostfunction( "t_jit_host: sin(a)*b + sqrt(a)" );
+  w.stop();
+  std::cout << "build:       " << w.getTimeInMicroseconds() << " us\n";
+
+  int    th_count = n;
+  float* ptr_r = r.data();
+  float* ptr_a = a.data();
+  float* ptr_b = b.data();
+
+  std::vector<void*> args;
+  args.push_back( &th_count );
+  args.push_back( &ptr_r );
+  args.push_back( &ptr_a );
+  args.push_back( &ptr_b );
+
+  jit_host_launch( func , th_count , args );
+
+  w.reset(); w.start();
+  jit_host_launch( func , th_count , args );
+  w.stop();
+  std::cout << "jit kernel:  " << w.getTimeInMicroseconds() << " us\n";
+
+  w.reset(); w.start();
+  for ( int i = 0 ; i < n ; ++i )
+    ref[i] = std::sin( a[i] ) * b[i] + std::sqrt( a[i] );
+  w.stop();
+  std::cout << "C++ loop:    " << w.getTimeInMicroseconds() << " us (1 thread)\n";
+
+  int wrong = 0;
+  for ( int i = 0 ; i < n ; ++i )
+    if ( std::fabs( r[i] - ref[i] ) > 1e-5 * ( 1.f + std::fabs( ref[i] ) ) )
+      ++wrong;
+
+  std::cout << "mismatches:  " << wrong << " of " << n << "\n";
+
+  return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+/*! \file
+ *  \brief QDP expressions on the host JIT backend
+ *
+ *  Evaluates lattice expressions, on the whole lattice, on a subset and
+ *  through a shift, and checks every site. Checks the reductions sum,
+ *  sumMulti, norm2 and innerProduct against sums on the host. Run with
+ *  -llvm-host, or on a machine without a CUDA device, the kernels are
+ *  then built and run by the host backend.
+ *
+ *  Usage: t_jit_host_exec -llvm-host [-llvm-host-threads n]
+ */
+
+#include <iostream>
+
+#include "qdp.h"
+
+using namespace QDP;
+
+
+namespace {
+
+  int& site( LatticeInteger& l , int i )
+  {
+    return l.elem(i).elem().elem().elem().elem();
+  }
+
+  REAL& site( LatticeReal& l , int i )
+  {
+    return l.elem(i).elem().elem().elem().elem();
+  }
+
+  int lexico( const multi1d<int>& coord )
+  {
+    const multi1d<int>& nrow = Layout::lattSize();
+    int n = 0;
+    for (int mu = Nd-1 ; mu >= 0 ; --mu)
+      n = n * nrow[mu] + coord[mu];
+    return n;
+  }
+
+  int fails = 0;
+
+  void report( double bad , const char* name )
+  {
+    QDPInternal::globalSum( bad );
+
+    QDPIO::cout << ( bad == 0 ? "OK   " : "FAIL " ) << name << "\n";
+    if (bad != 0)
+      ++fails;
+  }
+
+}
+
+
+int main(int argc, char *argv[])
+{
+  QDP_initialize(&argc, &argv);
+
+  const int foo[] = {4,4,4,8};
+  multi1d<int> nrow(Nd);
+  nrow = foo;  // Use only Nd elements
+  Layout::setLattSize(nrow);
+  Layout::create();
+
+  QDPIO::cout << ( jit_host_mode() ? "kernels on the host\n" : "kernels on the device\n" );
+
+  LatticeInteger a, b;
+  for (int i = 0 ; i < Layout::sitesOnNode() ; ++i) {
+    int n = lexico( Layout::siteCoords( Layout::nodeNumber() , i ) );
+    site( a , i ) = n;
+    site( b , i ) = n % 7 - 3;
+  }
+
+  LatticeInteger c = a * b + a;
+
+  LatticeInteger d = a;
+  d[rb[1]] = a - b;
+
+  LatticeInteger e = shift( a , FORWARD , 0 );
+
+  double bad_c = 0, bad_d = 0, bad_e = 0;
+  for (int i = 0 ; i < Layout::sitesOnNode() ; ++i) {
+    multi1d<int> coord = Layout::siteCoords( Layout::nodeNumber() , i );
+    int x = lexico( coord );
+    int y = x % 7 - 3;
+
+    if ( site( c , i ) != x * y + x )
+      ++bad_c;
+
+    if ( site( d , i ) != ( rb[1].isElement(i) ? x - y : x ) )
+      ++bad_d;
+
+    coord[0] = ( coord[0] + 1 ) % nrow[0];
+    if ( site( e , i ) != lexico( coord ) )
+      ++bad_e;
+  }
+
+  report( bad_c , "a * b + a" );
+  report( bad_d , "a - b on a subset" );
+  report( bad_e , "shift" );
+
+  // Reductions, the values are integers and their sums exact in double precision
+  LatticeReal u, v;
+  double want_norm2 = 0, want_inner = 0;
+  multi1d<double> want_multi( rb.numSubsets() );
+  want_multi = 0.;
+  for (int i = 0 ; i < Layout::sitesOnNode() ; ++i) {
+    int x = lexico( Layout::siteCoords( Layout::nodeNumber() , i ) );
+    int y = x % 7 - 3;
+    site( u , i ) = x;
+    site( v , i ) = y;
+    want_norm2 += (double)x * x;
+    want_inner += (double)x * y;
+    for (int k = 0 ; k < rb.numSubsets() ; ++k)
+      if ( rb[k].isElement(i) )
+	want_multi[k] += x;
+  }
+  QDPInternal::globalSum( want_norm2 );
+  QDPInternal::globalSum( want_inner );
+  for (int k = 0 ; k < rb.numSubsets() ; ++k)
+    QDPInternal::globalSum( want_multi[k] );
+
+  multi1d<Double> got_multi = sumMulti( u , rb );
+  double bad_multi = 0;
+  for (int k = 0 ; k < rb.numSubsets() ; ++k)
+    if ( toDouble( got_multi[k] ) != want_multi[k] )
+      ++bad_multi;
+
+  report( toDouble( norm2( u ) ) != want_norm2 , "norm2" );
+  report( toDouble( real( innerProduct( u , v ) ) ) != want_inner , "innerProduct" );
+  report( toDouble( sum( u , rb[1] ) ) != want_multi[1] , "sum on a subset" );
+  report( bad_multi , "sumMulti" );
+
+  QDPIO::cout << ( fails ? "FAILED\n" : "all passed\n" );
+
+  QDP_finalize();
+  return fails ? 1 : 0;
+}
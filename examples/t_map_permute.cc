@@ -0,0 +1,242 @@
+/*! \file
+ *  \brief Maps with several source and destination nodes
+ *
+ *  Applies maps that exchange sites with more than one node (a shift
+ *  whose boundary sites also move in another direction, and a random
+ *  permutation of the whole lattice) and with one (a reflection) to a
+ *  field of global site numbers, on the whole lattice and on a subset,
+ *  and checks every site. Also maps of maps and all nearest neighbour
+ *  shifts within one expression.
+ *  Run on several nodes, e.g. -geom 2 2 1 1.
+ *
+ *  Usage: t_map_permute [-geom ...]
+ */
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "qdp.h"
+
+using namespace QDP;
+
+
+namespace {
+
+  int lexico( const multi1d<int>& coord )
+  {
+    const multi1d<int>& nrow = Layout::lattSize();
+    int n = 0;
+    for (int mu = Nd-1 ; mu >= 0 ; --mu)
+      n = n * nrow[mu] + coord[mu];
+    return n;
+  }
+
+  multi1d<int> coords( int n )
+  {
+    const multi1d<int>& nrow = Layout::lattSize();
+    multi1d<int> coord(Nd);
+    for (int mu = 0 ; mu < Nd ; ++mu) {
+      coord[mu] = n % nrow[mu];
+      n /= nrow[mu];
+    }
+    return coord;
+  }
+
+
+  // x -> L-1-x in every direction
+  struct ReflectFunc : public MapFunc
+  {
+    multi1d<int> operator() (const multi1d<int>& coord, int sign) const
+    {
+      const multi1d<int>& nrow = Layout::lattSize();
+      multi1d<int> lc(Nd);
+      for (int mu = 0 ; mu < Nd ; ++mu)
+	lc[mu] = nrow[mu] - 1 - coord[mu];
+      return lc;
+    }
+  };
+
+
+  // Forward shift in direction 0, sites crossing the boundary also move by half the lattice in direction 1
+  struct TwistFunc : public MapFunc
+  {
+    multi1d<int> operator() (const multi1d<int>& coord, int sign) const
+    {
+      const multi1d<int>& nrow = Layout::lattSize();
+      multi1d<int> lc = coord;
+      int x = coord[0] + ( sign > 0 ? 1 : -1 );
+      if (x < 0 || x >= nrow[0])
+	lc[1] = ( coord[1] + nrow[1] / 2 ) % nrow[1];
+      lc[0] = ( x + nrow[0] ) % nrow[0];
+      return lc;
+    }
+  };
+
+
+  // Same permutation on all nodes
+  struct RandomFunc : public MapFunc
+  {
+    RandomFunc(): perm( Layout::vol() ), inv( Layout::vol() )
+    {
+      for (int i = 0 ; i < perm.size() ; ++i)
+	perm[i] = i;
+      std::shuffle( perm.begin() , perm.end() , std::mt19937( 1234 ) );
+      for (int i = 0 ; i < perm.size() ; ++i)
+	inv[ perm[i] ] = i;
+    }
+
+    multi1d<int> operator() (const multi1d<int>& coord, int sign) const
+    {
+      return coords( sign > 0 ? perm[ lexico( coord ) ] : inv[ lexico( coord ) ] );
+    }
+
+    std::vector<int> perm, inv;
+  };
+
+
+  // Shift by one in direction mu
+  struct ShiftFunc : public MapFunc
+  {
+    ShiftFunc( int mu ): mu(mu) {}
+
+    multi1d<int> operator() (const multi1d<int>& coord, int sign) const
+    {
+      const multi1d<int>& nrow = Layout::lattSize();
+      multi1d<int> lc = coord;
+      lc[mu] = ( coord[mu] + ( sign > 0 ? 1 : -1 ) + nrow[mu] ) % nrow[mu];
+      return lc;
+    }
+
+    int mu;
+  };
+
+
+  int fails = 0;
+
+  LatticeInteger site_numbers()
+  {
+    LatticeInteger src;
+    for (int i = 0 ; i < Layout::sitesOnNode() ; ++i)
+      src.elem(i).elem().elem().elem().elem() = lexico( Layout::siteCoords( Layout::nodeNumber() , i ) );
+    return src;
+  }
+
+  void report( double bad , const char* name )
+  {
+    QDPInternal::globalSum( bad );
+
+    QDPIO::cout << ( bad == 0 ? "OK   " : "FAIL " ) << name << "\n";
+    if (bad != 0)
+      ++fails;
+  }
+
+  void check( const MapFunc& func , const char* name )
+  {
+    Map m( func );
+
+    LatticeInteger src = site_numbers();
+
+    LatticeInteger d = m( src );
+
+    LatticeInteger d_sub = src;
+    d_sub[rb[1]] = m( src );
+
+    double bad = 0;
+    for (int i = 0 ; i < Layout::sitesOnNode() ; ++i) {
+      multi1d<int> coord = Layout::siteCoords( Layout::nodeNumber() , i );
+      int want = lexico( func( coord , +1 ) );
+
+      if ( d.elem(i).elem().elem().elem().elem() != want )
+	++bad;
+
+      int want_sub = rb[1].isElement(i) ? want : lexico( coord );
+      if ( d_sub.elem(i).elem().elem().elem().elem() != want_sub )
+	++bad;
+    }
+    report( bad , name );
+  }
+
+  // outer( inner( src ) ) + outer( src ), and three levels on a subset
+  void check_nested( const MapFunc& outer , const MapFunc& inner , const char* name )
+  {
+    Map mo( outer ), mi( inner );
+
+    LatticeInteger src = site_numbers();
+
+    LatticeInteger d = mo( mi( src ) ) + mo( src );
+
+    LatticeInteger d_sub = src;
+    d_sub[rb[0]] = mo( mi( mo( src ) ) );
+
+    double bad = 0;
+    for (int i = 0 ; i < Layout::sitesOnNode() ; ++i) {
+      multi1d<int> coord = Layout::siteCoords( Layout::nodeNumber() , i );
+      multi1d<int> y = outer( coord , +1 );
+
+      if ( d.elem(i).elem().elem().elem().elem() != lexico( inner( y , +1 ) ) + lexico( y ) )
+	++bad;
+
+      int want_sub = rb[0].isElement(i) ? lexico( outer( inner( y , +1 ) , +1 ) ) : lexico( coord );
+      if ( d_sub.elem(i).elem().elem().elem().elem() != want_sub )
+	++bad;
+    }
+    report( bad , name );
+  }
+
+  // All 2 Nd nearest neighbour shifts in one expression, their faces are gathered by one kernel
+  void check_stencil()
+  {
+    LatticeInteger src = site_numbers();
+
+    LatticeInteger d = src;
+    d[rb[1]] = shift( src , FORWARD , 0 ) + shift( src , BACKWARD , 0 )
+      + shift( src , FORWARD , 1 ) + shift( src , BACKWARD , 1 )
+      + shift( src , FORWARD , 2 ) + shift( src , BACKWARD , 2 )
+      + shift( src , FORWARD , 3 ) + shift( src , BACKWARD , 3 );
+
+    double bad = 0;
+    for (int i = 0 ; i < Layout::sitesOnNode() ; ++i) {
+      multi1d<int> coord = Layout::siteCoords( Layout::nodeNumber() , i );
+      int want = lexico( coord );
+      if ( rb[1].isElement(i) ) {
+	want = 0;
+	for (int mu = 0 ; mu < Nd ; ++mu)
+	  want += lexico( ShiftFunc(mu)( coord , +1 ) ) + lexico( ShiftFunc(mu)( coord , -1 ) );
+      }
+      if ( d.elem(i).elem().elem().elem().elem() != want )
+	++bad;
+    }
+    report( bad , "nearest neighbour stencil" );
+  }
+
+}
+
+
+int main(int argc, char *argv[])
+{
+  QDP_initialize(&argc, &argv);
+
+  const int foo[] = {4,4,4,8};
+  multi1d<int> nrow(Nd);
+  nrow = foo;  // Use only Nd elements
+  Layout::setLattSize(nrow);
+  Layout::create();
+
+  check( ReflectFunc() , "reflection" );
+  check( TwistFunc()   , "shift with a twisted boundary" );
+  check( RandomFunc()  , "random permutation" );
+
+  check_nested( ShiftFunc(0) , ShiftFunc(1) , "shift of shift" );
+  check_nested( ShiftFunc(0) , ShiftFunc(0) , "shift of shift, same direction" );
+  check_nested( RandomFunc() , TwistFunc()  , "permutation of a twisted shift" );
+
+  if (Nd == 4)
+    check_stencil();
+
+  QDPIO::cout << ( fails ? "FAILED\n" : "all passed\n" );
+
+  QDP_finalize();
+  return fails ? 1 : 0;
+}
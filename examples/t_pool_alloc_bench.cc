@@ -0,0 +1,163 @@
+/*! \file
+ *  \brief Pool allocator benchmark
+ *
+ *  Runs a random allocate/free workload shaped like a lattice code
+ *  (many small JIT scalars, fewer lattice sized objects) through the
+ *  pool allocator on host memory, once with next fit and once with
+ *  best fit, and reports the time per operation and the fragmentation.
+ *  When an allocation doesn't fit, random live objects are freed until
+ *  it does, as the cache would spill them.
+ *
+ *  Usage: t_pool_alloc_bench [pool_MB [ops [seed]]]
+ *         (defaults: 1024 2000000 1)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+#include "qdp.h"
+
+using namespace QDP;
+
+
+namespace {
+
+  class HostAllocator {
+  public:
+    enum { ALIGNMENT_SIZE = 4096 };
+
+    static bool allocate( void** ptr, const size_t n_bytes ) {
+      return posix_memalign( ptr , ALIGNMENT_SIZE , n_bytes ) == 0;
+    }
+
+    static void free(const void *mem) {
+      std::free( (void*)mem );
+    }
+  };
+
+  typedef QDPPoolAllocator<HostAllocator> HostPool;
+
+
+  struct Result {
+    double ns_per_op = 0.;
+    long   spilled = 0;
+    double frag_avg = 0.;
+    double frag_max = 0.;
+    long   free_blocks_max = 0;
+  };
+
+
+  Result run( HostPool& pool , long ops , unsigned seed )
+  {
+    std::mt19937 rng( seed );
+    std::uniform_real_distribution<double> uni( 0. , 1. );
+
+    // Lattice objects of a 16^3x32 local volume: fermion, gauge link, complex, real
+    const size_t lattice[] = { 16*16*16*32 * 24 * 4 ,
+			       16*16*16*32 * 18 * 4 ,
+			       16*16*16*32 *  2 * 4 ,
+			       16*16*16*32 *  1 * 4 };
+
+    std::vector<void*> live;
+    Result res;
+    long samples = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for ( long op = 0 ; op < ops ; ++op )
+      {
+	if ( live.empty() || uni( rng ) < 0.52 )
+	  {
+	    size_t size = uni( rng ) < 0.7 ? 8 + (size_t)( uni( rng ) * 248 ) : lattice[ rng() % 4 ];
+
+	    void* ptr;
+	    while (!pool.allocate( &ptr , size )) {
+	      if (live.empty()) {
+		std::cerr << "object of " << size << " bytes doesn't fit in the empty pool\n";
+		exit(1);
+	      }
+	      size_t victim = rng() % live.size();
+	      pool.free( live[victim] );
+	      live[victim] = live.back();
+	      live.pop_back();
+	      ++res.spilled;
+	    }
+	    live.push_back( ptr );
+	  }
+	else
+	  {
+	    size_t victim = rng() % live.size();
+	    pool.free( live[victim] );
+	    live[victim] = live.back();
+	    live.pop_back();
+	  }
+
+	if ( op % 1000 == 0 )
+	  {
+	    HostPool::stats_t st = pool.getStats();
+	    double frag = st.free ? 1. - (double)st.largest_free / st.free : 0.;
+	    res.frag_avg += frag;
+	    res.frag_max = std::max( res.frag_max , frag );
+	    res.free_blocks_max = std::max( res.free_blocks_max , st.free_blocks );
+	    ++samples;
+	  }
+      }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    // The stats sampling is included, it's the same for both
+    res.ns_per_op = std::chrono::duration<double,std::nano>( t1 - t0 ).count() / ops;
+    res.frag_avg /= samples;
+
+    for ( void* ptr : live )
+      pool.free( ptr );
+
+    return res;
+  }
+
+}
+
+
+int main(int argc, char *argv[])
+{
+  size_t   pool_mb = argc > 1 ? atol( argv[1] ) : 1024;
+  long     ops     = argc > 2 ? atol( argv[2] ) : 2000000;
+  unsigned seed    = argc > 3 ? atol( argv[3] ) : 1;
+
+  // Freeing live objects must always make room for the largest one
+  if ( pool_mb * 1024 * 1024 < 16*16*16*32 * 24 * 4 || ops < 1 ) {
+    std::cerr << "pool must hold a 16^3x32 fermion (" << 16*16*16*32 * 24 * 4 / (1024*1024) << " MB), ops at least 1\n";
+    return 1;
+  }
+
+  HostPool& pool = HostPool::Instance();
+  pool.setPoolSize( pool_mb * 1024 * 1024 );
+
+  std::cout << "pool " << pool_mb << " MB, " << ops << " operations\n\n";
+  std::cout << std::setw(10) << "strategy"
+	    << std::setw(10) << "ns/op"
+	    << std::setw(10) << "spilled"
+	    << std::setw(12) << "frag avg"
+	    << std::setw(12) << "frag max"
+	    << std::setw(14) << "free blocks" << "\n";
+
+  for ( bool best : { false , true } )
+    {
+      pool.setBestFit( best );
+
+      Result r = run( pool , ops , seed );
+
+      std::cout << std::setw(10) << ( best ? "best" : "next" )
+		<< std::setw(10) << std::fixed << std::setprecision(1) << r.ns_per_op
+		<< std::setw(10) << r.spilled
+		<< std::setw(12) << std::setprecision(3) << r.frag_avg
+		<< std::setw(12) << r.frag_max
+		<< std::setw(14) << r.free_blocks_max << "\n";
+    }
+
+  return 0;
+}
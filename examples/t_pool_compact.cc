@@ -0,0 +1,144 @@
+/*! \file
+ *  \brief Pool compaction test on host memory
+ *
+ *  Fragments a pool on host memory, checks that a large allocation
+ *  fails, compacts with some allocations held in place, and checks
+ *  that the contents survived the moves and that the allocation fits.
+ *
+ *  Usage: t_pool_compact [pool_MB [seed]]
+ *         (defaults: 256 1)
+ */
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+#include "qdp.h"
+
+using namespace QDP;
+
+
+namespace {
+
+  class HostAllocator {
+  public:
+    enum { ALIGNMENT_SIZE = 4096 };
+
+    static bool allocate( void** ptr, const size_t n_bytes ) {
+      return posix_memalign( ptr , ALIGNMENT_SIZE , n_bytes ) == 0;
+    }
+
+    static void free(const void *mem) {
+      std::free( (void*)mem );
+    }
+  };
+
+  typedef QDPPoolAllocator<HostAllocator> HostPool;
+
+
+  struct Object {
+    void*  ptr;
+    size_t size;
+    bool   fixed;
+  };
+
+
+  void fill( const Object& o , int id ) {
+    int* p = (int*)o.ptr;
+    for ( size_t i = 0 ; i < o.size / sizeof(int) ; ++i )
+      p[i] = id * 7919 + i;
+  }
+
+  bool check( const Object& o , int id ) {
+    const int* p = (const int*)o.ptr;
+    for ( size_t i = 0 ; i < o.size / sizeof(int) ; ++i )
+      if ( p[i] != (int)( id * 7919 + i ) )
+	return false;
+    return true;
+  }
+
+}
+
+
+int main(int argc, char *argv[])
+{
+  size_t   pool_mb = argc > 1 ? atol( argv[1] ) : 256;
+  unsigned seed    = argc > 2 ? atol( argv[2] ) : 1;
+
+  HostPool& pool = HostPool::Instance();
+  pool.setPoolSize( pool_mb * 1024 * 1024 );
+
+  std::mt19937 rng( seed );
+
+  // Fill the pool, then free every other object
+  std::map<int,Object> objects;
+  for ( int id = 0 ; ; ++id ) {
+    Object o;
+    o.size  = 4096 * ( 1 + rng() % 256 );
+    o.fixed = rng() % 64 == 0;
+    if (!pool.allocate( &o.ptr , o.size ))
+      break;
+    objects[id] = o;
+  }
+
+  for ( auto it = objects.begin() ; it != objects.end() ; ) {
+    if ( it->first % 2 ) {
+      pool.free( it->second.ptr );
+      it = objects.erase( it );
+    } else {
+      fill( it->second , it->first );
+      ++it;
+    }
+  }
+
+  HostPool::stats_t st = pool.getStats();
+  size_t want = st.largest_free * 2;
+
+  std::cout << objects.size() << " objects, free " << st.free << " in " << st.free_blocks
+	    << " blocks, largest " << st.largest_free << "\n";
+
+  void* big;
+  if ( want < st.free && pool.allocate( &big , want ) ) {
+    std::cout << "FAIL: " << want << " bytes fit before compaction\n";
+    return 1;
+  }
+
+  std::map<void*,int> owner;
+  for ( auto& o : objects )
+    owner[ o.second.ptr ] = o.first;
+
+  auto start = std::chrono::steady_clock::now();
+
+  size_t bytes = pool.compact( [&]( void* ptr ) { return !objects[ owner[ptr] ].fixed; },
+			       []( void* dst , void* src , size_t n ) { std::memcpy( dst , src , n ); },
+			       [&]( void* from , void* to ) {
+				 int id = owner[from];
+				 owner.erase( from );
+				 owner[to] = id;
+				 objects[id].ptr = to;
+			       });
+
+  double ms = std::chrono::duration< double , std::milli >( std::chrono::steady_clock::now() - start ).count();
+
+  st = pool.getStats();
+  std::cout << "compaction moved " << bytes << " bytes in " << ms << " ms, free now in "
+	    << st.free_blocks << " blocks, largest " << st.largest_free << "\n";
+
+  for ( auto& o : objects )
+    if (!check( o.second , o.first )) {
+      std::cout << "FAIL: object " << o.first << " corrupted\n";
+      return 1;
+    }
+
+  if ( want < st.free && !pool.allocate( &big , want ) ) {
+    std::cout << "FAIL: " << want << " bytes don't fit after compaction\n";
+    return 1;
+  }
+
+  std::cout << "OK\n";
+  return 0;
+}
@@ -81,6 +81,7 @@
 #include <iostream>
 #include <utility>
 #include <memory>
+#include <functional>
 #include <vector>
 
 #include <string>
@@ -97,6 +98,9 @@ using std::ostream;
 
 #include "cuda.h"
 #include "qdp_llvm.h"
+#include "qdp_ptxdb.h"
+#include "qdp_threadpool.h"
+#include "qdp_llvm_host.h"
 
 
 #include "qdp_forward.h"
@@ -116,6 +120,8 @@ namespace QDP {
 #include "qdp_cuda.h"
 #include "qdp_cuda_allocator.h"
 #include "qdp_pool_allocator.h"
+#include "qdp_cache_evict.h"
+#include "qdp_cache_trace.h"
 
 #include "qdp_multi.h"
 #include "qdp_cache.h"
@@ -180,6 +186,7 @@ namespace QDP {
 #include "qdp_profile.h"
 
 #include "qdp_mapresource.h"
+#include "qdp_commthread.h"
 #include "qdp_handle.h"
 #include "qdp_map.h"
 #include "qdp_autotuning.h"
@@ -212,6 +219,7 @@ namespace QDP {
 //#include "qdp_newopsjit.h"
 #include "qdp_internal.h"
 #include "qdp_jitfunction.h"
+#include "qdp_jit_deferred.h"
 #include "qdp_jitf_copymask.h"
 #include "qdp_jitf_sum.h"
 #include "qdp_jitf_summulti.h"
@@ -1,9 +1,142 @@
 #ifndef QDP_AUTOTUNING_H
 #define QDP_AUTOTUNING_H
 
+#include <map>
+#include <string>
+#include <vector>
+#include <iosfwd>
+
 namespace QDP {
 
-  void jit_launch(CUfunction function,int th_count,std::vector<int>& ids);
+  // Launch configuration tuning
+  //
+  // The first launches of a kernel measure launch configurations (block
+  // size and L1/shared memory preference) proposed by the tuning
+  // strategy, one launch per call, each configuration for a number of
+  // trials. The median time counts. Once the strategy is done the best
+  // configuration is used. Results are kept per kernel (its PTX DB id,
+  // see get_ptx_db_id) and thread count bucket (rounded up to a power
+  // of two). They are read from the tuning DB at start and written back
+  // at exit on the primary node. The DB is the PTX DB file with .tune
+  // appended, or set with -tunedb file. Kernels found there launch
+  // with their configuration right away.
+  //
+  // Strategies (-tune-strategy name):
+  //   greedy     - halves the block size from the maximum until the
+  //                time rises by a third, then tries the cache
+  //                preferences with the best block size
+  //   exhaustive - every block size from the maximum down to the
+  //                minimum with every cache preference
+  //
+  // With -launch-async settled kernels aren't waited for. Copies to
+  // and from the host, device direct sends and the next tuning launch
+  // synchronize, errors found there list the launches since the last
+  // sync (see CudaLaunchLogAdd).
+
+  enum class JitCachePref { none=0 , shared=1 , l1=2 , equal=3 };
+
+  struct JitLaunchConfig {
+    JitLaunchConfig(): block(0), cache(JitCachePref::none) {}
+    JitLaunchConfig(int block,JitCachePref cache): block(block), cache(cache) {}
+    bool operator==( const JitLaunchConfig& c ) const { return block == c.block && cache == c.cache; }
+
+    int          block;
+    JitCachePref cache;
+  };
+
+
+  //! Measurements of one configuration
+  struct JitTuneResult {
+    JitLaunchConfig     cfg;
+    std::vector<double> times;    // microseconds, one per trial
+    bool                failed = false;   // the kernel can't run with it
+
+    double time() const;          // median
+  };
+
+
+  //! The search space
+  struct JitTuneSpace {
+    int                       max_block = 1024;
+    int                       min_block = 32;   // lower only if nothing above runs
+    std::vector<JitCachePref> caches = { JitCachePref::none , JitCachePref::l1 , JitCachePref::shared };
+    int                       trials = 3;
+  };
+
+
+  struct tune_t {
+    tune_t(): settled(false), best_time(0.0), current(-1) {}
+    tune_t(const JitLaunchConfig& best,double best_time): settled(true), best(best), best_time(best_time), current(-1) {}
+
+    bool            settled;
+    JitLaunchConfig best;
+    double          best_time;   // microseconds
+
+    // Search state, cleared when settled
+    std::vector<JitTuneResult> results;
+    int                        current;   // result being measured
+  };
+
+
+  class JitTuneStrategy {
+  public:
+    virtual ~JitTuneStrategy() {}
+
+    virtual const char* name() const = 0;
+
+    //! The next configuration to measure given the results so far, false when done
+    virtual bool propose( const JitTuneSpace& space , const std::vector<JitTuneResult>& results , JitLaunchConfig& cfg ) = 0;
+  };
+
+  //! "greedy" or "exhaustive", NULL if unknown
+  JitTuneStrategy* jit_tune_strategy_create( const std::string& name );
+
+
+  //! One launch of a kernel with a given configuration
+  class JitLaunchTimer {
+  public:
+    virtual ~JitLaunchTimer() {}
+
+    //! false if the kernel can't run with the configuration. With time, waits for the kernel and sets the time in microseconds
+    virtual bool launch( const JitLaunchConfig& cfg , double* time ) = 0;
+  };
+
+
+  //! Launches with the tuned configuration or the next one of the search, false if no configuration runs
+  bool jit_tune_launch( tune_t& tune , JitTuneStrategy& strategy , const JitTuneSpace& space , JitLaunchTimer& timer );
+
+  //! Thread counts up to 2^bucket share a tuning
+  int jit_tune_bucket( int th_count );
+
+
+  class JitTuneDB {
+  public:
+    //! The entry of kernel id and bucket, a new search if there is none
+    tune_t& get( const std::string& id , int bucket );
+
+    //! Settled entries only, one per line: bucket block cache time id
+    void write( std::ostream& out ) const;
+    bool read( std::istream& in );
+
+    bool load( const std::string& fname );
+    bool save( const std::string& fname ) const;
+
+    size_t size() const { return mapTune.size(); }
+    size_t settled() const;
+
+  private:
+    std::map< std::pair< std::string , int > , tune_t > mapTune;
+  };
+
+
+  // written: the ids the kernel writes, NULL if it may write any of them
+  void jit_launch(CUfunction function,int th_count,std::vector<int>& ids,const std::vector<int>* written = NULL);
+
+  void jit_tune_set_db( const char * c_str );
+  void jit_tune_set_strategy( const char * c_str );
+  void jit_tune_set_trials( int n );
+  void jit_tune_init();
+  void jit_tune_db_save();
 
   //int jit_autotuning(CUfunction function,int lo,int hi,void ** param);
 
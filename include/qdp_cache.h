@@ -6,6 +6,8 @@
 #include <vector>
 #include <stack>
 #include <list>
+#include <deque>
+#include <fstream>
 //#include "string.h"
 //#include "math.h"
 
@@ -36,17 +38,37 @@ namespace QDP
       Multi = 16
     };
 
-    enum class Status { undef , host , device };
+    // Where the data is valid
+    //   host   - host only, a device copy is not kept
+    //   device - device only, a host copy (if allocated) is stale
+    //   shared - host and device copies agree
+    //
+    // Launching a kernel that writes an entry makes it device, a kernel
+    // only reading it leaves a shared entry shared. Writable host access makes it host. Read-only
+    // host access copies a device entry to the host and keeps the device
+    // copy; the entry becomes shared and spilling it is free.
+    enum class Status { undef , host , device , shared };
 
     enum class JitParamType { float_, int_, int64_, double_, bool_ };
 
+    union JitParamUnion {
+      void *  ptr;
+      float   float_;
+      int     int_;
+      int64_t int64_;
+      double  double_;
+      bool    bool_;
+    };
+
 
     
     QDPCache();
     
     typedef void (* LayoutFptr)(bool toDev,void * outPtr,void * inPtr);
 
-    std::vector<void*> get_kernel_args(std::vector<int>& ids , bool for_kernel = true );
+    // written: the ids the kernel writes, NULL if it may write any of them.
+    // Entries only read keep their host copy (shared).
+    std::vector<void*> get_kernel_args(std::vector<int>& ids , bool for_kernel = true , const std::vector<int>* written = NULL );
     
     int addJitParamFloat(float i);
     int addJitParamDouble(double i);
@@ -61,6 +83,7 @@ namespace QDP
     int add( size_t size, Flags flags, Status st, const void* ptr_host, const void* ptr_dev, LayoutFptr func );
 
     int addMulti( const multi1d<int>& ids );
+    bool isMulti( int id );
     
     // Wrappers to the previous interface
     int registrate( size_t size, unsigned flags, LayoutFptr func );
@@ -68,9 +91,11 @@ namespace QDP
     
     void signoff(int id);
     void assureOnHost(int id);
+    void assureOnHostRead(int id);
 
     //void * getDevicePtr(int id);
     void getHostPtr(void ** ptr , int id);
+    void getHostPtrRead(void ** ptr , int id);
 
     size_t getSize(int id);
     //bool allocate_device_static( void** ptr, size_t n_bytes );
@@ -79,6 +104,19 @@ namespace QDP
     
     CUDADevicePoolAllocator& get_allocator() { return pool_allocator; }
 
+    // Eviction policy (see qdp_cache_evict.h), decisions are printed if verbose
+    void setEvictionPolicy( const std::string& name );
+    void setEvictionVerbose( bool v ) { evict_verbose = v; }
+    void printEvictionStats();
+
+    // Compaction of the pool before spilling (on by default)
+    void setCompaction( bool c ) { compact_enabled = c; }
+
+    // Writes the cache and pool events to a binary trace (qdp_cache_trace.h)
+    void setTrace( const std::string& fname );
+    // Flushes and closes the trace, later events aren't traced
+    void closeTrace();
+
   private:
     class Entry;
     void growStack();
@@ -91,21 +129,63 @@ namespace QDP
     void freeDeviceMemory(Entry& e);
     void allocateDeviceMemory(Entry& e);
     
-    void assureDevice(Entry& e);
-    void assureDevice(int id);
+    void assureDevice(Entry& e , bool write = true);
+    void assureDevice(int id , bool write = true);
     
     void assureHost(Entry& e);
+    void assureHostRead(Entry& e);
     bool isOnDevice(int id);
     
-    bool spill_lru();
+    bool spill( size_t n_bytes );
+    bool compact( size_t n_bytes );
+
+    int addJitParam( JitParamType type , JitParamUnion param );
     void printTracker();
+
+    bool tracing();
+    void trace( char ev , int id );
+    void trace( char ev , int id , size_t size );
     
   private:
     vector<Entry>       vecEntry;
     stack<int>          stackFree;
     list<int>           lstTracker;
     vector<int>         vecLocked;   // with duplicate entries
+
+    // JIT scalars are passed to the kernel by value and don't need the
+    // entry table. Their ids start at jit_param_id_base and index the
+    // slots, which are reused; a deque keeps the values in place for the
+    // kernel argument pointers.
+    static const int    jit_param_id_base = 1 << 30;
+    struct JitParamSlot {
+      JitParamUnion     param;
+      JitParamType      type;
+    };
+    std::deque<JitParamSlot> jitParams;
+    std::vector<int>    jitParamsFree;
+
+    std::vector<int>    kernel_ids;    // get_kernel_args, reused
+    std::vector<bool>   kernel_writes; // get_kernel_args, reused
     CUDADevicePoolAllocator pool_allocator;
+
+    QDPEvictionPolicy*  evict_policy;
+    bool                evict_verbose = false;
+    unsigned long       tick = 0;              // kernels launched
+    bool                in_kernel_args = false;
+
+    long                evict_calls = 0;
+    long                evict_entries = 0;
+    long                evict_clean = 0;
+    size_t              evict_bytes = 0;
+    size_t              evict_copied = 0;
+
+    bool                compact_enabled = true;
+    long                compact_calls = 0;
+    size_t              compact_bytes = 0;
+    double              compact_ms = 0.;
+
+    std::string         trace_fname;
+    QDPCacheTraceWriter trace_writer;
   };
 
   QDPCache& QDP_get_global_cache();
@@ -0,0 +1,84 @@
+// -*- C++ -*-
+
+#ifndef QDP_CACHE_EVICT
+#define QDP_CACHE_EVICT
+
+#include <vector>
+#include <string>
+
+namespace QDP
+{
+
+  // Eviction from the device pool
+  //
+  // When an allocation doesn't fit, the cache hands the pool blocks in
+  // address order to the policy. The policy returns the entries to spill;
+  // the cache spills them and retries. An empty answer means nothing
+  // can be done.
+  //
+  // Policies (-cache-evict name):
+  //   lru  - the least recently used entry, one at a time
+  //   cost - the cheapest run of adjacent blocks large enough for the
+  //          allocation. Free blocks cost nothing, an entry costs its
+  //          copy to the host (none if clean) plus its expected refetch,
+  //          which falls with the number of kernels since its last use.
+
+  struct QDPEvictBlock
+  {
+    size_t        size;
+    int           id;         // cache id, -1 if the block is free
+    bool          evictable;  // false for static and in-use entries
+    bool          clean;      // the host copy is current
+    unsigned long age;        // kernels since last use
+    int           arena;      // blocks are adjacent only within an arena
+  };
+
+
+  class QDPEvictionPolicy
+  {
+  public:
+    virtual ~QDPEvictionPolicy() {}
+
+    virtual const char* name() const = 0;
+
+    //! Cache ids to spill so that n_bytes fit
+    virtual std::vector<int> victims( const std::vector<QDPEvictBlock>& blocks , size_t n_bytes ) = 0;
+  };
+
+
+  //! "lru" or "cost", NULL if unknown
+  QDPEvictionPolicy* qdp_eviction_policy_create( const std::string& name );
+
+
+  //! The pool's blocks in address order (per arena); owner( ptr , block ) fills in id, evictable, clean, age
+  template<class Allocator, class Owner>
+  std::vector<QDPEvictBlock> qdp_evict_blocks( QDPPoolAllocator<Allocator>& pool , const Owner& owner )
+  {
+    std::vector<QDPEvictBlock> blocks;
+    for ( auto& p : pool.blocks() ) {
+      QDPEvictBlock b;
+      b.size      = p.size;
+      b.id        = -1;
+      b.evictable = false;
+      b.clean     = true;
+      b.age       = 0;
+      b.arena     = p.arena;
+      if (p.allocated)
+	owner( p.ptr , b );
+      blocks.push_back( b );
+    }
+    return blocks;
+  }
+
+
+  //! The size the pool allocates for n_bytes
+  template<class Allocator>
+  size_t qdp_evict_size( size_t n_bytes )
+  {
+    size_t alignment = Allocator::ALIGNMENT_SIZE;
+    return (n_bytes + (alignment) - 1) & ~((alignment) - 1);
+  }
+
+}
+
+#endif
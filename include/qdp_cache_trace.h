@@ -0,0 +1,68 @@
+// -*- C++ -*-
+
+#ifndef QDP_CACHE_TRACE
+#define QDP_CACHE_TRACE
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+
+namespace QDP
+{
+
+  // Binary trace of the device memory system (-cache-trace file)
+  //
+  // A header, then fixed size records in event order. One file per node,
+  // with the node number appended on more than one node.
+  //
+  //   ev  event                 id      size
+  //   a   entry added           entry   bytes
+  //   s   static allocation     entry   bytes
+  //   d   sign off              entry
+  //   k   kernel launch                 number of arguments, one u each follows
+  //   u   kernel argument       entry
+  //   r   read-only host access entry
+  //   w   writable host access  entry
+  //   >   copy to the device    entry   bytes
+  //   <   copy to the host      entry   bytes
+  //   A   pool allocation       entry   bytes, rounded by the pool
+  //   F   pool free             entry   bytes
+  //   S   spill                         bytes needed
+  //   C   compaction                    bytes moved
+  //
+  // a s d k u r w drive a replay (examples/t_cache_evict_sim), the others
+  // record what the run did.
+
+  struct QDPCacheTraceRecord
+  {
+    uint64_t time;    // ns since the trace was opened
+    uint64_t size;
+    int32_t  id;
+    char     ev;
+    char     pad[3];
+  };
+
+
+  class QDPCacheTraceWriter
+  {
+  public:
+    bool is_open() const { return file.is_open(); }
+    bool open( const std::string& fname );
+    void write( char ev , int id , size_t size );
+    //! false if writing failed
+    bool close();
+
+  private:
+    std::ofstream file;
+    std::chrono::steady_clock::time_point start;
+  };
+
+
+  //! false if the file can't be read or isn't a trace
+  bool qdp_cache_trace_read( const std::string& fname , std::vector<QDPCacheTraceRecord>& records );
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+// -*- C++ -*-
+
+#ifndef QDP_COMMTHREAD_H
+#define QDP_COMMTHREAD_H
+
+namespace QDP {
+
+  struct FnMapRsrc;
+
+  // Communication progress thread (-comm-thread)
+  //
+  // Without it send_receive copies the send buffer to the host and
+  // starts the messages, qmp_wait waits for all of them and copies the
+  // receive buffer to the device, both blocking the host.
+  //
+  // With it send_receive only records an event after the gather kernel
+  // and hands the exchange to the thread. The thread starts the
+  // receives right away, once the event has passed copies the send
+  // buffer to the host on its own stream and starts the sends, then
+  // polls the messages and copies each receive to the device as soon as
+  // it has landed. qmp_wait waits for the messages only, the copies are
+  // waited for on the device before the face kernel. Inner kernels
+  // launched in between run while the thread progresses the exchange.
+  // Without progress the thread sleeps between polls. Before reusing a
+  // resource's receive buffer it waits for the previous copies, with
+  // GPUDirect for the event, which follows the previous face kernel.
+  //
+  // QMP must provide QMP_THREAD_MULTIPLE, otherwise the flag is dropped.
+
+  void comm_thread_start();
+  void comm_thread_stop();
+  bool comm_thread_running();
+
+  //! After the gather kernel has been launched
+  void comm_thread_post( const FnMapRsrc& r );
+
+  //! Until the messages have completed, makes the launch stream wait for the copies to the device
+  void comm_thread_wait( const FnMapRsrc& r );
+
+}
+
+#endif
@@ -14,6 +14,7 @@ namespace QDP {
   void CudaCheckResult(CUresult ret);
 
   void CudaInit();
+  void CudaSetCurrentContext();
   //int CudaGetConfig(CUdevice_attribute what);
   int CudaGetConfig(int what);
   void CudaGetSM(int* maj,int* min);
@@ -23,6 +24,13 @@ namespace QDP {
 			 unsigned int  blockDimX, unsigned int  blockDimY, unsigned int  blockDimZ, 
 			 unsigned int  sharedMemBytes, CUstream hStream, void** kernelParams, void** extra );
 
+  // Settled kernels may be launched without synchronization
+  // (-launch-async). Their errors show at the next synchronizing
+  // call, which reports the launches since the last sync.
+  void CudaLaunchLogAdd( CUfunction f , unsigned gridDimX , unsigned gridDimY , unsigned blockDimX );
+  void CudaLaunchLogReport();
+  void CudaLaunchSync( const char * where );
+
   int CudaAttributeNumRegs( CUfunction f );
   int CudaAttributeLocalSize( CUfunction f );
   int CudaAttributeConstSize( CUfunction f );
@@ -53,6 +61,7 @@ namespace QDP {
   void CudaMemcpyD2HAsync( void * dest , const void * src , size_t size );
   void CudaMemcpyH2D( void * dest , const void * src , size_t size );
   void CudaMemcpyD2H( void * dest , const void * src , size_t size );
+  void CudaMemcpyD2D( void * dest , const void * src , size_t size );
 
   bool CudaMalloc( void **mem , const size_t size );
   //  void CudaMallocHost( void **mem , size_t size );
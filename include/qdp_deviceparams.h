@@ -27,6 +27,7 @@ namespace QDP {
     }
 
     void setSM(int sm);
+    void setHost();
 
     size_t getMaxGridX() const {return max_gridx;}
     size_t getMaxGridY() const {return max_gridy;}
@@ -42,6 +43,8 @@ namespace QDP {
     bool getDivRnd() { return divRnd; }
     bool getSyncDevice() { return syncDevice; }
     bool getGPUDirect() { return GPUDirect; }
+    bool getAsyncLaunch() { return asyncLaunch; }
+    bool getCommThread() { return commThread; }
     void setENVVAR(const char * envvar_) {
       envvar = envvar_;
     } 
@@ -56,6 +59,14 @@ namespace QDP {
       QDP_info_primary("Setting GPU Direct = %d",(int)direct);
       GPUDirect = direct;
     };
+    void setAsyncLaunch(bool async) { 
+      QDP_info_primary("Setting async kernel launch = %d",(int)async);
+      asyncLaunch = async;
+    };
+    void setCommThread(bool thread) { 
+      QDP_info_primary("Setting communication thread = %d",(int)thread);
+      commThread = thread;
+    };
 
     unsigned getMaxKernelArg() { return maxKernelArg; }
     unsigned getMajor() { return major; }
@@ -66,7 +77,7 @@ namespace QDP {
     void autoDetect();
 
   private:
-    DeviceParams(): boolNoReadSM(false), GPUDirect(false), syncDevice(false), maxKernelArg(512){}; // Private constructor
+    DeviceParams(): boolNoReadSM(false), GPUDirect(false), syncDevice(false), asyncLaunch(false), commThread(false), maxKernelArg(512){}; // Private constructor
     DeviceParams(const DeviceParams&);                                           // Prevent copy-construction
     DeviceParams& operator=(const DeviceParams&);
     size_t roundDown2pow(size_t x);
@@ -77,6 +88,8 @@ namespace QDP {
     std::string envvar;
     bool GPUDirect;
     bool syncDevice;
+    bool asyncLaunch;
+    bool commThread;
     bool asyncTransfers;
     bool unifiedAddressing;
     bool divRnd;
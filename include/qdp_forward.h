@@ -133,6 +133,7 @@ namespace QDP
 
   struct ShiftPhase1;
   struct ShiftPhase2;
+  struct JitGatherBundle;
   class Map;
   struct FnMap;
   class ArrayBiDirectionalMap;
@@ -165,6 +166,10 @@ namespace QDP
   CUfunction
   function_gather_build( void* send_buf , const Map& map , const QDPExpr<RHS,OLattice<T1> >& rhs );
 
+  template<class T, class T1, class RHS>
+  void
+  function_gather_section_build( JitGatherBundle& bundle , const QDPExpr<RHS,OLattice<T1> >& rhs );
+
   namespace RNG 
   {
 //  float sranf(Seed&, Seed&, const Seed&);
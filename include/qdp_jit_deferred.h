@@ -0,0 +1,162 @@
+// -*- C++ -*-
+
+#ifndef QDP_JIT_DEFERRED_H
+#define QDP_JIT_DEFERRED_H
+
+#include <memory>
+#include <vector>
+
+namespace QDP {
+
+  // Deferred evaluation (-jit-fuse N)
+  //
+  // evaluate() of OLattice op expression on a subset is queued instead
+  // of launched. The queued statements are fused into one kernel in which
+  // every thread runs all statements for its site in order, so a value
+  // stored by one statement and loaded by a later one stays in registers
+  // and the inputs are read once. Statements with shifts read other sites
+  // and are never queued. An object used by several statements is passed
+  // as one parameter and the pointer parameters are marked noalias, the
+  // kernel key includes which statement ids are the same.
+  //
+  // The queue is flushed
+  //   - before any other kernel gets its arguments from the cache,
+  //   - on host access through the cache,
+  //   - when an object it references is signed off,
+  //   - when the subset changes or N statements are queued,
+  //   - at QDP_finalize.
+
+  //! One queued statement
+  class JitDeferred
+  {
+  public:
+    virtual ~JitDeferred() {}
+
+    //! Identifies the kernel code of this statement
+    virtual const char* pretty() const = 0;
+
+    //! Adds the statement's parameters to the kernel being built
+    virtual void build_params() = 0;
+
+    //! Emits the statement for site r_idx
+    virtual void build_body( llvm::Value* r_idx ) = 0;
+
+    //! Cache ids of the parameters, in build_params() order
+    virtual const std::vector<int>& ids() const = 0;
+  };
+
+
+  void llvm_set_fuse( int n );
+  bool jit_deferred_enabled();
+
+  //! Queues stmt (takes ownership), may flush
+  void jit_deferred_enqueue( JitDeferred* stmt , const Subset& s );
+
+  //! Launches the queued statements as one kernel
+  void jit_deferred_flush();
+
+  //! Called by the cache before an object is signed off
+  void jit_deferred_signoff( int id );
+
+
+  //! Whether an expression contains a shift
+  template<class T>
+  struct JitHasMap
+  {
+    enum { value = 0 };
+  };
+
+  template<class T>
+  struct JitHasMap< Reference<T> >
+  {
+    enum { value = JitHasMap<T>::value };
+  };
+
+  template<class A>
+  struct JitHasMap< UnaryNode<FnMap,A> >
+  {
+    enum { value = 1 };
+  };
+
+  template<class Op, class A>
+  struct JitHasMap< UnaryNode<Op,A> >
+  {
+    enum { value = JitHasMap<A>::value };
+  };
+
+  template<class Op, class A, class B>
+  struct JitHasMap< BinaryNode<Op,A,B> >
+  {
+    enum { value = JitHasMap<A>::value || JitHasMap<B>::value };
+  };
+
+  template<class Op, class A, class B, class C>
+  struct JitHasMap< TrinaryNode<Op,A,B,C> >
+  {
+    enum { value = JitHasMap<A>::value || JitHasMap<B>::value || JitHasMap<C>::value };
+  };
+
+
+  //! dest op rhs, the part of function_build/function_exec that depends on the expression
+  template<class T, class T1, class Op, class RHS>
+  class JitDeferredEval: public JitDeferred
+  {
+    typedef QDPExpr<RHS,OLattice<T1> >                                Expr_t;
+    typedef typename LeafFunctor<OLattice<T>, ParamLeaf>::Type_t      DestJit_t;
+    typedef typename AddOpParam<Op,ParamLeaf>::Type_t                 OpJit_t;
+    typedef typename ForEach<Expr_t, ParamLeaf, TreeCombine>::Type_t  View_t;
+
+  public:
+    JitDeferredEval(OLattice<T>& dest, const Op& op, const Expr_t& rhs, const Subset& s):
+      dest(dest), op(op), rhs(rhs), addr_leaf( new AddressLeaf(s) )
+    {
+      // Scalars are put into the cache now, while they exist
+      forEach(dest, *addr_leaf, NullCombine());
+      AddOpAddress<Op,AddressLeaf>::apply(op, *addr_leaf);
+      forEach(rhs, *addr_leaf, NullCombine());
+    }
+
+    const char* pretty() const { return __PRETTY_FUNCTION__; }
+
+    void build_params()
+    {
+      ParamLeaf param_leaf;
+      dest_jit.reset( new DestJit_t( forEach(dest, param_leaf, TreeCombine()) ) );
+      op_jit.reset( new OpJit_t( AddOpParam<Op,ParamLeaf>::apply(op, param_leaf) ) );
+      rhs_view.reset( new View_t( forEach(rhs, param_leaf, TreeCombine()) ) );
+    }
+
+    void build_body( llvm::Value* r_idx )
+    {
+      (*op_jit)( dest_jit->elem( JitDeviceLayout::Coalesced , r_idx ),
+		 forEach(*rhs_view, ViewLeaf( JitDeviceLayout::Coalesced , r_idx ), OpCombine()));
+    }
+
+    const std::vector<int>& ids() const { return addr_leaf->ids; }
+
+  private:
+    OLattice<T>&                   dest;
+    Op                             op;
+    Expr_t                         rhs;
+    std::unique_ptr< AddressLeaf > addr_leaf;
+
+    std::unique_ptr< DestJit_t >   dest_jit;
+    std::unique_ptr< OpJit_t >     op_jit;
+    std::unique_ptr< View_t >      rhs_view;
+  };
+
+
+  //! Queues dest op rhs if deferred evaluation is on and the expression has no shift
+  template<class T, class T1, class Op, class RHS>
+  bool jit_defer(OLattice<T>& dest, const Op& op, const QDPExpr<RHS,OLattice<T1> >& rhs, const Subset& s)
+  {
+    if (!jit_deferred_enabled() || JitHasMap<RHS>::value)
+      return false;
+
+    jit_deferred_enqueue( new JitDeferredEval<T,T1,Op,RHS>( dest , op , rhs , s ) , s );
+    return true;
+  }
+
+}
+
+#endif
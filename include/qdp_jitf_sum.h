@@ -17,15 +17,81 @@ namespace QDP {
 			  int size, int threads, int blocks, int shared_mem_usage,
 			  int in_id, int out_id);
 
+  void function_sum_expr_exec( CUfunction function, 
+			       int size, int threads, int blocks, int shared_mem_usage,
+			       const std::vector<int>& leaf_ids, int out_id, int siteTableId );
 
-  // T1 input
+  void function_sum_host_exec( JitHostFunction* function, 
+			       int size, int nchunks,
+			       const std::vector<int>& input_ids, int tmp_id, int out_id, int siteTableId );
+
+
+  // Inputs of the first reduction stage. params() adds the input's kernel
+  // parameters, store() writes the input at site r_idx to the shared memory
+  // element (this does the precision conversion).
+
+  // A lattice in device memory
+  template< class T1 , JitDeviceLayout input_layout >
+  class JitReduceInputLattice
+  {
+  public:
+    void params()
+    {
+      p_idata = llvm_add_param< typename WordType<T1>::Type_t* >();  // Input  array
+    }
+
+    template< class T2JIT >
+    void store( T2JIT& sdata_jit , llvm::Value* r_idx )
+    {
+      OLatticeJIT<typename JITType<T1>::Type_t> idata( p_idata );   // want coal   access later
+
+      typename REGType< typename JITType<T1>::Type_t >::Type_t reg_idata_elem;   // this is stupid
+      reg_idata_elem.setup( idata.elem( input_layout , r_idx ) );
+
+      sdata_jit = reg_idata_elem;
+    }
+
+  private:
+    ParamRef p_idata;
+  };
+
+
+  // An expression without shifts, evaluated per site
+  template< class RHS , class T1 >
+  class JitReduceInputExpr
+  {
+    typedef typename ForEach<QDPExpr<RHS,OLattice<T1> >, ParamLeaf, TreeCombine>::Type_t View_t;
+
+  public:
+    JitReduceInputExpr( const QDPExpr<RHS,OLattice<T1> >& rhs ) : rhs(rhs) {}
+
+    void params()
+    {
+      ParamLeaf param_leaf;
+      rhs_view.reset( new View_t( forEach(rhs, param_leaf, TreeCombine()) ) );
+    }
+
+    template< class T2JIT >
+    void store( T2JIT& sdata_jit , llvm::Value* r_idx )
+    {
+      sdata_jit = forEach(*rhs_view, ViewLeaf( JitDeviceLayout::Coalesced , r_idx ), OpCombine());
+    }
+
+  private:
+    const QDPExpr<RHS,OLattice<T1> >& rhs;
+    std::unique_ptr<View_t> rhs_view;
+  };
+
+
+
+  // First reduction stage, the input at the sites of the site table
   // T2 output
-  template< class T1 , class T2 , JitDeviceLayout input_layout >
+  template< class T2 , class Input >
   CUfunction 
-  function_sum_convert_ind_build()
+  function_sum_ind_build( Input& input , const char* pretty , const char* ptx_name )
   {
     if (ptx_db::db_enabled) {
-      CUfunction func = llvm_ptx_db( __PRETTY_FUNCTION__ );
+      CUfunction func = llvm_ptx_db( pretty );
       if (func)
 	return func;
     }
@@ -35,20 +101,17 @@ namespace QDP {
     ParamRef p_lo     = llvm_add_param<int>();
     ParamRef p_hi     = llvm_add_param<int>();
 
-    typedef typename WordType<T1>::Type_t T1WT;
     typedef typename WordType<T2>::Type_t T2WT;
 
     ParamRef p_site_perm  = llvm_add_param< int* >(); // Siteperm  array
-    ParamRef p_idata      = llvm_add_param< T1WT* >();  // Input  array
+    input.params();
     ParamRef p_odata      = llvm_add_param< T2WT* >();  // output array
 
-    OLatticeJIT<typename JITType<T1>::Type_t> idata(  p_idata );   // want coal   access later
     OLatticeJIT<typename JITType<T2>::Type_t> odata(  p_odata );   // want scalar access later
 
     llvm_derefParam( p_lo ); // r_lo
     llvm::Value* r_hi     = llvm_derefParam( p_hi );
 
-    llvm_derefParam( p_idata );  // Input  array
     llvm_derefParam( p_odata );  // output array
 
     llvm::Value* r_shared = llvm_get_shared_ptr( llvm_type<T2WT>::value );
@@ -71,10 +134,7 @@ namespace QDP {
 
     llvm::Value* r_idx_perm = llvm_array_type_indirection( p_site_perm , r_idx );
 
-    typename REGType< typename JITType<T1>::Type_t >::Type_t reg_idata_elem;   // this is stupid
-    reg_idata_elem.setup( idata.elem( input_layout , r_idx_perm ) );
-
-    sdata_jit = reg_idata_elem; // This should do the precision conversion (SP->DP)
+    input.store( sdata_jit , r_idx_perm ); // This should do the precision conversion (SP->DP)
 
     llvm_bar_sync();
 
@@ -174,7 +234,107 @@ namespace QDP {
     llvm_branch( block_not_store_global );
     llvm_set_insert_point(block_not_store_global);
 
-    return jit_function_epilogue_get_cuf("jit_sum_ind.ptx" , __PRETTY_FUNCTION__ );
+    return jit_function_epilogue_get_cuf( ptx_name , pretty );
+  }
+
+
+
+  // Host version of the first reduction stage (see qdp_llvm_host.h).
+  // Thread c sums the input at the sites [c*chunk,(c+1)*chunk) of the site
+  // table into odata[c], tmp[c] holds the input of one site.
+  // T2 output
+  template< class T2 , class Input >
+  JitHostFunction*
+  function_sum_host_build( Input& input )
+  {
+    llvm_start_new_host_function();
+
+    typedef typename WordType<T2>::Type_t T2WT;
+
+    ParamRef p_size       = llvm_add_param<int>();
+    ParamRef p_chunk      = llvm_add_param<int>();
+    ParamRef p_site_perm  = llvm_add_param< int* >(); // Siteperm  array
+    input.params();
+    ParamRef p_tmp        = llvm_add_param< T2WT* >();  // one site per chunk
+    ParamRef p_odata      = llvm_add_param< T2WT* >();  // partial sum per chunk
+
+    llvm::Value* r_size  = llvm_derefParam( p_size );
+    llvm::Value* r_chunk = llvm_derefParam( p_chunk );
+    llvm::Value* r_tmp   = llvm_derefParam( p_tmp );
+    llvm::Value* r_odata = llvm_derefParam( p_odata );
+
+    typedef typename JITType<T2>::Type_t T2JIT;
+
+    llvm::Value* r_c  = llvm_thread_idx();
+    llvm::Value* r_lo = llvm_mul( r_c , r_chunk );
+    llvm::Value* r_hi = llvm_add( r_lo , r_chunk );
+
+    IndexDomainVector args;
+    args.push_back( make_pair( Layout::sitesOnNode() , r_c ) );  // sitesOnNode irrelevant since Scalar access later
+
+    T2JIT sum_jit;
+    sum_jit.setup( r_odata , JitDeviceLayout::Scalar , args );
+    zero_rep( sum_jit );
+
+    T2JIT tmp_jit;
+    tmp_jit.setup( r_tmp , JitDeviceLayout::Scalar , args );
+
+    llvm::BasicBlock * entry_block     = llvm_get_insert_block();
+    llvm::BasicBlock * block_site_loop = llvm_new_basic_block();
+    llvm::BasicBlock * block_site      = llvm_new_basic_block();
+    llvm::BasicBlock * block_exit      = llvm_new_basic_block();
+
+    llvm_branch( block_site_loop );
+    llvm_set_insert_point( block_site_loop );
+
+    llvm::PHINode * r_i = llvm_phi( llvm_type<int>::value , 2 );
+    r_i->addIncoming( r_lo , entry_block );
+
+    llvm_cond_branch( llvm_or( llvm_ge( r_i , r_hi ) , llvm_ge( r_i , r_size ) ) , block_exit , block_site );
+    {
+      llvm_set_insert_point( block_site );
+
+      llvm::Value* r_idx_perm = llvm_array_type_indirection( p_site_perm , r_i );
+
+      input.store( tmp_jit , r_idx_perm ); // This should do the precision conversion (SP->DP)
+
+      typename REGType< T2JIT >::Type_t tmp_reg;
+      tmp_reg.setup( tmp_jit );
+
+      sum_jit += tmp_reg;
+
+      r_i->addIncoming( llvm_add( r_i , llvm_create_value(1) ) , llvm_get_insert_block() );
+      llvm_branch( block_site_loop );
+    }
+
+    llvm_set_insert_point( block_exit );
+
+    return llvm_get_hostfunction( __PRETTY_FUNCTION__ );
+  }
+
+
+
+  // T1 input
+  // T2 output
+  template< class T1 , class T2 , JitDeviceLayout input_layout >
+  CUfunction 
+  function_sum_convert_ind_build()
+  {
+    JitReduceInputLattice<T1,input_layout> input;
+    return function_sum_ind_build<T2>( input , __PRETTY_FUNCTION__ , "jit_sum_ind.ptx" );
+  }
+
+
+
+  // First reduction stage with the expression evaluated per site
+  // T1 expression type
+  // T2 output
+  template< class RHS , class T1 , class T2 >
+  CUfunction 
+  function_sum_expr_build(const QDPExpr<RHS,OLattice<T1> >& rhs)
+  {
+    JitReduceInputExpr<RHS,T1> input( rhs );
+    return function_sum_ind_build<T2>( input , __PRETTY_FUNCTION__ , "jit_sum_expr.ptx" );
   }
 
 
@@ -20,37 +20,42 @@ namespace QDP {
 			  int numsubsets,
 			  const multi1d<int>& sizes );
 
+  void
+  function_summulti_expr_exec( CUfunction function, 
+			       int size, int threads, int blocks, int shared_mem_usage,
+			       const std::vector<int>& leaf_ids, int out_id,
+			       int numsubsets,
+			       const multi1d<int>& sizes,
+			       const multi1d<int>& table_ids );
+
 
   
-  // T1 input
+  // First reduction stage, the input at the sites of each subset's site table
   // T2 output
-  template< class T1 , class T2 , JitDeviceLayout input_layout >
+  template< class T2 , class Input >
   CUfunction
-  function_summulti_convert_ind_build()
+  function_summulti_ind_build( Input& input , const char* pretty , const char* ptx_name )
   {
     if (ptx_db::db_enabled) {
-      CUfunction func = llvm_ptx_db( __PRETTY_FUNCTION__ );
+      CUfunction func = llvm_ptx_db( pretty );
       if (func)
 	return func;
     }
 
     llvm_start_new_function();
 
-    typedef typename WordType<T1>::Type_t T1WT;
     typedef typename WordType<T2>::Type_t T2WT;
 
     ParamRef p_numsubset  = llvm_add_param< int  >();   // number of subsets
     ParamRef p_sizes      = llvm_add_param< int* >();   // size (per subset)
     ParamRef p_sitetables = llvm_add_param< int** >();  // sitetable (per subset)
-    ParamRef p_idata      = llvm_add_param< T1WT* >();  // Input  array
+    input.params();
     ParamRef p_odata      = llvm_add_param< T2WT* >();  // output array
 
-    OLatticeJIT<typename JITType<T1>::Type_t> idata(  p_idata );   // want coal   access later
     OLatticeJIT<typename JITType<T2>::Type_t> odata(  p_odata );   // want scalar access later
 
     llvm::Value* r_subsetnum = llvm_derefParam( p_numsubset );
 
-    llvm_derefParam( p_idata );  // Input  array
     llvm_derefParam( p_odata );  // output array
 
     llvm::Value* r_shared = llvm_get_shared_ptr( llvm_type<T2WT>::value );
@@ -109,10 +114,7 @@ namespace QDP {
       llvm::Value* r_sitetable = llvm_array_type_indirection( p_sitetables , r_subset );
       llvm::Value* r_idx_perm  = llvm_array_type_indirection( r_sitetable , r_idx );
 
-      typename REGType< typename JITType<T1>::Type_t >::Type_t reg_idata_elem;
-      reg_idata_elem.setup( idata.elem( input_layout , r_idx_perm ) );
-
-      sdata_jit = reg_idata_elem; // This should do the precision conversion (SP->DP)
+      input.store( sdata_jit , r_idx_perm ); // This should do the precision conversion (SP->DP)
 
       llvm_bar_sync();
 
@@ -218,7 +220,33 @@ namespace QDP {
     llvm_set_insert_point(block_subset_loop_exit);
 
     
-    return jit_function_epilogue_get_cuf("jit_summulti_ind.ptx" , __PRETTY_FUNCTION__ );
+    return jit_function_epilogue_get_cuf( ptx_name , pretty );
+  }
+
+
+
+  // T1 input
+  // T2 output
+  template< class T1 , class T2 , JitDeviceLayout input_layout >
+  CUfunction
+  function_summulti_convert_ind_build()
+  {
+    JitReduceInputLattice<T1,input_layout> input;
+    return function_summulti_ind_build<T2>( input , __PRETTY_FUNCTION__ , "jit_summulti_ind.ptx" );
+  }
+
+
+
+
+  // First reduction stage with the expression evaluated per site
+  // T1 expression type
+  // T2 output
+  template< class RHS , class T1 , class T2 >
+  CUfunction
+  function_summulti_expr_build(const QDPExpr<RHS,OLattice<T1> >& rhs)
+  {
+    JitReduceInputExpr<RHS,T1> input( rhs );
+    return function_summulti_ind_build<T2>( input , __PRETTY_FUNCTION__ , "jit_summulti_expr.ptx" );
   }
 
 
@@ -416,6 +416,7 @@ function_lat_sca_exec(CUfunction function, OLattice<T>& dest, const Op& op, cons
   AddressLeaf addr_leaf(s);
 
   forEach(dest, addr_leaf, NullCombine());
+  std::vector<int> written( addr_leaf.ids );   // the kernel writes dest only
   AddOpAddress<Op,AddressLeaf>::apply(op,addr_leaf);
   forEach(rhs, addr_leaf, NullCombine());
 
@@ -435,7 +436,7 @@ function_lat_sca_exec(CUfunction function, OLattice<T>& dest, const Op& op, cons
   for(unsigned i=0; i < addr_leaf.ids.size(); ++i)
     ids.push_back( addr_leaf.ids[i] );
  
-  jit_launch(function,th_count,ids);
+  jit_launch(function,th_count,ids,&written);
 }
 
 
@@ -852,8 +853,8 @@ template<class T1, class RHS>
 void
   function_gather_exec( CUfunction function, int send_buf_id , const Map& map , const QDPExpr<RHS,OLattice<T1> >& rhs , const Subset& subset )
 {
-
-  AddressLeaf addr_leaf(subset);
+  // Maps in the gathered expression were exchanged for all sites
+  AddressLeaf addr_leaf(all);
 
   forEach(rhs, addr_leaf, NullCombine());
 
@@ -892,6 +893,76 @@ void
 }
 
 
+//! Adds a map's section to the bundled gather kernel being built (see JitGatherBundle)
+template<class T, class T1, class RHS>
+void
+function_gather_section_build( JitGatherBundle& bundle , const QDPExpr<RHS,OLattice<T1> >& rhs )
+{
+  typedef typename WordType<T1>::Type_t WT;
+
+  ParamRef p_lo      = llvm_add_param<int>();
+  ParamRef p_hi      = llvm_add_param<int>();
+  ParamRef p_soffset = llvm_add_param<int*>();
+  ParamRef p_sndbuf  = llvm_add_param<WT*>();
+
+  ParamLeaf param_leaf;
+
+  typedef typename ForEach<QDPExpr<RHS,OLattice<T1> >, ParamLeaf, TreeCombine>::Type_t View_t;
+  View_t rhs_view( forEach( rhs , param_leaf , TreeCombine() ) );
+
+  // The code follows once all parameters are known
+  bundle.sections.push_back( [=]( llvm::Value * r_idx ) {
+      typedef typename JITType< OLattice<T> >::Type_t DestView_t;
+      DestView_t dest_jit( p_sndbuf );
+
+      llvm::Value * r_i = llvm_sub( r_idx , llvm_derefParam( p_lo ) );
+
+      llvm::BasicBlock * block_section = llvm_new_basic_block();
+      llvm::BasicBlock * block_next    = llvm_new_basic_block();
+      llvm_cond_branch( llvm_and( llvm_ge( r_i , llvm_create_value(0) ) ,
+				  llvm_lt( r_i , llvm_derefParam( p_hi ) ) ) ,
+			block_section ,
+			block_next );
+      llvm_set_insert_point( block_section );
+
+      llvm::Value * r_idx_site = llvm_array_type_indirection( p_soffset , r_i );
+
+      OpAssign()( dest_jit.elem( JitDeviceLayout::Scalar , r_i ) , 
+		  forEach(rhs_view, ViewLeaf( JitDeviceLayout::Coalesced , r_idx_site ) , OpCombine() ) );
+
+      llvm_branch( block_next );
+      llvm_set_insert_point( block_next );
+    } );
+}
+
+
+//! One kernel packing the faces of all maps at the top of rhs
+template<class T1, class RHS>
+CUfunction
+function_gather_bundle_build( const QDPExpr<RHS,OLattice<T1> >& rhs )
+{
+  if (ptx_db::db_enabled) {
+    CUfunction func = llvm_ptx_db( __PRETTY_FUNCTION__ );
+    if (func)
+      return func;
+  }
+
+  llvm_start_new_function();
+
+  JitGatherBundle bundle( true );
+  ShiftPhase1 phase1( all , &bundle );
+  forEach( rhs , phase1 , BitOrCombine() );
+
+  llvm::Value * r_idx = llvm_thread_idx();
+
+  for ( auto& section : bundle.sections )
+    section( r_idx );
+
+  return jit_function_epilogue_get_cuf("jit_gather_bundle.ll" , __PRETTY_FUNCTION__ );
+}
+
+
+
 namespace COUNT {
   extern int count;
 }
@@ -903,11 +974,28 @@ function_exec(CUfunction function, OLattice<T>& dest, const Op& op, const QDPExp
 {
   //QDPIO::cout << __PRETTY_FUNCTION__ << "\n";
 
-  ShiftPhase1 phase1(s);
+  // The faces of all off-node maps are packed by one kernel into one
+  // buffer, then one message per peer node is started
+  JitGatherBundle bundle( false );
+  ShiftPhase1 phase1(s, &bundle);
   int offnode_maps = forEach(rhs, phase1 , BitOrCombine());
+  bundle.acquire();
+
+  if (bundle.rsrc)
+    {
+      static CUfunction gather;
+
+      if (gather == NULL)
+	gather = function_gather_bundle_build( rhs );
+
+      jit_launch( gather , bundle.count , bundle.addr.ids );
+
+      bundle.rsrc->send_receive();
+    }
 
   AddressLeaf addr_leaf(s);
   forEach(dest, addr_leaf, NullCombine());
+  std::vector<int> written( addr_leaf.ids );   // the kernel writes dest only
   AddOpAddress<Op,AddressLeaf>::apply(op,addr_leaf);
   forEach(rhs, addr_leaf, NullCombine());
 
@@ -932,7 +1020,7 @@ function_exec(CUfunction function, OLattice<T>& dest, const Op& op, const QDPExp
       for(unsigned i=0; i < addr_leaf.ids.size(); ++i) 
 	ids.push_back( addr_leaf.ids[i] );
  
-      jit_launch(function,th_count,ids);
+      jit_launch(function,th_count,ids,&written);
     }
   else
     {
@@ -957,13 +1045,12 @@ function_exec(CUfunction function, OLattice<T>& dest, const Op& op, const QDPExp
 	for(unsigned i=0; i < addr_leaf.ids.size(); ++i) 
 	  ids.push_back( addr_leaf.ids[i] );
  
-	jit_launch(function,th_count,ids);
+	jit_launch(function,th_count,ids,&written);
       }
       
       // 2nd call: face
       {
-	ShiftPhase2 phase2;
-	forEach(rhs, phase2 , NullCombine());
+	bundle.rsrc->qmp_wait();
 
 	int th_count = MasterMap::Instance().getCountFace(s,offnode_maps);
       
@@ -984,7 +1071,7 @@ function_exec(CUfunction function, OLattice<T>& dest, const Op& op, const QDPExp
 	for(unsigned i=0; i < addr_leaf.ids.size(); ++i) 
 	  ids.push_back( addr_leaf.ids[i] );
  
-	jit_launch(function,th_count,ids);
+	jit_launch(function,th_count,ids,&written);
       }
 
       
@@ -1010,6 +1097,7 @@ function_subtype_type_exec(CUfunction function, OSubLattice<T>& dest, const Op&
 
   AddressLeaf addr_leaf(s);
   forEach(dest, addr_leaf, NullCombine());
+  std::vector<int> written( addr_leaf.ids );   // the kernel writes dest only
   AddOpAddress<Op,AddressLeaf>::apply(op,addr_leaf);
   forEach(rhs, addr_leaf, NullCombine());
 
@@ -1021,7 +1109,7 @@ function_subtype_type_exec(CUfunction function, OSubLattice<T>& dest, const Op&
   for(unsigned i=0; i < addr_leaf.ids.size(); ++i) 
     ids.push_back( addr_leaf.ids[i] );
  
-  jit_launch(function,th_count,ids);
+  jit_launch(function,th_count,ids,&written);
 }
 
 
@@ -1039,6 +1127,7 @@ operator_type_subtype_exec(CUfunction function, OLattice<T>& dest, const Op& op,
 
   AddressLeaf addr_leaf(s);
   forEach(dest, addr_leaf, NullCombine());
+  std::vector<int> written( addr_leaf.ids );   // the kernel writes dest only
   AddOpAddress<Op,AddressLeaf>::apply(op,addr_leaf);
   forEach(rhs, addr_leaf, NullCombine());
 
@@ -1050,7 +1139,7 @@ operator_type_subtype_exec(CUfunction function, OLattice<T>& dest, const Op& op,
   for(unsigned i=0; i < addr_leaf.ids.size(); ++i) 
     ids.push_back( addr_leaf.ids[i] );
  
-  jit_launch(function,th_count,ids);
+  jit_launch(function,th_count,ids,&written);
 }
 
 
@@ -1068,6 +1157,7 @@ operator_subtype_subtype_exec(CUfunction function, OSubLattice<T>& dest, const O
 
   AddressLeaf addr_leaf(s);
   forEach(dest, addr_leaf, NullCombine());
+  std::vector<int> written( addr_leaf.ids );   // the kernel writes dest only
   AddOpAddress<Op,AddressLeaf>::apply(op,addr_leaf);
   forEach(rhs, addr_leaf, NullCombine());
 
@@ -1078,7 +1168,7 @@ operator_subtype_subtype_exec(CUfunction function, OSubLattice<T>& dest, const O
   for(unsigned i=0; i < addr_leaf.ids.size(); ++i) 
     ids.push_back( addr_leaf.ids[i] );
  
-  jit_launch(function,th_count,ids);
+  jit_launch(function,th_count,ids,&written);
 }
 
 
@@ -1100,6 +1190,7 @@ function_lat_sca_subtype_exec(CUfunction function, OSubLattice<T>& dest, const O
   AddressLeaf addr_leaf(s);
 
   forEach(dest, addr_leaf, NullCombine());
+  std::vector<int> written( addr_leaf.ids );   // the kernel writes dest only
   AddOpAddress<Op,AddressLeaf>::apply(op,addr_leaf);
   forEach(rhs, addr_leaf, NullCombine());
 
@@ -1110,7 +1201,7 @@ function_lat_sca_subtype_exec(CUfunction function, OSubLattice<T>& dest, const O
   for(unsigned i=0; i < addr_leaf.ids.size(); ++i) 
     ids.push_back( addr_leaf.ids[i] );
  
-  jit_launch(function,th_count,ids);
+  jit_launch(function,th_count,ids,&written);
 }
 
 
@@ -66,6 +66,8 @@
 #include "llvm/Support/Host.h"
 
 #include <system_error>
+#include <map>
+#include <chrono>
 
 //#include "llvm/ExecutionEngine/ObjectBuffer.h"
 #include "llvm/IR/GlobalVariable.h"
@@ -102,20 +104,88 @@ namespace QDP {
 
   CUfunction llvm_ptx_db( const char * pretty );
   
-  extern llvm::LLVMContext TheContext;
-
   typedef int ParamRef;
 
-  // llvm::IRBuilder<> *builder;
-  // llvm::BasicBlock  *entry;
-  extern llvm::Function    *mainFunc;
-  extern llvm::Function    *mainFunc_extern;
-  //extern llvm::Module      *Mod;
+
+  // Build profile of one kernel, times in microseconds. The phases
+  // after IR construction may run on a worker thread.
+  struct JitKernelStats
+  {
+    std::string pretty;
+    bool        from_db     = false;  // PTX found in the DB by IR hash
+    bool        host        = false;
+    double      build       = 0;      // IR construction (function_build)
+    double      libdevice   = 0;      // libdevice import
+    double      optimize    = 0;      // optimize_module
+    double      codegen     = 0;      // PTX or host code generation
+    double      load        = 0;      // cuModuleLoadData
+    long        inst_before = 0;      // IR instructions before optimization
+    long        inst_after  = 0;      // IR instructions after optimization
+    size_t      ptx_size    = 0;
+
+    std::chrono::steady_clock::time_point start;
+
+    double total() const { return build + libdevice + optimize + codegen + load; }
+  };
+
+  double jit_us_since( const std::chrono::steady_clock::time_point& start );
+  long   llvm_count_instructions( const llvm::Module& M );
+
+  void llvm_set_kernel_stats( bool print );
+  void llvm_set_kernel_stats_json( const char * c_str );
+  void llvm_kernel_stats_report();
+
+  // State of one kernel compilation. The IR is built on the calling
+  // thread, optimization and PTX codegen may then run on a worker
+  // thread. Each compilation owns its LLVMContext, so no LLVM state
+  // is shared between threads. Compilations are recycled, a context
+  // keeps its lazily loaded libdevice module across kernels.
+  struct JitCompilation
+  {
+    JitCompilation();
+
+    llvm::LLVMContext                    context;
+    std::unique_ptr< llvm::Module >      Mod;
+    std::unique_ptr< llvm::IRBuilder<> > builder;
+
+    llvm::Function*                      mainFunc;
+    std::vector< llvm::Type* >           vecParamType;
+    std::vector< llvm::Value* >          vecArgument;
+    bool                                 function_created;
+    int                                  label_counter;
+
+    // Built for the host CPU instead of NVPTX (see qdp_llvm_host.h)
+    bool                                 host;
+
+    // Cache ids of the parameters to be added, see llvm_param_ids
+    std::vector< int >                   param_ids;
+    size_t                               param_ids_next;
+    std::map< int , ParamRef >           param_by_id;
+
+    std::shared_ptr< JitKernelStats >    stats;
+
+    llvm::Function*                      func_seed2float;
+    llvm::Function*                      func_seedMultiply;
+
+    // libdevice, function bodies are parsed on first use
+    std::unique_ptr< llvm::Module >      libdevice;
+    std::map< const llvm::Function* , std::vector< llvm::GlobalValue* > > libdevice_deps;
+  };
+
+  // The compilation being built on this thread
+  JitCompilation& jit_current();
+
+  // Drops the compilation being built on this thread
+  void jit_release_current();
+
+  void llvm_set_threads( int n );
+  void llvm_set_bcast( bool b );
 
 
   void llvm_set_debug( const char * str );
   void llvm_set_opt( const char * c_str );
   void llvm_set_ptxdb( const char * c_str );
+  void llvm_set_manifest( const char * c_str );
   void llvm_debug_write_set_name( const char* pretty, const char* additional );
 
   std::string get_ptx_db_fname();
@@ -131,14 +201,14 @@ namespace QDP {
 
   template<class T> struct llvm_type;
 
-  template<> struct llvm_type<float> { static llvm::Type* value; };
-  template<> struct llvm_type<double> { static llvm::Type* value; };
-  template<> struct llvm_type<int> { static llvm::Type* value; };
-  template<> struct llvm_type<bool> { static llvm::Type* value; };
-  template<> struct llvm_type<float*> { static llvm::Type* value; };
-  template<> struct llvm_type<double*> { static llvm::Type* value; };
-  template<> struct llvm_type<int*> { static llvm::Type* value; };
-  template<> struct llvm_type<bool*> { static llvm::Type* value; };
+  template<> struct llvm_type<float> { static thread_local llvm::Type* value; };
+  template<> struct llvm_type<double> { static thread_local llvm::Type* value; };
+  template<> struct llvm_type<int> { static thread_local llvm::Type* value; };
+  template<> struct llvm_type<bool> { static thread_local llvm::Type* value; };
+  template<> struct llvm_type<float*> { static thread_local llvm::Type* value; };
+  template<> struct llvm_type<double*> { static thread_local llvm::Type* value; };
+  template<> struct llvm_type<int*> { static thread_local llvm::Type* value; };
+  template<> struct llvm_type<bool*> { static thread_local llvm::Type* value; };
 
   struct IndexRet {
     IndexRet(){}
@@ -161,7 +231,9 @@ namespace QDP {
   llvm::Value *llvm_get_arg_start();
 
   void llvm_start_new_function();
+  void llvm_start_new_host_function();
   void llvm_wrapper_init();
+  void optimize_module( std::unique_ptr< llvm::TargetMachine >& TM );
   llvm::PHINode * llvm_phi( llvm::Type* type, unsigned num = 0 );
   llvm::Type* promote( llvm::Type* t0 , llvm::Type* t1 );
   llvm::Value* llvm_cast( llvm::Type *dest_type , llvm::Value *src );
@@ -223,6 +295,14 @@ namespace QDP {
   template<> ParamRef llvm_add_param<float**>();
   template<> ParamRef llvm_add_param<double**>();
 
+  //! The next parameters get these cache ids, a parameter of an id added before is reused
+  void llvm_param_ids( const std::vector<int>& ids );
+  //! Whether all ids given to llvm_param_ids got their parameter
+  bool llvm_param_ids_done();
+
+  //! Pointer parameters don't alias each other, call after the function was created
+  void llvm_set_params_noalias();
+
   void llvm_module_dump();
   
   llvm::Value * llvm_derefParam( ParamRef r );
@@ -273,6 +353,14 @@ namespace QDP {
 
   CUfunction llvm_get_cufunction(const char* fname, const char* pretty);
 
+  // Kernels may be handed out before their codegen finished.
+  // These return the loaded kernel, waiting for codegen if needed.
+  CUfunction llvm_resolve_cufunction( CUfunction f );
+  void       llvm_resolve_all();
+
+  // PTX DB id of a kernel, empty if unknown
+  std::string llvm_get_kernel_id( CUfunction f );
+
 
   llvm::Value* llvm_sin_f32( llvm::Value* lhs );
   llvm::Value* llvm_acos_f32( llvm::Value* lhs );
@@ -0,0 +1,56 @@
+// -*- C++ -*-
+
+#ifndef QDP_LLVM_HOST_H
+#define QDP_LLVM_HOST_H
+
+#include <vector>
+#include <string>
+
+namespace QDP {
+
+  // Host CPU backend for JIT kernels
+  //
+  // A kernel started with llvm_start_new_host_function() is built with
+  // the usual llvm_* builder calls. llvm_thread_idx() then refers to a
+  // site index argument instead of the NVPTX special registers.
+  // llvm_get_hostfunction() wraps the kernel into a site loop
+  //
+  //   main_range( void** args , int lo , int hi )
+  //
+  // optimizes it for the host (inlining, loop vectorization over sites)
+  // and generates code with the MCJIT execution engine. libdevice calls
+  // are mapped to the host math library.
+  //
+  // jit_host_launch() splits the sites across the host thread pool.
+  // Arguments follow the cuLaunchKernel convention, one pointer to each
+  // parameter value; memory arguments must be host pointers.
+  //
+  // Kernels using shared memory or barriers are GPU only. The reductions
+  // of sum() and sumMulti() have a host version instead: one kernel
+  // thread sums a chunk of the sites into a partial sum, the partial sums
+  // are added on the host (function_sum_host_build). globalMax() and the
+  // reductions of OSubLattice are GPU only.
+  //
+  // In host mode (no CUDA device found, or -llvm-host) every kernel is
+  // built this way. llvm_get_cufunction() hands out the host function
+  // as CUfunction and jit_launch() runs it with jit_host_launch(). The
+  // cache's device memory is host memory then (see qdp_cuda.cc), so the
+  // kernel arguments are the same as for the device.
+
+  struct JitHostFunction;
+
+  bool jit_host_mode();
+  void jit_host_set_mode( bool host );
+
+  void llvm_host_init( int nthreads );
+  void llvm_set_host_threads( int n );
+  //! Threads sharing a launch, valid after the first kernel was built
+  int jit_host_threads();
+
+  JitHostFunction* llvm_get_hostfunction( const char* pretty );
+
+  void jit_host_launch( JitHostFunction* func , int th_count , std::vector<void*>& args );
+
+}
+
+#endif
@@ -74,7 +74,7 @@ public:
   FnMap(const Map& m);
   FnMap(const FnMap& f);
 
-  const FnMapRsrc& getResource(int srcnum_, int dstnum_) {
+  const FnMapRsrc& getResource(const std::vector<int>& srcnum_, const std::vector<int>& dstnum_) {
     //assert(pRsrc);
     return pRsrc->getResource( srcnum_ , dstnum_ );
   }
@@ -83,6 +83,11 @@ public:
     //assert(pRsrc);
     return pRsrc->get();
   }
+
+  //! The map's part of the resource (non-zero in a bundle)
+  int getPart() const {
+    return pRsrc->getPart();
+  }
   
   template<class T>
   inline typename UnaryReturn<T, FnMap>::Type_t
@@ -222,9 +227,10 @@ private:
   void operator=(const Map&) {}
 
 private:
+  // The send and receive buffers hold one segment per peer in the order of destnodes/srcenodes
   mutable multi1d< multi1d<int> > goffsets;    // [subset no.][linear index] > 0 local, < 0 receive buffer index
-  mutable multi1d< multi1d<int> > soffsets;    // [subset no.][0..N] = linear index   N = destnodes_num
-  mutable multi1d< multi1d<int> > roffsets;    // [subset no.][0..N] = linear index   N = srcenodes_num
+  mutable multi1d< multi1d<int> > soffsets;    // [subset no.][0..N] = linear index   N = sum of destnodes_num
+  mutable multi1d< multi1d<int> > roffsets;    // [subset no.][0..N] = linear index   N = sum of srcenodes_num
 
   mutable multi1d<int> roffsetsId; // [subset no.]
   mutable multi1d<int> soffsetsId; // [subset no.]
@@ -246,7 +252,7 @@ private:
   multi1d< multi1d<int> > lazy_fcoord;
   multi1d< multi1d<int> > lazy_bcoord;
   mutable multi1d<int>    srcnode;
-  multi1d< multi1d<int> > lazy_destnodes0_fcoord;
+  multi1d<int>            dstnode;
   mutable multi1d<bool>   lazy_done;                  // [subset no.]
 };
 
@@ -422,10 +428,15 @@ struct ForEach<UnaryNode<FnMap, A>, AddressLeaf, NullCombine>
 	rid = rRSrc.getRecvBufId();
       }
 #endif
-      a.setId( map.hasOffnode() ? fnmap.getCached().getRecvBufId() : -1 );
+      a.setId( map.hasOffnode() ? fnmap.getCached().getRecvBufId( fnmap.getPart() ) : -1 );
 #endif
 
-      return Type_t( ForEach<A, AddressLeaf, NullCombine>::apply( expr.child() , a , n ) );
+      // Maps below this one were exchanged for all sites (see ShiftPhase1)
+      AddressLeaf a_all(all);
+      Type_t ret( ForEach<A, AddressLeaf, NullCombine>::apply( expr.child() , a_all , n ) );
+      a.append( a_all );
+
+      return ret;
     }
   };
 
@@ -433,6 +444,40 @@ struct ForEach<UnaryNode<FnMap, A>, AddressLeaf, NullCombine>
 
 
 
+//! The maps at the top of an expression, gathered by one kernel
+/*! function_exec walks the expression with ShiftPhase1 and a bundle.
+ *  When building the kernel each map adds its parameters and a section
+ *  that packs its face, sections follow each other in thread index.
+ *  When running, each map adds the arguments of its section (an empty
+ *  one if on-node) and, if off-node, its key. acquire() then gets one
+ *  resource for all off-node maps, each map's send and receive buffers
+ *  are its part of the resource's buffers. There is one message per
+ *  peer node, started after the kernel and waited for once.
+ */
+struct JitGatherBundle
+{
+  JitGatherBundle( bool build_ ): build(build_), addr(all) {}
+  ~JitGatherBundle();
+
+  bool build;
+
+  // Building: emit the sections given the thread index
+  std::vector< std::function< void( llvm::Value * ) > > sections;
+
+  // Running
+  AddressLeaf                                   addr;
+  int                                           count = 0;   // threads
+  std::vector< QDPHandle::Handle<RsrcWrapper> > maps;        // off-node maps
+  std::vector< FnMapRsrcKey >                   keys;
+  std::vector< int >                            send_pos;    // of the maps' send buffer ids in addr
+  const FnMapRsrc*                              rsrc = NULL;
+
+  //! After the walk: the resource of the off-node maps, if any
+  void acquire();
+};
+
+
+
 template<class A>
 struct ForEach<UnaryNode<FnMap, A>, ShiftPhase1 , BitOrCombine>
 {
@@ -451,43 +496,85 @@ struct ForEach<UnaryNode<FnMap, A>, ShiftPhase1 , BitOrCombine>
 
     Expr subexpr(expr.child());
 
+    if (f.bundle && f.bundle->build) {
+      function_gather_section_build<InnerType_t>( *f.bundle , subexpr );
+      return 0;
+    }
+
+    // Shift of shift: the maps below this one are exchanged first, for
+    // all sites since this map reads the inner result at sites outside
+    // the subset, and waited for. This map's gather and both kernels
+    // then find their data in place, so they don't add to the face.
+    ShiftPhase1 phase1_all(all);
+    int maps_involved = forEach(subexpr, phase1_all , BitOrCombine());
+    if (maps_involved > 0) {
+      ShiftPhase2 phase2;
+      forEach(subexpr, phase2 , NullCombine());
+    }
+
     if (map.get_offnodeP())
       {
 #if QDP_DEBUG >= 3
 	QDP_info("Map: off-node communications required");
 #endif
 
-	int dstnum = map.get_destnodes_num(f.subset)[0]*sizeof(InnerType_t);
-	int srcnum = map.get_srcenodes_num(f.subset)[0]*sizeof(InnerType_t);
-
-	const FnMapRsrc& rRSrc = fnmap.getResource(srcnum,dstnum);
-
-	// Make sure the inner expression's map function
-	// send and receive before recursing down
-	int maps_involved = forEach(subexpr, f , BitOrCombine());
-	if (maps_involved > 0) {
-	  QDP_error_exit("shift of shift is not supported");
-	  // ShiftPhase2 phase2;
-	  // forEach(subexpr, phase2 , NullCombine());
-	}
+	// Message sizes per peer
+	const multi1d<int>& destnodes_num = map.get_destnodes_num(f.subset);
+	const multi1d<int>& srcenodes_num = map.get_srcenodes_num(f.subset);
 
-	static CUfunction function;
+	std::vector<int> dstnum( destnodes_num.size() ), srcnum( srcenodes_num.size() );
+	for (int i = 0 ; i < destnodes_num.size() ; ++i )
+	  dstnum[i] = destnodes_num[i]*sizeof(InnerType_t);
+	for (int i = 0 ; i < srcenodes_num.size() ; ++i )
+	  srcnum[i] = srcenodes_num[i]*sizeof(InnerType_t);
 
-	if (function == NULL)
+	if (f.bundle)
 	  {
-	    function = function_gather_build<InnerType_t>( subexpr );
+	    // The resource is acquired once all maps are known
+	    f.bundle->maps.push_back( fnmap.pRsrc );
+	    f.bundle->keys.push_back( fnmap.pRsrc->getKey(srcnum,dstnum) );
 	  }
+	else
+	  {
+	    const FnMapRsrc& rRSrc = fnmap.getResource(srcnum,dstnum);
+
+	    static CUfunction function;
+
+	    if (function == NULL)
+	      {
+		function = function_gather_build<InnerType_t>( subexpr );
+	      }
 
-	function_gather_exec(function, rRSrc.getSendBufId() , map , subexpr , f.subset );
+	    function_gather_exec(function, rRSrc.getSendBufId() , map , subexpr , f.subset );
 
-	rRSrc.send_receive();
+	    rRSrc.send_receive();
+	  }
 	
-	returnVal = maps_involved | map.getId();
+	returnVal = map.getId();
       }
-    else 
+
+    if (f.bundle)
       {
-	returnVal = ForEach<A, ShiftPhase1, BitOrCombine>::apply(expr.child(), f, c);
+	// This map's section of the bundled gather
+	JitGatherBundle& b = *f.bundle;
+	const bool offnode = map.get_offnodeP();
+	int hi = offnode ? map.soffset(f.subset).size() : 0;
+
+	b.addr.setLit( b.count );   // lo
+	b.addr.setLit( hi );
+	b.addr.setId( offnode ? map.getSoffsetsId(f.subset) : -1 );
+	if (offnode)
+	  b.send_pos.push_back( b.addr.ids.size() );
+	b.addr.setId( -1 );   // off-node: the send buffer, see acquire()
+
+	// Maps in the gathered expression were exchanged for all sites
+	AddressLeaf a_all(all);
+	forEach(subexpr, a_all, NullCombine());
+	b.addr.append( a_all );
+
+	b.count += hi;
       }
+
     return returnVal;
   }
 };
@@ -504,11 +591,13 @@ struct ForEach<UnaryNode<FnMap, A>, ShiftPhase2 , CTag>
   {
     const Map& map = expr.operation().map;
     FnMap& fnmap = const_cast<FnMap&>(expr.operation());
-    if (map.get_offnodeP()) {
+    // A bundle's resource is waited for by function_exec
+    if (map.get_offnodeP() && !fnmap.pRsrc->isBundled()) {
       const FnMapRsrc& rRSrc = fnmap.getCached();
       rRSrc.qmp_wait();
     }
-    return ForEach<A, ShiftPhase2, CTag>::apply(expr.child(), f, c);
+    // The maps below were waited for in ShiftPhase1
+    return 0;
   }
 };
 
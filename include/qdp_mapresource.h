@@ -3,11 +3,32 @@
 
 #include "qmp.h"
 
+#include <list>
+#include <unordered_map>
+
 namespace QDP {
 
-  // The MPI resources class for an FnMap.
-  // An instance for each (dest/src node,msg_size) combination
-  // exists so they can be reused over the whole program lifetime.
+  // Node lists and message sizes (bytes per peer, in node list order) of a map
+struct FnMapRsrcKey {
+  std::vector<int> destNodes, srcNodes, sendMsgSizes, rcvMsgSizes;
+
+  bool operator==(const FnMapRsrcKey& k) const {
+    return destNodes == k.destNodes && srcNodes == k.srcNodes &&
+      sendMsgSizes == k.sendMsgSizes && rcvMsgSizes == k.rcvMsgSizes;
+  }
+};
+
+
+  // The MPI resources class for an FnMap, or for the maps whose faces
+  // are gathered by one kernel (see JitGatherBundle).
+  // Handed out by FnMapRsrcPool per list of map keys and reused later
+  // with the same list.
+  // The send and receive buffers are one contiguous block each, holding
+  // one part per map in order. A part has the segment to/from the map's
+  // i-th peer as its i-th segment in node list order. Each map reads and
+  // writes its part through its own cache id. There is one message per
+  // peer node, made of the segments of all maps for that peer in map
+  // order. Peers without sites in the subset don't get a message.
   // Can't allocate resources in constructor, since I use ::operator new
   // to allocate a whole array of them. This is necessary since if a 
   // size of 2 occurs in the logical machine grid, then forward/backward
@@ -19,13 +40,15 @@ private:
   FnMapRsrc(const FnMapRsrc&);
   int send_buf_id = -1;
   int recv_buf_id = -1;
+  std::vector<int> send_part_id;      // per map, the buffer if there is one map
+  std::vector<int> recv_part_id;
 public:
   FnMapRsrc():bSet(false) {};
 
-  int getSendBufId() const { assert(send_buf_id>=0); return send_buf_id; }
-  int getRecvBufId() const { assert(recv_buf_id>=0); return recv_buf_id; }
+  int getSendBufId(int part = 0) const { assert(part < send_part_id.size()); return send_part_id[part]; }
+  int getRecvBufId(int part = 0) const { assert(part < recv_part_id.size()); return recv_part_id[part]; }
   
-  void setup(int _destNode,int _srcNode,int _sendMsgSize,int _rcvMsgSize);
+  void setup(const std::vector<FnMapRsrcKey>& maps);
   void cleanup();
 
   ~FnMapRsrc() {
@@ -38,124 +61,84 @@ public:
   void * getSendBufDevPtr() const { return send_buf_dev; }
   void * getRecvBufDevPtr() const { return recv_buf_dev; }
 
+  struct Block {
+    int offset, size;
+  };
+
   bool bSet;
   mutable void * send_buf;
   mutable void * recv_buf;
   void * send_buf_dev;
   void * recv_buf_dev;
 
-  int srcnum, dstnum;
-  QMP_msgmem_t msg[2];
-  QMP_msghandle_t mh_a[2], mh;
+  int srcnum, dstnum;                 // total bytes
+  std::vector<QMP_msgmem_t> msg;
+  std::vector<QMP_msghandle_t> mh_a;  // receives first
+  std::vector< std::vector<Block> > mh_blocks; // buffer segments of each message
+  int nrecv;
+  QMP_msghandle_t mh;                 // NULL with the comm thread, it starts the messages singly
+  CUevent ev_gathered, ev_landed;     // with the comm thread
   QMP_mem_t *send_buf_mem;
   QMP_mem_t *recv_buf_mem;
 };
 
 
-  // A 2D container of resource classes.
-  // We index msg_size and dest_node and take the
-  // index as the coordinate in the 2D matrix.
+  // Pool of resources keyed by the maps' node lists and message sizes.
+  // A resource is handed out to one map (or bundle) at a time, those in
+  // use at the same time with the same key get one each. Resources given
+  // back stay set up for the next user with the key. With a limit on
+  // their pinned buffers (-mapbuf-limit) the least recently used idle
+  // ones are freed.
 
-class FnMapRsrcMatrix {
+struct FnMapRsrcKeyHash {
+  size_t operator()(const FnMapRsrcKey& k) const;
+  size_t operator()(const std::vector<FnMapRsrcKey>& k) const;
+};
 
-  multi2d< std::pair< int , std::vector<FnMapRsrc*> >* > m2d;
-  std::vector<int> sendMsgSize;
-  std::vector<int> destNode;
-  unsigned int numSendMsgSize;
-  unsigned int numDestNode;
 
-  FnMapRsrcMatrix(): sendMsgSize(0),
-		             destNode(0),
-		             numSendMsgSize(32),
-		             numDestNode(Nd*2) {
-    m2d.resize(numSendMsgSize,numDestNode);
+class FnMapRsrcPool {
 
-    for(unsigned int i=0;i<numSendMsgSize;i++) {
-      for(unsigned int q=0;q<numDestNode;q++) {
-	m2d(i,q)=new std::pair< int , std::vector<FnMapRsrc*> >;
-	(*m2d(i,q)).first=0;
-      }
-    }
-  }
+  struct Entry {
+    std::vector<FnMapRsrcKey> key;
+    FnMapRsrc*   rsrc;
+    int          refs;
+    size_t       bytes;     // send and receive buffer, each pinned on the host and on the device
+  };
 
+  typedef std::list<Entry> listEntry_t;
 
-  public:
+  // Several resources per key
+  std::unordered_multimap< std::vector<FnMapRsrcKey> , listEntry_t::iterator , FnMapRsrcKeyHash > mapKey;
+  std::unordered_map< const FnMapRsrc* , listEntry_t::iterator > mapRsrc;
+  listEntry_t listInUse;
+  listEntry_t listIdle;     // least recently used first
 
-  void cleanup() {
-    //QDPIO::cout << "FnMapRsrcMatrix cleanup\n";
-    for(unsigned int i=0;i<numSendMsgSize;i++) {
-      for(unsigned int q=0;q<numDestNode;q++) {
-	//QDPIO::cout << "cleanup m2d(" << i << "," << q << ")\n";
-	for (std::vector<FnMapRsrc*>::iterator v = (*m2d(i,q)).second.begin() ; v != (*m2d(i,q)).second.end() ; ++v )
-	  delete *v;
-	//std::for_each( (*m2d(i,q)).second.begin() , (*m2d(i,q)).second.end() , this->*del );
-	delete m2d(i,q);
-      }
-    }
-  }
+  size_t limit = 0;         // 0: no limit
+  size_t bytes = 0;
+  size_t bytes_peak = 0;
+  size_t n_acquire = 0;
+  size_t n_reuse = 0;
+  size_t n_setup = 0;
+  size_t n_freed = 0;
 
+  FnMapRsrcPool() {}
 
-  std::pair< int , std::vector<FnMapRsrc*> >* get(int _destNode,int _srcNode,
-						  int _sendMsgSize,int _rcvMsgSize) {
-    bool found = false;
-    unsigned int xDestNode=0;
-    for(; xDestNode < destNode.size(); ++xDestNode)
-      if (destNode[xDestNode] == _destNode)
-	{
-	  found = true;
-	  break;
-	}
-    if (! found) {
-      if (destNode.size() == numDestNode) {
-	QDP_error_exit("FnMapRsrcMatrix not enough space in destNode");
-      } else {
-	destNode.push_back(_destNode);
-	xDestNode=destNode.size()-1;
-      }
-    }
-    //QDPIO::cout << "using node place = " << xDestNode << "\n";
-
-
-    found = false;
-    unsigned int xSendmsgsize=0;
-    for(; xSendmsgsize < sendMsgSize.size(); ++xSendmsgsize)
-      if (sendMsgSize[xSendmsgsize] == _sendMsgSize)
-	{
-	  found = true;
-	  break;
-	}
-    if (! found) {
-      if (sendMsgSize.size() == numSendMsgSize) {
-	QDP_error_exit("FnMapRsrcMatrix not enough space in sendmsgsize");
-      } else {
-	sendMsgSize.push_back(_sendMsgSize);
-	xSendmsgsize=sendMsgSize.size()-1;
-      }
-    }
-    //QDPIO::cout << "using msg_size place = " << xSendmsgsize << "\n";
-
-    std::pair< int , std::vector<FnMapRsrc*> >& pos = *m2d(xSendmsgsize,xDestNode);
+  void free_entry(listEntry_t::iterator e);
+  void trim();
 
-#if QDP_DEBUG >= 3
-    // SANITY
-    if ( pos.second.size() <  pos.first )
-      QDP_error_exit(" pos.second.size()=%d  pos.first=%d",pos.second.size(), pos.first);
-#endif
+  public:
 
-    // Vector's size large enough ?
-    if ( pos.second.size() ==  (unsigned)pos.first ) {
-      //QDPIO::cout << "allocate and setup new rsrc-obj (destnode=" << _destNode << ",sndmsgsize=" << _sendMsgSize << ")\n";
-      pos.second.push_back( new FnMapRsrc() );
-      pos.second.at(pos.first)->setup( _destNode, _srcNode, _sendMsgSize, _rcvMsgSize );
-    }
+  //! A resource for the maps, set up if there is no idle one
+  FnMapRsrc* acquire(const std::vector<FnMapRsrcKey>& maps);
+  void release(const FnMapRsrc* r);
 
-    //QDPIO::cout << "returning rsrc-obj " << pos.first << "\n";
+  void setLimit(size_t l) { limit = l; }
 
-    return &pos;
-  }
+  void printStats() const;
+  void cleanup();
 
-  static FnMapRsrcMatrix& Instance() {
-    static FnMapRsrcMatrix singleton;
+  static FnMapRsrcPool& Instance() {
+    static FnMapRsrcPool singleton;
     return singleton;
   }
 
@@ -171,44 +154,62 @@ class RsrcWrapper
 {
   const multi1d<int>& destnodes;
   const multi1d<int>& srcenodes;
-  std::pair< int , std::vector<FnMapRsrc*> > * pPair;
   const FnMapRsrc* cached;
-  bool rAlloc;
+  int part = 0;             // the map's part of cached
+  bool bundled = false;     // cached is given back by the bundle
 public:
   ~RsrcWrapper() {
-    if (rAlloc) {
-      pPair->first--;
-      //QDPIO::cout << "wrapper destructor: counting down to " << pPair->first << "\n";
-#if QDP_DEBUG >= 3
-      if (pPair->first < 0)
-	QDP_error_exit("<0");
-#endif
-    }
+    if (cached && !bundled)
+      FnMapRsrcPool::Instance().release(cached);
   }
   RsrcWrapper(  const multi1d<int>& destnodes_, const multi1d<int>& srcenodes_): 
-    destnodes(destnodes_),srcenodes(srcenodes_),cached(NULL),rAlloc(false) {
+    destnodes(destnodes_),srcenodes(srcenodes_),cached(NULL) {
   }
 
-  const FnMapRsrc& getResource(int srcnum_, int dstnum_) {
+  //! Message sizes in bytes per peer, in the order of the node lists
+  FnMapRsrcKey getKey(const std::vector<int>& srcnum_, const std::vector<int>& dstnum_) const {
 #if QDP_DEBUG >= 3
     if ( !srcenodes.size() || !destnodes.size() )
       QDP_error_exit("FnMapRsrc& getResource srcnode_size=%d destnode_size=%d", srcenodes.size() , destnodes.size() );
 #endif
-    pPair = FnMapRsrcMatrix::Instance().get( destnodes[0] , srcenodes[0] , dstnum_ , srcnum_ );
-    cached = pPair->second.at(pPair->first++);
-    rAlloc=true;
+    std::vector<int> dst( destnodes.size() ), src( srcenodes.size() );
+    for (int i = 0 ; i < destnodes.size() ; ++i )
+      dst[i] = destnodes[i];
+    for (int i = 0 ; i < srcenodes.size() ; ++i )
+      src[i] = srcenodes[i];
+
+    return FnMapRsrcKey{ dst , src , dstnum_ , srcnum_ };
+  }
+
+  //! A resource of the map's own
+  const FnMapRsrc& getResource(const std::vector<int>& srcnum_, const std::vector<int>& dstnum_) {
+    FnMapRsrcKey key = getKey( srcnum_ , dstnum_ );
+
+    if (cached && !bundled)
+      FnMapRsrcPool::Instance().release(cached);
+    cached = FnMapRsrcPool::Instance().acquire( std::vector<FnMapRsrcKey>( 1 , key ) );
+    part = 0;
+    bundled = false;
     return *cached;
   }
 
+  //! The map's part of a bundle's resource
+  void setBundled(const FnMapRsrc* r, int part_) {
+    if (cached && !bundled)
+      FnMapRsrcPool::Instance().release(cached);
+    cached = r;
+    part = part_;
+    bundled = true;
+  }
+
   const FnMapRsrc& get() const {
-#if QDP_DEBUG >= 3
-    if (!rAlloc)
-      QDP_error_exit("RsrcWrapper::get() internal error");
-#endif
     assert(cached);
     return *cached;
   }
 
+  int getPart() const { return part; }
+  bool isBundled() const { return bundled; }
+
 };
 
 
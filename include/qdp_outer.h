@@ -134,9 +134,9 @@ namespace QDP {
 
 
     inline T& elem() { assert_on_host(); return F;  }
-    inline const T& elem() const { assert_on_host(); return F; }
+    inline const T& elem() const { assert_on_host_read(); return F; }
     inline T& elem(int i) { assert_on_host(); return F; }
-    inline const T& elem(int i) const { assert_on_host(); return F; }
+    inline const T& elem(int i) const { assert_on_host_read(); return F; }
 
     int getId() const {       
       alloc_mem(); 
@@ -165,6 +165,14 @@ namespace QDP {
       
       QDP_get_global_cache().assureOnHost( myId );
     }
+    inline void assert_on_host_read() const {
+      accessed_on_host = true;
+      
+      if (myId < 0)
+	return;
+      
+      QDP_get_global_cache().assureOnHostRead( myId );
+    }
 
     mutable T F;
     mutable int myId = -1;
@@ -427,7 +435,7 @@ void evaluate(OScalar<T>& dest, const Op& op, const QDPExpr<RHS,OScalar<T1> >& r
       return F[i]; 
     }
     inline const T& elem(int i) const { 
-      assert_on_host(); 
+      assert_on_host_read(); 
       return F[i]; 
     }
 
@@ -509,6 +517,11 @@ void evaluate(OScalar<T>& dest, const Op& op, const QDPExpr<RHS,OScalar<T1> >& r
       QDP_get_global_cache().getHostPtr( (void**)&F , myId );
     }
 
+    // Keeps the device copy
+    inline void assert_on_host_read() const {
+      QDP_get_global_cache().getHostPtrRead( (void**)&F , myId );
+    }
+
   private:
 
     mutable T *F;
@@ -214,6 +214,11 @@ public:
     QDP_get_global_cache().getHostPtr( (void**)&F_private , myId );
   }
 
+  // Keeps the device copy
+  inline void assert_on_host_read() const {
+    QDP_get_global_cache().getHostPtrRead( (void**)&F_private , myId );
+  }
+
   inline T* getF() const { 
     assert_on_host(); 
     return F_private; 
@@ -225,7 +230,7 @@ public:
   }
   
   inline const T& elem(int i) const { 
-    assert_on_host(); 
+    assert_on_host_read(); 
     return F_private[i]; 
   }
 
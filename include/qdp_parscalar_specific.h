@@ -205,6 +205,31 @@ void evaluate(OLattice<T>& dest, const Op& op, const QDPExpr<RHS,OScalar<T1> >&
 }
 
 
+//! Kernel of evaluate() for OLattice Op OLattice(Expression(source))
+template<class T, class T1, class Op, class RHS>
+CUfunction& evaluate_function()
+{
+  static CUfunction function;
+  return function;
+}
+
+
+//! Start building the kernel for dest Op rhs ahead of its first use
+/*!
+ * The IR is built right away, optimization and PTX codegen run on the
+ * LLVM worker threads while the caller continues. Nothing is evaluated.
+ * Long jobs can list the expressions of later phases this way.
+ */
+template<class T, class T1, class Op, class RHS>
+void jit_enqueue(OLattice<T>& dest, const Op& op, const QDPExpr<RHS,OLattice<T1> >& rhs)
+{
+  CUfunction& function = evaluate_function<T,T1,Op,RHS>();
+
+  if (function == NULL)
+    function = function_build(dest, op, rhs);
+}
+
+
 //! OLattice Op OLattice(Expression(source)) under an Subset
 /*! 
  * OLattice Op Expression, where Op is some kind of binary operation 
@@ -215,6 +240,10 @@ template<class T, class T1, class Op, class RHS>
 void evaluate(OLattice<T>& dest, const Op& op, const QDPExpr<RHS,OLattice<T1> >& rhs,
 	      const Subset& s)
 {
+  // Fused with the following statements (-jit-fuse)
+  if (jit_defer(dest, op, rhs, s))
+    return;
+
 #if defined(QDP_USE_PROFILING)   
   static QDPProfile_t prof(dest, op, rhs);
   prof.stime(getClockTime());
@@ -297,7 +326,7 @@ void evaluate(OLattice<T>& dest, const Op& op, const QDPExpr<RHS,OLattice<T1> >&
     check_abort();
   }
 #else
-  static CUfunction function;
+  CUfunction& function = evaluate_function<T,T1,Op,RHS>();
 
   // Build the function
   if (function == NULL)
@@ -798,6 +827,50 @@ sum(const QDPExpr<RHS,OScalar<T> >& s1)
 
 
 
+//! Reductions of expressions
+/*!
+ * Expressions with shifts are evaluated into a temporary first since
+ * the shift needs the face communication of evaluate().
+ */
+template<class RHS, class T, bool has_map>
+struct JitSumExpr
+{
+  static typename UnaryReturn<OLattice<T>, FnSum>::Type_t
+  sum(const QDPExpr<RHS,OLattice<T> >& s1, const Subset& s)
+  {
+    return sum_expr(s1,s);
+  }
+
+  static typename UnaryReturn<OLattice<T>, FnSumMulti>::Type_t
+  sumMulti(const QDPExpr<RHS,OLattice<T> >& s1, const Set& ss)
+  {
+    return sumMulti_expr(s1,ss);
+  }
+};
+
+template<class RHS, class T>
+struct JitSumExpr<RHS,T,true>
+{
+  static typename UnaryReturn<OLattice<T>, FnSum>::Type_t
+  sum(const QDPExpr<RHS,OLattice<T> >& s1, const Subset& s)
+  {
+    // We don't profile this because this is a combination of eval and sum
+
+    OLattice<T> l;
+    l[s]=s1;
+    return QDP::sum(l,s);
+  }
+
+  static typename UnaryReturn<OLattice<T>, FnSumMulti>::Type_t
+  sumMulti(const QDPExpr<RHS,OLattice<T> >& s1, const Set& ss)
+  {
+    OLattice<T> lat;
+    lat = s1;
+    return QDP::sumMulti(lat,ss);
+  }
+};
+
+
 //! OScalar = sum(OLattice)  under an explicit subset
 /*!
  * Allow a global sum that sums over the lattice, but returns an object
@@ -808,11 +881,8 @@ template<class RHS, class T>
 typename UnaryReturn<OLattice<T>, FnSum>::Type_t
 sum(const QDPExpr<RHS,OLattice<T> >& s1, const Subset& s)
 {
-  // We don't profile this because this is a combination of eval and sum
-
-  OLattice<T> l;
-  l[s]=s1;
-  return sum(l,s);
+  // Without shifts the expression is evaluated in the first reduction stage
+  return JitSumExpr<RHS,T,JitHasMap<RHS>::value>::sum(s1,s);
 }
 #else
 template<class RHS, class T>
@@ -859,11 +929,7 @@ template<class RHS, class T>
 typename UnaryReturn<OLattice<T>, FnSum>::Type_t
 sum(const QDPExpr<RHS,OLattice<T> >& s1)
 {
-  // We don't profile this because this is a combination of eval and sum
-
-  OLattice<T> l;
-  l=s1;
-  return sum(l,all);
+  return JitSumExpr<RHS,T,JitHasMap<RHS>::value>::sum(s1,all);
 }
 #else
 template<class RHS, class T>
@@ -990,9 +1056,7 @@ template<class RHS, class T>
 typename UnaryReturn<OLattice<T>, FnSumMulti>::Type_t
 sumMulti(const QDPExpr<RHS,OLattice<T> >& s1, const Set& ss)
 {
-  OLattice<T> lat;
-  lat = s1;
-  return sumMulti(lat,ss);
+  return JitSumExpr<RHS,T,JitHasMap<RHS>::value>::sumMulti(s1,ss);
 }
 #endif
 
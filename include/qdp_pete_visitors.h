@@ -10,10 +10,13 @@ namespace QDP {
 
 
 
+struct JitGatherBundle;
+
 struct ShiftPhase1
 {
-  ShiftPhase1(const Subset& _s):subset(_s) {}
+  ShiftPhase1(const Subset& _s,JitGatherBundle* _bundle = NULL):subset(_s),bundle(_bundle) {}
   const Subset& subset;
+  JitGatherBundle* bundle;   // if set, the maps are gathered by one kernel (see function_exec)
 };
 
 struct ShiftPhase2
@@ -102,6 +105,13 @@ struct AddressLeaf
     ids.push_back( QDP_get_global_cache().addJitParamBool(b) );
     ids_signoff.push_back( ids.back() );
   }
+
+  //! Takes over the ids of a walk over a subexpression with another subset
+  void append( AddressLeaf& sub ) const {
+    ids.insert( ids.end() , sub.ids.begin() , sub.ids.end() );
+    ids_signoff.insert( ids_signoff.end() , sub.ids_signoff.begin() , sub.ids_signoff.end() );
+    sub.ids_signoff.clear();
+  }
 };
 
 
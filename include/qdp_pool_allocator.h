@@ -5,6 +5,9 @@
 
 #include <string>
 #include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
 #include <iostream>
 #include <algorithm>
 
@@ -15,6 +18,30 @@ namespace QDP
 {
 
 
+  // Two placement strategies over the same address ordered block list:
+  //
+  //   next fit - scan from the last allocation or free for the first
+  //              block that fits (default)
+  //   best fit - the smallest free block that fits, lowest address on
+  //              ties, from a size ordered index of the free blocks.
+  //              O(log n) allocate, free and coalesce.
+  //
+  // In both, free() finds the block through a pointer map.
+  //
+  // The memory comes in arenas. By default there is one arena of the
+  // pool size. With an arena size set (-pool-arena) the pool starts with
+  // one arena of that size and adds arenas as allocations need them, up
+  // to the pool size in total. Blocks never span arenas. Empty arenas are
+  // given back when an arena can't be added, i.e. when the pool or the
+  // device is short of memory. Static allocations (external libraries)
+  // get an arena each, which is given back when they are freed, so they
+  // don't pin down parts of the shared arenas. When no arena can be added
+  // for one, it takes a block in a shared arena like any allocation.
+  //
+  // compact() slides the allocations the owner allows to move towards the
+  // start of their arena, so the free space of an arena becomes one block
+  // (or one per stretch between blocks that can't move).
+
   template<class Allocator>
   class QDPPoolAllocator {
   public:
@@ -26,6 +53,21 @@ namespace QDP
     typedef typename std::list< entry_t >              listEntry_t;
     typedef std::list< typename  listEntry_t::iterator> listEntryIter_t;
 
+    struct stats_t {
+      size_t pool;
+      size_t in_use;
+      size_t peak_in_use;
+      size_t free;
+      size_t largest_free;
+      long   free_blocks;
+      long   allocs;
+      long   failed;
+      int    arenas;
+      size_t reserved;    // in arenas
+      long   arenas_added;
+      long   arenas_released;
+    };
+
   public:
 
     void registerMemory();
@@ -37,9 +79,37 @@ namespace QDP
 
     bool allocate( void** ptr, size_t n_bytes );
 
+    //! Long lived memory for external use, in its own arena if arenas grow
+    //! and one can be added, otherwise in a shared arena
+    bool allocateStatic( void** ptr, size_t n_bytes );
+
     void free(const void *mem);
     void setPoolSize(size_t s);
 
+    //! 0: one arena of the pool size
+    void   setArenaSize(size_t s);
+    size_t getArenaSize() const { return arenaSize; }
+
+    //! Gives the empty arenas back, returns the bytes released
+    size_t releaseEmptyArenas();
+
+    //! movable( ptr ) - whether the allocation at ptr may move
+    //! copy( dst , src , n ) - copies n bytes, the ranges don't overlap
+    //! moved( old , new ) - after an allocation has moved
+    //! Returns the bytes moved
+    template<class Movable, class Copy, class Moved>
+    size_t compact( const Movable& movable , const Copy& copy , const Moved& moved );
+
+    void setBestFit(bool b);
+    bool getBestFit() const { return bestFit; }
+
+    //! Fragmentation: 1 - largest_free / free
+    stats_t getStats() const;
+    void    printStats();
+
+    //! Blocks arena by arena, in address order within an arena
+    const listEntry_t& blocks() const { return listEntry; }
+
 
   private:
     friend class QDPCache;
@@ -53,16 +123,57 @@ namespace QDP
     void allocateInternalBuffer();
     void freeInternalBuffer();
     bool bufferAllocated;
-    
-    void *             poolPtr;
-    void *             unaligned;
+
+    struct arena_t {
+      void *           unaligned;   // NULL if the slot is unused
+      size_t           size;
+      bool             dedicated;   // holds one static allocation
+    };
+
     size_t             poolSize;
-    size_t             bytes_allocated;
+    size_t             arenaSize = 0;
+    size_t             reserved = 0;
+    std::vector<arena_t> arenas;
+    long               n_arenas_added = 0;
+    long               n_arenas_released = 0;
+
+    typename listEntry_t::iterator addArena( size_t size , bool dedicated );
+    void releaseArena( typename listEntry_t::iterator p );
+    bool grow( size_t size );
+
     listEntry_t        listEntry;
-    listEntryIter_t    listAllocOrder;
     typename listEntry_t::iterator iterNextNotAllocated;
 
+    typedef std::map< std::pair<size_t,void*> , typename listEntry_t::iterator > mapFree_t;
+
+    bool               bestFit = false;
+    mapFree_t          mapFree;    // best fit: free blocks by (size, address)
+    std::unordered_map< const void* , typename listEntry_t::iterator > mapAlloc;
+
+    size_t             in_use = 0;
+    size_t             peak_in_use = 0;
+    long               n_allocs = 0;
+    long               n_failed = 0;
+
     bool findNextNotAllocated( typename listEntry_t::iterator & start , size_t & size );
+    bool allocateNextFit( void ** ptr , size_t size );
+    bool allocateBestFit( void ** ptr , size_t size );
+
+    void indexFree( typename listEntry_t::iterator p ) {
+      if (bestFit)
+	mapFree.insert( std::make_pair( std::make_pair( p->size , p->ptr ) , p ) );
+    }
+    void unindexFree( typename listEntry_t::iterator p ) {
+      if (bestFit)
+	mapFree.erase( std::make_pair( p->size , p->ptr ) );
+    }
+
+    void allocated( typename listEntry_t::iterator p ) {
+      mapAlloc[ p->ptr ] = p;
+      in_use += p->size;
+      peak_in_use = std::max( peak_in_use , in_use );
+      ++n_allocs;
+    }
 
   };
 
@@ -71,8 +182,10 @@ namespace QDP
   void QDPPoolAllocator<Allocator>::registerMemory() {
       if (!bufferAllocated)
 	allocateInternalBuffer();
-      QDP_info_primary("Pool allocator: Registering memory pool with NVIDIA driver (%lu bytes)",(unsigned long)bytes_allocated);
-      CudaHostRegister(unaligned,bytes_allocated);
+      QDP_info_primary("Pool allocator: Registering memory pool with NVIDIA driver (%lu bytes)",(unsigned long)reserved);
+      for ( auto& a : arenas )
+	if (a.unaligned)
+	  CudaHostRegister(a.unaligned,a.size + 2 * QDP_ALIGNMENT_SIZE);
     }
 
 
@@ -82,7 +195,9 @@ namespace QDP
 	QDP_error_exit("pool unregisterMemory: not allocated");
       }
       QDP_info_primary("Pool allocator: Unregistering memory pool with NVIDIA driver");
-      CudaHostUnregister(unaligned);
+      for ( auto& a : arenas )
+	if (a.unaligned)
+	  CudaHostUnregister(a.unaligned);
     }
 
 
@@ -101,6 +216,7 @@ namespace QDP
     void * ptr;
     size_t size;
     bool allocated;
+    int arena;
   };
 
 
@@ -142,7 +258,14 @@ namespace QDP
   void QDPPoolAllocator<Allocator>::freeInternalBuffer() {
     if (bufferAllocated) {
       QDP_info_primary("pool allocator: Deallocating internal buffer");
-      Allocator::free(unaligned);
+      for ( auto& a : arenas )
+	if (a.unaligned)
+	  Allocator::free(a.unaligned);
+      arenas.clear();
+      listEntry.clear();
+      mapFree.clear();
+      mapAlloc.clear();
+      reserved = 0;
       bufferAllocated=false;
     } else {
 #ifdef GPU_DEBUG    
@@ -161,46 +284,210 @@ namespace QDP
 #ifdef GPU_DEBUG    
       QDP_debug("memory was allocated before, I will free it first..");
 #endif      
-      Allocator::free( unaligned );
-#ifdef GPU_DEBUG      
-      QDP_debug("listEntry size (should be 1) = %d" , listEntry.size());
-#endif      
-      if (listEntry.size() != 1)
-	QDP_error_exit("pool allocator problem, listEntry not 1");
-      while ( listEntry.size() )
-	listEntry.pop_front();
+      if (!mapAlloc.empty())
+	QDP_error_exit("pool allocator problem, entries still allocated");
+      freeInternalBuffer();
     }
 
     if ( listEntry.size() > 0 )
       QDP_error_exit("Pool allocator: list of entries not zero");
 
-    bytes_allocated = poolSize + 2 * QDP_ALIGNMENT_SIZE;
-#ifdef GPU_DEBUG
-    QDP_debug("Pool allocater: Allocating buffer %d bytes" , bytes_allocated );
-#endif	
-    if (!Allocator::allocate( (void**)&unaligned , bytes_allocated )) {
-      QDP_error_exit("Pool allocater: Error allocating %lu bytes" , bytes_allocated );
+    size_t size = arenaSize ? std::min( arenaSize , poolSize ) : poolSize;
+
+    if (addArena( size , false ) == listEntry.end()) {
+      QDP_error_exit("Pool allocater: Error allocating %lu bytes" , size + 2 * QDP_ALIGNMENT_SIZE );
     }
 
-    poolPtr = (unsigned char *)( ( (unsigned long)unaligned + (QDP_ALIGNMENT_SIZE-1) ) & ~(QDP_ALIGNMENT_SIZE - 1));
+    bufferAllocated=true;
+  }
+
+
+  template<class Allocator>
+  typename QDPPoolAllocator<Allocator>::listEntry_t::iterator QDPPoolAllocator<Allocator>::addArena( size_t size , bool dedicated )
+  {
+    size_t bytes = size + 2 * QDP_ALIGNMENT_SIZE;
 #ifdef GPU_DEBUG
-    QDP_debug("pool allocator allocate internal buffer: unaligned ptr = %p  aligned ptr = %p" , (void*)unaligned , (void*)poolPtr);
-#endif
+    QDP_debug("Pool allocater: Allocating arena %lu bytes" , bytes );
+#endif	
+    arena_t a;
+    if (!Allocator::allocate( &a.unaligned , bytes ))
+      return listEntry.end();
+    a.size = size;
+    a.dedicated = dedicated;
+
+    int slot = 0;
+    while ( slot < (int)arenas.size() && arenas[slot].unaligned )
+      ++slot;
+    if ( slot == (int)arenas.size() )
+      arenas.push_back( a );
+    else
+      arenas[slot] = a;
+
     entry_t e;
-    e.ptr = poolPtr;
-    e.size = poolSize;
+    e.ptr = (void*)( ( (size_t)a.unaligned + (QDP_ALIGNMENT_SIZE-1) ) & ~(size_t)(QDP_ALIGNMENT_SIZE - 1) );
+    e.size = size;
     e.allocated = false;
-    listEntry.push_back(e);
+    e.arena = slot;
+
+    typename listEntry_t::iterator p = listEntry.insert( listEntry.end() , e );
+    indexFree( p );
+
+    // Next fit wants a free block here, a dedicated arena is taken right away
+    if ( !dedicated )
+      iterNextNotAllocated = p;
+
+    reserved += size;
+    ++n_arenas_added;
+
+    return p;
+  }
+
+
+  // p is the arena's only block and free
+  template<class Allocator>
+  void QDPPoolAllocator<Allocator>::releaseArena( typename listEntry_t::iterator p )
+  {
+    arena_t& a = arenas[ p->arena ];
+
+    Allocator::free( a.unaligned );
+    a.unaligned = NULL;
+    reserved -= a.size;
+    ++n_arenas_released;
+
+    unindexFree( p );
+
+    if ( iterNextNotAllocated == p ) {
+      iterNextNotAllocated = listEntry.erase( p );
+      if ( iterNextNotAllocated == listEntry.end() )
+	iterNextNotAllocated = listEntry.begin();
+      size_t alignment = Allocator::ALIGNMENT_SIZE;
+      findNextNotAllocated( iterNextNotAllocated , alignment );
+    } else {
+      listEntry.erase( p );
+    }
+  }
+
+
+  template<class Allocator>
+  size_t QDPPoolAllocator<Allocator>::releaseEmptyArenas()
+  {
+    size_t released = 0;
+
+    typename listEntry_t::iterator p = listEntry.begin();
+    while ( p != listEntry.end() ) {
+      typename listEntry_t::iterator q = p++;
+      if ( !q->allocated && q->size == arenas[ q->arena ].size ) {
+	released += q->size;
+	releaseArena( q );
+      }
+    }
+
+    return released;
+  }
+
+
+  template<class Allocator>
+  template<class Movable, class Copy, class Moved>
+  size_t QDPPoolAllocator<Allocator>::compact( const Movable& movable , const Copy& copy , const Moved& moved )
+  {
+    size_t bytes = 0;
+
+    typename listEntry_t::iterator p = listEntry.begin();
+    while ( p != listEntry.end() ) {
+
+      const int arena = p->arena;
+      size_t dst = (size_t)p->ptr;       // the first block starts the arena
+      const size_t end = dst + arenas[arena].size;
+
+      for ( ; p != listEntry.end() && p->arena == arena ; ) {
+
+	if (!p->allocated) {
+	  unindexFree( p );
+	  p = listEntry.erase( p );
+	  continue;
+	}
+
+	size_t src = (size_t)p->ptr;
+
+	if ( src != dst && movable( p->ptr ) ) {
+
+	  // Down by gap, in pieces that don't overlap
+	  size_t gap = src - dst;
+	  for ( size_t done = 0 ; done < p->size ; done += gap )
+	    copy( (void*)( dst + done ) , (void*)( src + done ) , std::min( gap , p->size - done ) );
+
+	  mapAlloc.erase( p->ptr );
+	  p->ptr = (void*)dst;
+	  mapAlloc[ p->ptr ] = p;
+
+	  moved( (void*)src , (void*)dst );
+	  bytes += p->size;
+
+	} else if ( src != dst ) {
+
+	  entry_t e;
+	  e.ptr = (void*)dst;
+	  e.size = src - dst;
+	  e.allocated = false;
+	  e.arena = arena;
+	  indexFree( listEntry.insert( p , e ) );
+
+	}
+
+	dst = (size_t)p->ptr + p->size;
+	++p;
+      }
+
+      if ( dst < end ) {
+	entry_t e;
+	e.ptr = (void*)dst;
+	e.size = end - dst;
+	e.allocated = false;
+	e.arena = arena;
+	indexFree( listEntry.insert( p , e ) );
+      }
+    }
 
     iterNextNotAllocated = listEntry.begin();
+    size_t alignment = Allocator::ALIGNMENT_SIZE;
+    findNextNotAllocated( iterNextNotAllocated , alignment );
 
-    bufferAllocated=true;
+    return bytes;
+  }
+
+
+  template<class Allocator>
+  bool QDPPoolAllocator<Allocator>::grow( size_t size )
+  {
+    if ( !arenaSize )
+      return false;
+
+    if ( reserved + size > poolSize )
+      releaseEmptyArenas();
+
+    if ( reserved + size > poolSize )
+      return false;
+
+    size_t want = std::min( std::max( arenaSize , size ) , poolSize - reserved );
+
+    if ( addArena( want , false ) != listEntry.end() )
+      return true;
+
+    // The device is short, others may need the memory more than the empty arenas
+    releaseEmptyArenas();
+
+    if ( addArena( want , false ) != listEntry.end() )
+      return true;
+
+    return want > size && addArena( size , false ) != listEntry.end();
   }
     
 
   template<class Allocator>
   void QDPPoolAllocator<Allocator>::printPoolInfo() {
-    QDP_info("CUDA memory allocated: start pointer = %p, size = %lu" , (void*)unaligned , (unsigned long)bytes_allocated );
+    for ( auto& a : arenas )
+      if (a.unaligned)
+	QDP_info("CUDA memory allocated: start pointer = %p, size = %lu%s" , a.unaligned , (unsigned long)( a.size + 2 * QDP_ALIGNMENT_SIZE ) , a.dedicated ? " (static)" : "" );
   }
 
 
@@ -209,23 +496,10 @@ namespace QDP
     QDP_info("Memory pool");
     int c=0;
     for ( typename listEntry_t::iterator p = listEntry.begin(); p != listEntry.end() ; p++ ) {
-
-      typename listEntryIter_t::iterator q = listAllocOrder.begin();
-      bool found=false;
-      int d=0;
-      while ((!found) && ( q != listAllocOrder.end() )) {
-	if (*q == p)
-	  found=true;
-	else {
-	  d++;
-	  q++;
-	}
-      }
-
-      if (iterNextNotAllocated==p)
-	QDP_info("%d ptr=%p size=%d %d (cand) allocOrder=%d", c++ , p->ptr , p->size , p->allocated ,d);
+      if (!bestFit && iterNextNotAllocated==p)
+	QDP_info("%d ptr=%p size=%lu %d arena=%d (cand)", c++ , p->ptr , (unsigned long)p->size , p->allocated , p->arena );
       else
-	QDP_info("%d ptr=%p size=%d %d allocOrder=%d", c++ , p->ptr , p->size , p->allocated ,d);
+	QDP_info("%d ptr=%p size=%lu %d arena=%d", c++ , p->ptr , (unsigned long)p->size , p->allocated , p->arena );
     }
   }
 
@@ -248,7 +522,7 @@ namespace QDP
   template<class Allocator>
   bool QDPPoolAllocator<Allocator>::allocate( void ** ptr , size_t n_bytes ) {
 
-    if (!bufferAllocated)
+    if (!bufferAllocated || listEntry.empty())
       allocateInternalBuffer();
 
     //size_t alignment = QDP_ALIGNMENT_SIZE;
@@ -262,6 +536,7 @@ namespace QDP
 
     if (size > poolSize) {
       QDP_info("Pool allocator: trying to allocate %lu (poolsize=%lu) " , size , poolSize );
+      ++n_failed;
       return false;
     }
 
@@ -270,6 +545,65 @@ namespace QDP
       QDP_error_exit("QDPPoolAllocator<Allocator>::allocate ( size == 0 )");
 #endif
 
+    if ( bestFit ? allocateBestFit( ptr , size ) : allocateNextFit( ptr , size ) )
+      return true;
+
+    if ( grow( size ) && ( bestFit ? allocateBestFit( ptr , size ) : allocateNextFit( ptr , size ) ) )
+      return true;
+
+#ifdef GPU_DEBUG
+    QDP_debug("Pool allocator: out of memory");
+#endif
+    ++n_failed;
+    return false;
+  }
+
+
+  template<class Allocator>
+  bool QDPPoolAllocator<Allocator>::allocateStatic( void ** ptr , size_t n_bytes ) {
+
+    if ( !arenaSize )
+      return allocate( ptr , n_bytes );
+
+    if (!bufferAllocated || listEntry.empty())
+      allocateInternalBuffer();
+
+    size_t alignment = Allocator::ALIGNMENT_SIZE;
+    size_t size = (n_bytes + (alignment) - 1) & ~((alignment) - 1);
+
+    if ( reserved + size > poolSize )
+      releaseEmptyArenas();
+
+    typename listEntry_t::iterator p = listEntry.end();
+
+    if ( reserved + size <= poolSize ) {
+      p = addArena( size , true );
+      if ( p == listEntry.end() ) {
+	releaseEmptyArenas();
+	p = addArena( size , true );
+      }
+    }
+
+    // No arena of its own: the reservation ceiling is hit or the device is
+    // short. Spilling frees blocks in the shared arenas, not reservations,
+    // so the allocation takes a block in a shared arena instead.
+    if ( p == listEntry.end() )
+      return allocate( ptr , n_bytes );
+
+    unindexFree( p );
+    p->allocated = true;
+    allocated( p );
+    *ptr = p->ptr;
+
+    return true;
+  }
+
+
+  template<class Allocator>
+  bool QDPPoolAllocator<Allocator>::allocateNextFit( void ** ptr , size_t size ) {
+
+    size_t alignment = Allocator::ALIGNMENT_SIZE;
+
     typename QDPPoolAllocator::listEntry_t::iterator candidate = iterNextNotAllocated;
     if (candidate == listEntry.end() || candidate->allocated) {
       //QDP_info("Pool allocator (alignment=%u): no candidate, means pool full!",(unsigned)Allocator::ALIGNMENT_SIZE);
@@ -286,7 +620,7 @@ namespace QDP
 	  // we seek a spot of at least the mininmum size
 	  findNextNotAllocated( iterNextNotAllocated , alignment );
 
-	  listAllocOrder.push_front(candidate);
+	  allocated( candidate );
 	  *ptr = candidate->ptr;
 
 	  return true;
@@ -297,6 +631,7 @@ namespace QDP
 	  e.ptr = candidate->ptr;
 	  e.size = size;
 	  e.allocated = true;
+	  e.arena = candidate->arena;
 	
 	  candidate->ptr = (void*)( (size_t)(candidate->ptr) + size );
 	  candidate->size = candidate->size - size;
@@ -305,7 +640,7 @@ namespace QDP
 	    QDP_error_exit("QDPPoolAllocator<Allocator>::allocate ( candidate->size == 0 ),%u",(unsigned)size);
 
 	  iterNextNotAllocated = listEntry.insert( candidate , e );
-	  listAllocOrder.push_front( iterNextNotAllocated );
+	  allocated( iterNextNotAllocated );
 
 	  iterNextNotAllocated++;
 
@@ -316,40 +651,65 @@ namespace QDP
 	}
       }
     } while ( findNextNotAllocated( ++candidate , size ) );
-#ifdef GPU_DEBUG
-    QDP_debug("Pool allocator: out of memory");
-#endif
     return false;
   }
 
 
+  template<class Allocator>
+  bool QDPPoolAllocator<Allocator>::allocateBestFit( void ** ptr , size_t size ) {
 
+    typename mapFree_t::iterator f = mapFree.lower_bound( std::make_pair( size , (void*)NULL ) );
+    if (f == mapFree.end())
+      return false;
 
-  template<class Allocator>
-  void QDPPoolAllocator<Allocator>::free(const void *mem) {
+    typename listEntry_t::iterator candidate = f->second;
+    mapFree.erase(f);
 
-    typename listEntryIter_t::iterator q = listAllocOrder.begin();
+    if (candidate->size > size) {
+      entry_t e;
+      e.ptr = candidate->ptr;
+      e.size = size;
+      e.allocated = true;
+      e.arena = candidate->arena;
 
-    bool found=false;
-    while ((!found) && ( q != listAllocOrder.end() )) {
-      if ((*q)->ptr == mem) 
-	found=true;
-      else {
-	q++;
-      }
+      candidate->ptr = (void*)( (size_t)(candidate->ptr) + size );
+      candidate->size = candidate->size - size;
+      indexFree( candidate );
+
+      candidate = listEntry.insert( candidate , e );
+    } else {
+      candidate->allocated = true;
     }
 
-    if (!found) {
+    allocated( candidate );
+    *ptr = candidate->ptr;
+
+    return true;
+  }
+
+
+
+
+  template<class Allocator>
+  void QDPPoolAllocator<Allocator>::free(const void *mem) {
+
+    auto q = mapAlloc.find( mem );
+
+    if (q == mapAlloc.end()) {
       QDP_error_exit("pool allocator: free: address not found %p",mem);
     }
 
-    typename listEntry_t::iterator p = *q;
+    typename listEntry_t::iterator p = q->second;
     p->allocated = false;
+    in_use -= p->size;
+
+    mapAlloc.erase(q);
 
     if ( p != listEntry.begin() ) {
       typename listEntry_t::iterator prev = p;
       prev--;
-      if (!prev->allocated) {
+      if (!prev->allocated && prev->arena == p->arena) {
+	unindexFree( prev );
 	prev->size += p->size;
 	listEntry.erase(p);
 	p = prev;
@@ -359,15 +719,21 @@ namespace QDP
     if ( p != --listEntry.end() ) {
       typename listEntry_t::iterator next = p;
       next++;
-      if (!next->allocated) {
+      if (!next->allocated && next->arena == p->arena) {
+	unindexFree( next );
 	p->size += next->size;
 	listEntry.erase(next);
       }
     }
 
-    iterNextNotAllocated = p;
+    if ( arenas[ p->arena ].dedicated ) {
+      releaseArena( p );
+      return;
+    }
 
-    listAllocOrder.erase(q);
+    indexFree( p );
+
+    iterNextNotAllocated = p;
 
     return;
   }
@@ -386,6 +752,72 @@ namespace QDP
   }
 
 
+  template<class Allocator>
+  void QDPPoolAllocator<Allocator>::setArenaSize(size_t s) {
+    size_t alignment = Allocator::ALIGNMENT_SIZE;
+    arenaSize = (s + (alignment) - 1) & ~((alignment) - 1);
+  }
+
+
+  template<class Allocator>
+  void QDPPoolAllocator<Allocator>::setBestFit(bool b) {
+    bestFit = b;
+
+    mapFree.clear();
+    for ( typename listEntry_t::iterator p = listEntry.begin(); p != listEntry.end() ; p++ )
+      if (!p->allocated)
+	indexFree( p );
+  }
+
+
+  template<class Allocator>
+  typename QDPPoolAllocator<Allocator>::stats_t QDPPoolAllocator<Allocator>::getStats() const {
+    stats_t st;
+    st.pool         = poolSize;
+    st.in_use       = in_use;
+    st.peak_in_use  = peak_in_use;
+    st.free         = 0;
+    st.largest_free = 0;
+    st.free_blocks  = 0;
+    st.allocs       = n_allocs;
+    st.failed       = n_failed;
+    st.arenas       = 0;
+    st.reserved     = reserved;
+    st.arenas_added    = n_arenas_added;
+    st.arenas_released = n_arenas_released;
+
+    for ( auto& a : arenas )
+      if (a.unaligned)
+	++st.arenas;
+
+    for ( auto& e : listEntry )
+      if (!e.allocated) {
+	st.free += e.size;
+	st.largest_free = std::max( st.largest_free , e.size );
+	++st.free_blocks;
+      }
+
+    return st;
+  }
+
+
+  template<class Allocator>
+  void QDPPoolAllocator<Allocator>::printStats() {
+    stats_t st = getStats();
+
+    double frag = st.free ? 1. - (double)st.largest_free / st.free : 0.;
+
+    QDPIO::cout << "Pool allocator (" << ( bestFit ? "best fit" : "next fit" ) << "):\n";
+    QDPIO::cout << "  pool size:                           " << st.pool << "\n";
+    QDPIO::cout << "  arenas, reserved:                    " << st.arenas << ", " << st.reserved << "\n";
+    QDPIO::cout << "  arenas added, released:              " << st.arenas_added << ", " << st.arenas_released << "\n";
+    QDPIO::cout << "  in use, peak:                        " << st.in_use << ", " << st.peak_in_use << "\n";
+    QDPIO::cout << "  free blocks, largest:                " << st.free_blocks << ", " << st.largest_free << "\n";
+    QDPIO::cout << "  fragmentation:                       " << frag << "\n";
+    QDPIO::cout << "  allocations, failed:                 " << st.allocs << ", " << st.failed << "\n";
+  }
+
+
 
 
 } // namespace QDP
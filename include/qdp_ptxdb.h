@@ -0,0 +1,88 @@
+// -*- C++ -*-
+
+#ifndef QDP_PTXDB_H
+#define QDP_PTXDB_H
+
+#include <string>
+#include <cstdint>
+
+namespace QDP {
+
+  //! Identifies a kernel by its IR before libdevice import and optimization, prefixed with the code generation settings
+  struct PtxIrHash {
+    uint64_t hash  = 0;   // FNV-1a, indexed, 0 for none
+    uint32_t check = 0;   // CRC32, must match too, so a collision of hash doesn't return another kernel
+
+    bool operator==( const PtxIrHash& h ) const { return hash == h.hash && check == h.check; }
+  };
+
+  // Persistent PTX kernel store
+  //
+  // <fname>      data file, append-only sequence of records
+  //              [ record header | key | ptx ]
+  //              The header carries the sizes, two hashes of the
+  //              kernel's unoptimized IR and the code generation settings
+  //              (see PtxIrHash) and a CRC32 over key and ptx, so a torn
+  //              write at the end of the file is detected and cut off.
+  //
+  // <fname>.idx  mmap'ed open addressing hash tables (by key, by IR hash)
+  //              pointing to record offsets in the data file. A lookup
+  //              reads only the one record it hits. The index is rebuilt
+  //              from the data file when it's missing or invalid.
+  //
+  // The DB is opened on the primary node only. Appends serialize on an
+  // advisory lock of the data file, so concurrent jobs can share a DB.
+
+  class PtxDB {
+  public:
+    PtxDB();
+    ~PtxDB();
+
+    void open( const std::string& fname );
+    void close();
+
+    bool is_open() const { return fd_data >= 0; }
+
+    bool find( const std::string& key , std::string& ptx );
+    bool find_ir( const PtxIrHash& ir_hash , std::string& ptx );
+
+    void insert( const std::string& key , const PtxIrHash& ir_hash , const std::string& ptx );
+
+    size_t size() const;
+
+    static uint64_t hash( const char* buf , size_t len );
+
+  private:
+    struct FileHeader;
+    struct RecordHeader;
+    struct IndexHeader;
+    struct Slot;
+
+    PtxDB(const PtxDB&);
+    PtxDB& operator=(const PtxDB&);
+
+    bool read_record( uint64_t offset , std::string* key , std::string* ptx , PtxIrHash* ir_hash , uint64_t* next );
+
+    bool map_index();
+    void unmap_index();
+    void build_index( uint64_t nslots , uint64_t end , bool verify );
+    void sync_tail();
+
+    void index_add( uint64_t key_hash , uint64_t ir_hash , uint64_t offset );
+    static void table_add( Slot* table , uint64_t nslots , uint64_t hash , uint64_t offset );
+
+    void lock();
+    void unlock();
+
+    std::string fname_data;
+    std::string fname_index;
+
+    int    fd_data;
+    int    fd_index;
+    void*  index;
+    size_t index_bytes;
+  };
+
+}
+
+#endif
@@ -97,6 +97,72 @@ namespace QDP {
 
 
 
+  // First stage of sum() of an expression, the expression is evaluated in the kernel
+  // T1 expression type
+  // T2 output
+  template < class RHS , class T1 , class T2 >
+  void qdp_jit_reduce_expr(int size, 
+			   int threads, 
+			   int blocks, 
+			   int shared_mem_usage,
+			   const QDPExpr<RHS,OLattice<T1> >& rhs,
+			   int out_id, 
+			   const Subset& s)
+  {
+    static CUfunction function;
+
+    // Build the function
+    if (function == NULL)
+      {
+	function = function_sum_expr_build<RHS,T1,T2>(rhs);
+      }
+
+    AddressLeaf addr_leaf(s);
+    forEach(rhs, addr_leaf, NullCombine());
+
+    // Execute the function
+    function_sum_expr_exec(function, size, threads, blocks, shared_mem_usage, 
+			   addr_leaf.ids, out_id, s.getIdSiteTable() );
+  }
+
+
+  // First stage of sumMulti() of an expression
+  template < class RHS , class T1 , class T2 >
+  void qdp_jit_summulti_expr(int size, 
+			     int threads, 
+			     int blocks, 
+			     int shared_mem_usage,
+			     const QDPExpr<RHS,OLattice<T1> >& rhs,
+			     int out_id,
+			     int numsubsets,
+			     const multi1d<int>& sizes,
+			     const multi1d<int>& table_ids)
+  {
+    static CUfunction function;
+
+    assert( sizes.size() == numsubsets );
+    assert( table_ids.size() == numsubsets );
+
+    // Build the function
+    if (function == NULL)
+      {
+	function = function_summulti_expr_build<RHS,T1,T2>(rhs);
+      }
+
+    AddressLeaf addr_leaf(all);
+    forEach(rhs, addr_leaf, NullCombine());
+
+    // Execute the function
+    function_summulti_expr_exec(function,
+				size, threads, blocks, shared_mem_usage, 
+				addr_leaf.ids, out_id,
+				numsubsets ,
+				sizes ,
+				table_ids );
+  }
+
+
+
   // T input/output
   template < class T >
   void qdp_jit_summulti(int size, 
@@ -167,24 +233,50 @@ namespace QDP {
 
 
 
-  template<class T1>
-  typename UnaryReturn<OLattice<T1>, FnSum>::Type_t
-  sum(const OLattice<T1>& s1, const Subset& s)
+  // Host mode: sum of the input on the sites of s into d. Each thread of the
+  // kernel sums a chunk of the sites, the partial sums are added here.
+  template<class T2, class Input>
+  void qdp_host_sum( Input& input , const std::vector<int>& input_ids , const Subset& s , OScalar<T2>& d )
   {
-    typedef typename UnaryReturn<OLattice<T1>, FnSum>::Type_t::SubType_t T2;
-    
-    //QDP_info("sum(lat,subset) dev");
+    static JitHostFunction* function;
 
-    int out_id,in_id;
+    // Build the function
+    if (function == NULL)
+      {
+	function = function_sum_host_build<T2>( input );
+      }
 
-    typename UnaryReturn<OLattice<T1>, FnSum>::Type_t  d;
+    int size    = s.numSiteTable();
+    int nchunks = std::max( 1 , std::min( size , 4 * jit_host_threads() ) );
 
-#if defined(QDP_USE_PROFILING)   
-    static QDPProfile_t prof(d, OpAssign(), FnSum(), s1);
-    prof.stime(getClockTime());
-#endif
+    int tmp_id = QDP_get_global_cache().add( nchunks*sizeof(T2) , QDPCache::Flags::Empty , QDPCache::Status::undef , NULL , NULL , NULL );
+    int out_id = QDP_get_global_cache().add( nchunks*sizeof(T2) , QDPCache::Flags::Empty , QDPCache::Status::undef , NULL , NULL , NULL );
+
+    function_sum_host_exec( function , size , nchunks , input_ids , tmp_id , out_id , s.getIdSiteTable() );
+
+    std::vector<int> ids( 1 , out_id );
+    std::vector<T2> part( nchunks );
+    CudaMemcpyD2H( part.data() , QDP_get_global_cache().get_kernel_args( ids , false )[0] , nchunks*sizeof(T2) );
+
+    T2 acc;
+    zero_rep( acc );
+    for ( const T2& p : part )
+      acc += p;
+    d.elem() = acc;
+
+    QDP_get_global_cache().signoff( tmp_id );
+    QDP_get_global_cache().signoff( out_id );
+  }
+
+
+
+  // Reduction stages of sum() into d_id. The first stage reads the input:
+  // first_stage( size, threads, blocks, shared_mem_usage, out_id )
+  template<class T2, class FirstStage>
+  void qdp_jit_sum_stages( unsigned actsize , int d_id , const FirstStage& first_stage )
+  {
+    int out_id,in_id;
 
-    unsigned actsize=s.numSiteTable();
     bool first=true;
     while (1) {
 
@@ -206,22 +298,12 @@ namespace QDP {
 	in_id  = QDP_get_global_cache().add( numBlocks*sizeof(T2) , QDPCache::Flags::Empty , QDPCache::Status::undef , NULL , NULL , NULL );
       }
 
-      
-      if (numBlocks == 1) {
-	if (first) {
-	  qdp_jit_reduce_convert_indirection<T1,T2,JitDeviceLayout::Coalesced>(actsize, numThreads, numBlocks, shared_mem_usage, s1.getId(), d.getId(), s.getIdSiteTable());
-	}
-	else {
-	  qdp_jit_reduce<T2>( actsize , numThreads , numBlocks, shared_mem_usage , in_id , d.getId() );
-	}
-      } else {
-	if (first) {
-	  qdp_jit_reduce_convert_indirection<T1,T2,JitDeviceLayout::Coalesced>(actsize, numThreads, numBlocks, shared_mem_usage, s1.getId(), out_id, s.getIdSiteTable());
-	}
-	else
-	  qdp_jit_reduce<T2>( actsize , numThreads , numBlocks , shared_mem_usage , in_id , out_id );
+      int dest_id = numBlocks == 1 ? d_id : out_id;
 
-      }
+      if (first)
+	first_stage( actsize , numThreads , numBlocks , shared_mem_usage , dest_id );
+      else
+	qdp_jit_reduce<T2>( actsize , numThreads , numBlocks , shared_mem_usage , in_id , dest_id );
 
       first =false;
 
@@ -237,6 +319,77 @@ namespace QDP {
 
     QDP_get_global_cache().signoff( in_id );
     QDP_get_global_cache().signoff( out_id );
+  }
+
+
+
+  template<class T1>
+  typename UnaryReturn<OLattice<T1>, FnSum>::Type_t
+  sum(const OLattice<T1>& s1, const Subset& s)
+  {
+    typedef typename UnaryReturn<OLattice<T1>, FnSum>::Type_t::SubType_t T2;
+    
+    //QDP_info("sum(lat,subset) dev");
+
+    typename UnaryReturn<OLattice<T1>, FnSum>::Type_t  d;
+
+#if defined(QDP_USE_PROFILING)   
+    static QDPProfile_t prof(d, OpAssign(), FnSum(), s1);
+    prof.stime(getClockTime());
+#endif
+
+    if (jit_host_mode()) {
+      JitReduceInputLattice<T1,JitDeviceLayout::Coalesced> input;
+      qdp_host_sum<T2>( input , std::vector<int>( 1 , s1.getId() ) , s , d );
+    } else {
+      qdp_jit_sum_stages<T2>( s.numSiteTable() , d.getId() ,
+			      [&]( int size , int threads , int blocks , int shared_mem_usage , int out_id ) {
+				qdp_jit_reduce_convert_indirection<T1,T2,JitDeviceLayout::Coalesced>(size, threads, blocks, shared_mem_usage,
+												     s1.getId(), out_id, s.getIdSiteTable());
+			      });
+    }
+
+    QDPInternal::globalSum(d);
+
+#if defined(QDP_USE_PROFILING)   
+    prof.etime(getClockTime());
+    prof.count++;
+    prof.print();
+#endif
+
+    return d;
+  }
+
+
+  //! sum() of an expression without shifts
+  /*!
+   * The expression is evaluated in the first reduction stage, no
+   * temporary lattice is written.
+   */
+  template<class RHS, class T1>
+  typename UnaryReturn<OLattice<T1>, FnSum>::Type_t
+  sum_expr(const QDPExpr<RHS,OLattice<T1> >& s1, const Subset& s)
+  {
+    typedef typename UnaryReturn<OLattice<T1>, FnSum>::Type_t::SubType_t T2;
+
+    typename UnaryReturn<OLattice<T1>, FnSum>::Type_t  d;
+
+#if defined(QDP_USE_PROFILING)   
+    static QDPProfile_t prof(d, OpAssign(), FnSum(), s1);
+    prof.stime(getClockTime());
+#endif
+
+    if (jit_host_mode()) {
+      JitReduceInputExpr<RHS,T1> input( s1 );
+      AddressLeaf addr_leaf(s);
+      forEach(s1, addr_leaf, NullCombine());
+      qdp_host_sum<T2>( input , addr_leaf.ids , s , d );
+    } else {
+      qdp_jit_sum_stages<T2>( s.numSiteTable() , d.getId() ,
+			      [&]( int size , int threads , int blocks , int shared_mem_usage , int out_id ) {
+				qdp_jit_reduce_expr<RHS,T1,T2>(size, threads, blocks, shared_mem_usage, s1, out_id, s);
+			      });
+    }
 
     QDPInternal::globalSum(d);
 
@@ -282,33 +435,28 @@ namespace QDP {
   //
   // sumMulti DOUBLE PRECISION
   //
-  template<class T1>
+
+  // Reduction stages of sumMulti(). The first stage reads the input:
+  // first_stage( size, threads, blocks, shared_mem_usage, out_id, numsubsets, sizes, table_ids )
+  template<class T1, class FirstStage>
   typename UnaryReturn<OLattice<T1>, FnSumMulti>::Type_t
-  sumMulti( const OLattice<T1>& s1 , const Set& ss )
+  qdp_jit_summulti_stages( const Set& ss , const FirstStage& first_stage )
   {
     typedef typename UnaryReturn<OLattice<T1>, FnSum>::Type_t::SubType_t T2;
 
     const int numsubsets = ss.numSubsets();
     
-    int maxsize = 0;
     multi1d<int> table_ids( numsubsets );
     for (int i = 0 ; i < numsubsets ; ++i )
       {
 	table_ids[i] = ss[i].getIdSiteTable();
-	if ( ss[i].numSiteTable() > maxsize )
-	  maxsize = ss[i].numSiteTable();
       }
     
-    //QDPIO::cout << "number of subsets:           " << ss.numSubsets() << "\n";
-      
-    //QDPIO::cout << "sizes = ";
     multi1d<int> sizes(numsubsets);
     for (int i = 0 ; i < numsubsets ; ++i )
       {
 	sizes[i] = ss[i].numSiteTable();
-	//QDPIO::cout << sizes[i] << " ";
       }
-    //QDPIO::cout << "\n";
     
     bool first=true;
     
@@ -323,8 +471,6 @@ namespace QDP {
 	    maxsize = sizes[i];
 	}
       
-      //QDPIO::cout << "maxsize: " << maxsize << "\n";
-
       unsigned numThreads = DeviceParams::Instance().getMaxBlockX();
       while ((numThreads*sizeof(T2) > DeviceParams::Instance().getMaxSMem()) || (numThreads > maxsize)) {
 	numThreads >>= 1;
@@ -343,67 +489,26 @@ namespace QDP {
 	in_id  = QDP_get_global_cache().add( numBlocks*sizeof(T2)*numsubsets , QDPCache::Flags::Empty , QDPCache::Status::undef , NULL , NULL , NULL );
       }
 
-      if (numBlocks == 1) {
-	if (first) {
-	  qdp_jit_summulti_convert_indirection<T1,T2,JitDeviceLayout::Coalesced>(maxsize, numThreads, numBlocks,
-										 shared_mem_usage,
-										 s1.getId(), out_id,
-										 numsubsets,
-										 sizes,
-										 table_ids);
-	}
-	else {
-	  qdp_jit_summulti<T2>(maxsize, numThreads, numBlocks,
-			       shared_mem_usage,
-			       in_id, out_id,
-			       numsubsets,
-			       sizes);
-	}
-      } else {
-	if (first) {
-	      qdp_jit_summulti_convert_indirection<T1,T2,JitDeviceLayout::Coalesced>(maxsize, numThreads, numBlocks,
-										     shared_mem_usage,
-										     s1.getId(), out_id,
-										     numsubsets,
-										     sizes,
-										     table_ids);
-	}
-	else {
-	  qdp_jit_summulti<T2>(maxsize, numThreads, numBlocks,
-			       shared_mem_usage,
-			       in_id, out_id,
-			       numsubsets,
-			       sizes);
-	}
-
+      if (first) {
+	first_stage( maxsize , numThreads , numBlocks , shared_mem_usage , out_id , numsubsets , sizes , table_ids );
       }
-
-#if 0
-      {
-	multi1d<double> tmp(numBlocks*numsubsets);
-	std::vector<int> ids = {out_id};
-	auto ptrs = QDP_get_global_cache().get_kernel_args( ids , false );
-      
-	CudaMemcpyD2H( (void*)tmp.slice() , ptrs[0] , numBlocks*numsubsets*sizeof(double) );
-	QDPIO::cout << "out: ";
-	for(int i=0;i<tmp.size();i++)
-	  QDPIO::cout << tmp[i] << " ";
-	QDPIO::cout << "\n";
+      else {
+	qdp_jit_summulti<T2>(maxsize, numThreads, numBlocks,
+			     shared_mem_usage,
+			     in_id, out_id,
+			     numsubsets,
+			     sizes);
       }
-#endif
-      
+
       first =false;
 
       if (numBlocks==1)
 	break;
 
-      //QDPIO::cout << "new sizes = ";
       for (int i = 0 ; i < numsubsets ; ++i )
 	{
 	  sizes[i] = numBlocks;
-	  //QDPIO::cout << sizes[i] << " ";
 	}
-      //QDPIO::cout << "\n";
 
       int tmp = in_id;
       in_id = out_id;
@@ -426,6 +531,66 @@ namespace QDP {
   }
 
 
+  template<class T1>
+  typename UnaryReturn<OLattice<T1>, FnSumMulti>::Type_t
+  sumMulti( const OLattice<T1>& s1 , const Set& ss )
+  {
+    typedef typename UnaryReturn<OLattice<T1>, FnSum>::Type_t::SubType_t T2;
+
+    if (jit_host_mode()) {
+      typename UnaryReturn<OLattice<T1>, FnSumMulti>::Type_t dest( ss.numSubsets() );
+      JitReduceInputLattice<T1,JitDeviceLayout::Coalesced> input;
+      for (int i = 0 ; i < ss.numSubsets() ; ++i )
+	qdp_host_sum<T2>( input , std::vector<int>( 1 , s1.getId() ) , ss[i] , dest[i] );
+      QDPInternal::globalSumArray(dest);
+      return dest;
+    }
+
+    return qdp_jit_summulti_stages<T1>( ss ,
+					[&]( int size , int threads , int blocks , int shared_mem_usage , int out_id ,
+					     int numsubsets , const multi1d<int>& sizes , const multi1d<int>& table_ids ) {
+					  qdp_jit_summulti_convert_indirection<T1,T2,JitDeviceLayout::Coalesced>(size, threads, blocks,
+														 shared_mem_usage,
+														 s1.getId(), out_id,
+														 numsubsets,
+														 sizes,
+														 table_ids);
+					});
+  }
+
+
+  //! sumMulti() of an expression without shifts, evaluated in the first reduction stage
+  template<class RHS, class T1>
+  typename UnaryReturn<OLattice<T1>, FnSumMulti>::Type_t
+  sumMulti_expr( const QDPExpr<RHS,OLattice<T1> >& s1 , const Set& ss )
+  {
+    typedef typename UnaryReturn<OLattice<T1>, FnSum>::Type_t::SubType_t T2;
+
+    if (jit_host_mode()) {
+      typename UnaryReturn<OLattice<T1>, FnSumMulti>::Type_t dest( ss.numSubsets() );
+      JitReduceInputExpr<RHS,T1> input( s1 );
+      for (int i = 0 ; i < ss.numSubsets() ; ++i ) {
+	AddressLeaf addr_leaf(ss[i]);
+	forEach(s1, addr_leaf, NullCombine());
+	qdp_host_sum<T2>( input , addr_leaf.ids , ss[i] , dest[i] );
+      }
+      QDPInternal::globalSumArray(dest);
+      return dest;
+    }
+
+    return qdp_jit_summulti_stages<T1>( ss ,
+					[&]( int size , int threads , int blocks , int shared_mem_usage , int out_id ,
+					     int numsubsets , const multi1d<int>& sizes , const multi1d<int>& table_ids ) {
+					  qdp_jit_summulti_expr<RHS,T1,T2>(size, threads, blocks,
+									   shared_mem_usage,
+									   s1, out_id,
+									   numsubsets,
+									   sizes,
+									   table_ids);
+					});
+  }
+
+
 
 
   template<class T>
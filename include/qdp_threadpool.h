@@ -0,0 +1,67 @@
+// -*- C++ -*-
+
+#ifndef QDP_THREADPOOL_H
+#define QDP_THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <vector>
+
+namespace QDP {
+
+  // Fixed number of worker threads executing tasks in FIFO order.
+  // Without workers (size 0) tasks run in the submitting thread.
+  class ThreadPool
+  {
+  public:
+    ThreadPool() {}
+    ~ThreadPool() { stop(); }
+
+    void start( int nthreads );
+    void stop();
+
+    int size() const { return workers.size(); }
+
+    template<class F>
+    std::future< typename std::result_of<F()>::type > submit( F f )
+    {
+      typedef typename std::result_of<F()>::type R;
+
+      std::shared_ptr< std::packaged_task<R()> > task = std::make_shared< std::packaged_task<R()> >( std::move(f) );
+      std::future<R> ret = task->get_future();
+
+      if (workers.empty())
+	{
+	  (*task)();
+	  return ret;
+	}
+
+      {
+	std::lock_guard<std::mutex> lock(mutex);
+	queue.push_back( [task]() { (*task)(); } );
+      }
+      cond.notify_one();
+      return ret;
+    }
+
+  private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void run();
+
+    std::vector< std::thread >            workers;
+    std::deque< std::function<void()> >   queue;
+    std::mutex                            mutex;
+    std::condition_variable               cond;
+    bool                                  stopping = false;
+  };
+
+}
+
+#endif
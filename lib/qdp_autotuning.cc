@@ -1,16 +1,27 @@
 #include "qdp.h"
+#include <sstream>
+#include <algorithm>
 
 namespace QDP {
 
-  struct tune_t {
-    tune_t(): cfg(0),best(0),best_time(0.0) {}
-    tune_t(int cfg,int best,double best_time): cfg(cfg),best(best),best_time(best_time) {}
-    int    cfg;
-    int    best;
-    double best_time;
-  };
+  namespace jit_tune {
+    JitTuneDB db;
+    JitTuneDB unnamed;   // kernels without PTX DB id, not stored
+    std::string fname;
+
+    JitTuneSpace space;
+    std::string strategy_name = "greedy";
+    std::unique_ptr< JitTuneStrategy > strategy;
+
+    // Entry of kernel and bucket, points into db or unnamed
+    std::map< std::pair< CUfunction , int > , tune_t* > mapTune;
 
-  std::map< CUfunction , tune_t > mapTune;
+    CUevent ev_start = NULL;
+    CUevent ev_stop  = NULL;
+
+    // Cache configuration applied to each kernel, a kernel starts with none
+    std::map< CUfunction , CUfunc_cache > mapCacheConfig;
+  }
 
 
   void LaunchPrintArgs( std::vector<void*>& args )
@@ -18,7 +29,7 @@ namespace QDP {
     QDP_info("Number of kernel arguments: %d",(int)args.size());
     int i=0;
     QDP_info("            bool          int     pointer");
-    for (void *addr : args)	
+    for (void *addr : args)
       QDP_info("%2d: %12d %12d %p",i++,*(bool*)addr,*(int*)addr,*(void**)addr);
     QDP_info("Device pool info:");
     //CUDADevicePoolAllocator::Instance().printPoolInfo();
@@ -26,7 +37,278 @@ namespace QDP {
   }
 
 
-  void jit_launch(CUfunction function,int th_count,std::vector<int>& ids)
+  namespace {
+
+    CUfunc_cache cu_cache_config( JitCachePref pref )
+    {
+      switch (pref) {
+      case JitCachePref::shared: return CU_FUNC_CACHE_PREFER_SHARED;
+      case JitCachePref::l1:     return CU_FUNC_CACHE_PREFER_L1;
+      case JitCachePref::equal:  return CU_FUNC_CACHE_PREFER_EQUAL;
+      default:                   return CU_FUNC_CACHE_PREFER_NONE;
+      }
+    }
+
+
+    // Only when it changes, the driver call isn't free
+    void jit_set_cache_config( CUfunction function , JitCachePref pref )
+    {
+      CUfunc_cache config = cu_cache_config( pref );
+
+      auto it = jit_tune::mapCacheConfig.find( function );
+      CUfunc_cache current = it == jit_tune::mapCacheConfig.end() ? CU_FUNC_CACHE_PREFER_NONE : it->second;
+      if (current == config)
+	return;
+
+      CUresult result = cuFuncSetCacheConfig( function , config );
+      if (result != CUDA_SUCCESS) {
+	CudaCheckResult(result);
+	QDP_error_exit("cuFuncSetCacheConfig failed");
+      }
+      jit_tune::mapCacheConfig[ function ] = config;
+    }
+
+
+    class CudaLaunchTimer: public JitLaunchTimer
+    {
+    public:
+      CudaLaunchTimer( CUfunction function , int th_count , std::vector<void*>& args ):
+	function(function), th_count(th_count), args(args) {}
+
+      bool launch( const JitLaunchConfig& cfg , double* time )
+      {
+	kernel_geom_t now = getGeom( th_count , cfg.block );
+
+	if (time) {
+	  // Errors of earlier kernels aren't this one's
+	  CudaLaunchSync("autotune");
+	  cuEventRecord( jit_tune::ev_start , 0 );
+	}
+
+	jit_set_cache_config( function , cfg.cache );
+
+	//QDP_info("CUDA launch: grid=(%u,%u,%u), block=(%d,%u,%u) ",now.Nblock_x,now.Nblock_y,1,    cfg.block,1,1 );
+
+	CUresult result = cuLaunchKernel(function,   now.Nblock_x,now.Nblock_y,1,    cfg.block,1,1,    0, 0, &args[0] , 0);
+
+	if (result == CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES)
+	  return false;
+
+	if (result != CUDA_SUCCESS) {
+	  CudaCheckResult(result);
+	  CudaLaunchLogReport();
+	  LaunchPrintArgs(args);
+	  QDPIO::cout << getPTXfromCUFunc(function);
+	  QDP_error_exit("CUDA launch error%s: grid=(%u,%u,%u), block=(%d,%u,%u) ",
+			 time ? " (during autotune)" : "",
+			 now.Nblock_x,now.Nblock_y,1,    cfg.block,1,1 );
+	}
+
+	// Settled kernels, errors show at the next sync
+	if (!time && DeviceParams::Instance().getAsyncLaunch()) {
+	  CudaLaunchLogAdd( function , now.Nblock_x , now.Nblock_y , cfg.block );
+	  return true;
+	}
+
+	if (time)
+	  cuEventRecord( jit_tune::ev_stop , 0 );
+
+	//QDP_get_global_cache().releasePrevLockSet();
+	//QDP_get_global_cache().newLockSet();
+
+	result = cuCtxSynchronize();
+	if (result != CUDA_SUCCESS) {
+	  CudaCheckResult(result);
+	  CudaLaunchLogReport();
+	  LaunchPrintArgs(args);
+	  QDPIO::cout << getPTXfromCUFunc(function) << "\n";
+	  QDP_error_exit("CUDA launch error%s, on sync: grid=(%u,%u,%u), block=(%d,%u,%u) ",
+			 time ? " (during autotune)" : "",
+			 now.Nblock_x,now.Nblock_y,1,    cfg.block,1,1 );
+	}
+
+	if (time) {
+	  float ms = 0.f;
+	  cuEventElapsedTime( &ms , jit_tune::ev_start , jit_tune::ev_stop );
+	  *time = 1000. * ms;
+	}
+
+	return true;
+      }
+
+    private:
+      CUfunction          function;
+      int                 th_count;
+      std::vector<void*>& args;
+    };
+
+
+    // Best of the measured results, false if none ran
+    bool jit_tune_settle( tune_t& tune )
+    {
+      const JitTuneResult* best = NULL;
+      for ( auto& r : tune.results )
+	if ( !r.failed && !r.times.empty() && ( !best || r.time() < best->time() ) )
+	  best = &r;
+
+      if (!best)
+	return false;
+
+      tune = tune_t( best->cfg , best->time() );
+      return true;
+    }
+
+  } // namespace
+
+
+  double JitTuneResult::time() const
+  {
+    if (times.empty())
+      return 0.0;
+    std::vector<double> t( times );
+    std::sort( t.begin() , t.end() );
+    size_t n = t.size();
+    return n % 2 ? t[n/2] : 0.5 * ( t[n/2-1] + t[n/2] );
+  }
+
+
+  bool jit_tune_launch( tune_t& tune , JitTuneStrategy& strategy , const JitTuneSpace& space , JitLaunchTimer& timer )
+  {
+    if (tune.settled) {
+      if (timer.launch( tune.best , NULL ))
+	return true;
+
+      // A stored configuration no longer fits the kernel, search again without it
+      JitTuneResult r;
+      r.cfg    = tune.best;
+      r.failed = true;
+      tune = tune_t();
+      tune.results.push_back( r );
+    }
+
+    while (true) {
+      if (tune.current < 0) {
+	JitLaunchConfig cfg;
+	bool more = strategy.propose( space , tune.results , cfg );
+
+	// A configuration proposed twice ends the search too
+	for ( auto& r : tune.results )
+	  if (r.cfg == cfg)
+	    more = false;
+
+	if (!more)
+	  return jit_tune_settle( tune ) && timer.launch( tune.best , NULL );
+
+	JitTuneResult r;
+	r.cfg = cfg;
+	tune.results.push_back( r );
+	tune.current = tune.results.size() - 1;
+      }
+
+      JitTuneResult& r = tune.results[ tune.current ];
+
+      double time = 0.0;
+      if (!timer.launch( r.cfg , &time )) {
+	r.failed = true;
+	tune.current = -1;
+	continue;
+      }
+
+      r.times.push_back( time );
+      if ( (int)r.times.size() >= space.trials )
+	tune.current = -1;
+
+      //QDP_info("block = %d,  cache = %d,  time = %f", r.cfg.block, (int)r.cfg.cache, time );
+
+      return true;
+    }
+  }
+
+
+  int jit_tune_bucket( int th_count )
+  {
+    int bucket = 0;
+    while ( bucket < 31 && ( 1 << bucket ) < th_count )
+      ++bucket;
+    return bucket;
+  }
+
+
+  tune_t& JitTuneDB::get( const std::string& id , int bucket )
+  {
+    return mapTune[ std::make_pair( id , bucket ) ];
+  }
+
+
+  size_t JitTuneDB::settled() const
+  {
+    size_t n = 0;
+    for ( auto& it : mapTune )
+      if (it.second.settled)
+	++n;
+    return n;
+  }
+
+
+  void JitTuneDB::write( std::ostream& out ) const
+  {
+    out << "QDPTUNE 2\n";
+    for ( auto& it : mapTune )
+      if (it.second.settled)
+	out << it.first.second << " " << it.second.best.block << " " << (int)it.second.best.cache << " "
+	    << it.second.best_time << " " << it.first.first << "\n";
+  }
+
+
+  bool JitTuneDB::read( std::istream& in )
+  {
+    std::string magic;
+    int version;
+    if (!( in >> magic >> version ) || magic != "QDPTUNE" || version < 1 || version > 2)
+      return false;
+
+    // Version 1 has no cache preference
+    int bucket, block, cache = 0;
+    double best_time;
+    std::string id;
+    while ( in >> bucket >> block ) {
+      if (version > 1 && !( in >> cache ))
+	return false;
+      if (!( in >> best_time ))
+	return false;
+      in.ignore( 1 );
+      if (!std::getline( in , id ) || id.empty() || block < 1 || cache < 0 || cache > 3)
+	return false;
+      mapTune[ std::make_pair( id , bucket ) ] = tune_t( JitLaunchConfig( block , (JitCachePref)cache ) , best_time );
+    }
+    return in.eof();
+  }
+
+
+  bool JitTuneDB::load( const std::string& fname )
+  {
+    std::ifstream in( fname );
+    return in && read( in );
+  }
+
+
+  bool JitTuneDB::save( const std::string& fname ) const
+  {
+    // Replace the file only when complete
+    std::string tmp = fname + ".tmp";
+    {
+      std::ofstream out( tmp );
+      if (!out)
+	return false;
+      write( out );
+      if (!out)
+	return false;
+    }
+    return std::rename( tmp.c_str() , fname.c_str() ) == 0;
+  }
+
+
+  void jit_launch(CUfunction function,int th_count,std::vector<int>& ids,const std::vector<int>* written)
   {
     //QDP_get_global_cache().printLockSet();
     //QDP_get_global_cache().newLockSet();
@@ -34,114 +316,118 @@ namespace QDP {
     // for (auto i : ids)
     //   QDPIO::cout << i << ", ";
     // QDPIO::cout << "\n";
-    
-     std::vector<void*> args( QDP_get_global_cache().get_kernel_args(ids) );
-    
+
+     std::vector<void*> args( QDP_get_global_cache().get_kernel_args(ids,true,written) );
+
     // Check for thread count equals zero
     // This can happen, when inner count is zero
     if ( th_count == 0 )
       return;
 
-    if (mapTune.count(function) == 0) {
-      mapTune[function] = tune_t( DeviceParams::Instance().getMaxBlockX() , 0 , 0.0 );
+    if (jit_host_mode()) {
+      jit_host_launch( reinterpret_cast< JitHostFunction* >( function ) , th_count , args );
+      return;
     }
 
+    // The kernel may still be in codegen
+    function = llvm_resolve_cufunction( function );
 
-    tune_t& tune = mapTune[function];
+    int bucket = jit_tune_bucket( th_count );
 
+    tune_t*& tune = jit_tune::mapTune[ std::make_pair( function , bucket ) ];
+    if (!tune) {
+      std::string id = llvm_get_kernel_id( function );
+      if (id.empty()) {
+	std::ostringstream oss;
+	oss << (void*)function;
+	tune = &jit_tune::unnamed.get( oss.str() , bucket );
+      } else {
+	tune = &jit_tune::db.get( id , bucket );
+      }
+    }
 
-    if (tune.cfg == -1) {
-      kernel_geom_t now = getGeom( th_count , tune.best );
+    CudaLaunchTimer timer( function , th_count , args );
 
-      //QDP_info("CUDA launch (settled): grid=(%u,%u,%u), block=(%d,%u,%u) ",now.Nblock_x,now.Nblock_y,1,    tune.best,1,1 );
-	
-      CUresult result = cuLaunchKernel(function,   now.Nblock_x,now.Nblock_y,1,    tune.best,1,1,    0, 0, &args[0] , 0);
+    if (!jit_tune_launch( *tune , *jit_tune::strategy , jit_tune::space , timer ))
+      QDP_error_exit("Kernel launch failed with every configuration down to block size 1. Giving up.");
+  }
 
-      if (result != CUDA_SUCCESS) {
-	CudaCheckResult(result);
-	LaunchPrintArgs(args);
-	QDPIO::cout << getPTXfromCUFunc(function);
-	QDP_error_exit("CUDA launch error (after successful tuning): grid=(%u,%u,%u), block=(%d,%u,%u) ",
-		       now.Nblock_x,now.Nblock_y,1,    tune.best,1,1 );
-      }
 
-      //QDP_get_global_cache().releasePrevLockSet();
-      //QDP_get_global_cache().newLockSet();
+  void jit_tune_set_db( const char * c_str )
+  {
+    jit_tune::fname = std::string( c_str );
+  }
 
-      result = cuCtxSynchronize();
-      if (result != CUDA_SUCCESS) {
-	CudaCheckResult(result);
-	LaunchPrintArgs(args);
-	QDPIO::cout << getPTXfromCUFunc(function) << "\n";
-	QDP_error_exit("CUDA launch error (after successful autotune, on sync): grid=(%u,%u,%u), block=(%d,%u,%u) ",
-		       now.Nblock_x,now.Nblock_y,1,    tune.best,1,1 );
-      }
-    } else {
 
-      CUresult result = CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES;
-      CUresult result_sync;
-      double time;
+  void jit_tune_set_strategy( const char * c_str )
+  {
+    jit_tune::strategy_name = std::string( c_str );
+  }
 
-      while (result != CUDA_SUCCESS && tune.cfg > 0) {
-	kernel_geom_t now = getGeom( th_count , tune.cfg );
-	StopWatch w;
 
-	w.start();
+  void jit_tune_set_trials( int n )
+  {
+    jit_tune::space.trials = std::max( 1 , n );
+  }
 
-	//QDP_info("CUDA launch (trying): grid=(%u,%u,%u), block=(%d,%u,%u) ",now.Nblock_x,now.Nblock_y,1,    tune.cfg,1,1 );
 
-	result = cuLaunchKernel(function,   now.Nblock_x,now.Nblock_y,1,    tune.cfg,1,1,    0, 0, &args[0] , 0);
+  void jit_tune_init()
+  {
+    jit_tune::strategy.reset( jit_tune_strategy_create( jit_tune::strategy_name ) );
+    if (!jit_tune::strategy)
+      QDP_error_exit("-tune-strategy: unknown strategy %s (greedy, exhaustive)", jit_tune::strategy_name.c_str());
 
-	if (result != CUDA_SUCCESS && result != CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES) {
-	  CudaCheckResult(result);
-	  LaunchPrintArgs(args);
-	  QDPIO::cout << getPTXfromCUFunc(function);
-	  QDP_error_exit("CUDA launch error: grid=(%u,%u,%u), block=(%d,%u,%u) ",
-			 now.Nblock_x,now.Nblock_y,1,    tune.cfg,1,1 );
-  	}
-
-	if (result == CUDA_SUCCESS) {
-
-	  //QDP_get_global_cache().releasePrevLockSet();
-	  //QDP_get_global_cache().newLockSet();
-
-	  result_sync = cuCtxSynchronize();
-	  if (result_sync != CUDA_SUCCESS) {
-	    CudaCheckResult(result_sync);
-	    LaunchPrintArgs(args);
-	    QDPIO::cout << getPTXfromCUFunc(function);
-	    QDP_error_exit("CUDA launch error (during autotune, on sync): grid=(%u,%u,%u), block=(%d,%u,%u) ",
-			   now.Nblock_x,now.Nblock_y,1,    tune.cfg,1,1 );
-	  }
-	}
+    jit_tune::space.max_block = DeviceParams::Instance().getMaxBlockX();
 
-	w.stop();
+    // Host kernels aren't tuned
+    if (jit_host_mode())
+      return;
 
-	time = w.getTimeInMicroseconds();
-	if (result != CUDA_SUCCESS)
-	  tune.cfg >>= 1;
-      }
+    if (cuEventCreate( &jit_tune::ev_start , CU_EVENT_DEFAULT ) != CUDA_SUCCESS ||
+	cuEventCreate( &jit_tune::ev_stop  , CU_EVENT_DEFAULT ) != CUDA_SUCCESS)
+      QDP_error_exit("Tuning: could not create CUDA events");
 
-      if (tune.cfg == 0) {
-	CudaCheckResult(result);
-	QDP_error_exit("Kernel launch failed even for block size 1. Giving up.");
-      }
+    QDPIO::cout << "Tuning strategy " << jit_tune::strategy->name() << ", " << jit_tune::space.trials << " trials per configuration\n";
 
-      if (time < tune.best_time || tune.best_time == 0.0) {
-	tune.best_time = time;
-	tune.best = tune.cfg;
-      }
+    if (jit_tune::fname.empty() && get_ptx_db_enabled())
+      jit_tune::fname = get_ptx_db_fname() + ".tune";
 
-      // If time is much greater than our best time
-      // we are in the rising part of the performance 
-      // profile and stop searching any further
-      tune.cfg = time > 1.33 * tune.best_time || tune.cfg == 1 ? -1 : tune.cfg >> 1;
+    if (jit_tune::fname.empty())
+      return;
 
-      //QDP_info("time = %f,  cfg = %d,  best = %d,  best_time = %f ", time,tune.cfg,tune.best,tune.best_time );
+    // Read on the primary node, all nodes start from its results
+    std::string str;
+    if (Layout::primaryNode()) {
+      std::ifstream in( jit_tune::fname );
+      if (in) {
+	std::ostringstream oss;
+	oss << in.rdbuf();
+	str = oss.str();
+      }
     }
+    QDPInternal::broadcast_str( str );
+
+    if (str.empty()) {
+      QDPIO::cout << "Tuning DB " << jit_tune::fname << ": new\n";
+      return;
+    }
+
+    std::istringstream in( str );
+    if (!jit_tune::db.read( in ))
+      QDP_error_exit("Tuning DB %s: unknown format", jit_tune::fname.c_str());
+
+    QDPIO::cout << "Tuning DB " << jit_tune::fname << ": " << jit_tune::db.size() << " entries\n";
   }
 
 
+  void jit_tune_db_save()
+  {
+    if (jit_tune::fname.empty() || !Layout::primaryNode())
+      return;
+
+    if (!jit_tune::db.save( jit_tune::fname ))
+      QDP_info("Tuning DB %s: could not write", jit_tune::fname.c_str());
+  }
 
 
 }
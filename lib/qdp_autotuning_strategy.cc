@@ -0,0 +1,131 @@
+#include "qdp.h"
+
+
+namespace QDP
+{
+
+  namespace {
+
+    const JitTuneResult* find( const std::vector<JitTuneResult>& results , const JitLaunchConfig& cfg )
+    {
+      for ( auto& r : results )
+	if (r.cfg == cfg)
+	  return &r;
+      return NULL;
+    }
+
+
+    JitCachePref first_cache( const JitTuneSpace& space )
+    {
+      return space.caches.empty() ? JitCachePref::none : space.caches[0];
+    }
+
+
+    // When nothing ran down to the minimum, halve the smallest block size tried
+    bool below_min( const JitTuneSpace& space , const std::vector<JitTuneResult>& results , JitLaunchConfig& cfg )
+    {
+      int smallest = 0;
+      for ( auto& r : results ) {
+	if (!r.failed)
+	  return false;
+	if ( !smallest || r.cfg.block < smallest )
+	  smallest = r.cfg.block;
+      }
+
+      if ( smallest <= 1 )
+	return false;
+
+      cfg = JitLaunchConfig( smallest >> 1 , first_cache( space ) );
+      return true;
+    }
+
+
+    class TuneGreedy: public JitTuneStrategy
+    {
+    public:
+      const char* name() const { return "greedy"; }
+
+      bool propose( const JitTuneSpace& space , const std::vector<JitTuneResult>& results , JitLaunchConfig& cfg )
+      {
+	const JitCachePref cache0 = first_cache( space );
+
+	// Block sizes with the first cache preference
+	const JitTuneResult* last = NULL;
+	const JitTuneResult* best = NULL;
+	for ( auto& r : results )
+	  if ( r.cfg.cache == cache0 ) {
+	    last = &r;
+	    if ( !r.failed && ( !best || r.time() < best->time() ) )
+	      best = &r;
+	  }
+
+	if (!last) {
+	  cfg = JitLaunchConfig( space.max_block , cache0 );
+	  return true;
+	}
+
+	bool halve;
+	if (last->failed) {
+	  halve = last->cfg.block > space.min_block || !best;
+	} else {
+	  // If time is much greater than our best time
+	  // we are in the rising part of the performance
+	  // profile and stop searching any further
+	  halve = last->time() <= 1.33 * best->time() && last->cfg.block > space.min_block;
+	}
+
+	if ( halve && last->cfg.block > 1 ) {
+	  cfg = JitLaunchConfig( last->cfg.block >> 1 , cache0 );
+	  return true;
+	}
+
+	if (!best)
+	  return false;
+
+	// The other cache preferences with the best block size
+	for ( JitCachePref c : space.caches ) {
+	  JitLaunchConfig next( best->cfg.block , c );
+	  if (!find( results , next )) {
+	    cfg = next;
+	    return true;
+	  }
+	}
+
+	return false;
+      }
+    };
+
+
+    class TuneExhaustive: public JitTuneStrategy
+    {
+    public:
+      const char* name() const { return "exhaustive"; }
+
+      bool propose( const JitTuneSpace& space , const std::vector<JitTuneResult>& results , JitLaunchConfig& cfg )
+      {
+	for ( int block = space.max_block ; block >= space.min_block && block > 0 ; block >>= 1 )
+	  for ( JitCachePref c : space.caches ) {
+	    JitLaunchConfig next( block , c );
+	    if (!find( results , next )) {
+	      cfg = next;
+	      return true;
+	    }
+	  }
+
+	return below_min( space , results , cfg );
+      }
+    };
+
+  } // namespace
+
+
+  JitTuneStrategy* jit_tune_strategy_create( const std::string& name )
+  {
+    if (name == "greedy")
+      return new TuneGreedy;
+    if (name == "exhaustive")
+      return new TuneExhaustive;
+    return NULL;
+  }
+
+}
@@ -3,9 +3,11 @@
 #include <map>
 #include <list>
 #include <functional>
+#include <algorithm>
 
 #include <iostream>
 #include <fstream>
+#include <chrono>
 
 
 
@@ -87,15 +89,6 @@ namespace QDP
 
 
   struct QDPCache::Entry {
-    union JitParamUnion {
-      void *  ptr;
-      float   float_;
-      int     int_;
-      int64_t int64_;
-      double  double_;
-      bool    bool_;
-    };
-
     int    Id;
     size_t size;
     Flags  flags;
@@ -105,9 +98,9 @@ namespace QDP
     int    lockCount;
     list<int>::iterator iterTrack;
     LayoutFptr fptr;
-    JitParamUnion param;
-    QDPCache::JitParamType param_type;
     std::vector<int> multi;
+    unsigned long last_use;   // tick of the last kernel that used it
+    bool   fixed;             // the device pointer was handed out, don't move
   };
 
 
@@ -159,74 +152,54 @@ namespace QDP
 
   
 
+  int QDPCache::addJitParam( JitParamType type , JitParamUnion param )
+  {
+    int slot;
+    if (jitParamsFree.empty()) {
+      slot = jitParams.size();
+      jitParams.emplace_back();
+    } else {
+      slot = jitParamsFree.back();
+      jitParamsFree.pop_back();
+    }
+    jitParams[slot].param = param;
+    jitParams[slot].type  = type;
+    return jit_param_id_base + slot;
+  }
+
   int QDPCache::addJitParamFloat(float i)
   {
-    int Id = getNewId();
-    Entry& e = vecEntry[ Id ];
-    e.Id           = Id;
-    e.size         = 0;
-    e.flags        = Flags::JitParam;
-    e.param.float_ = i;
-    e.param_type   = JitParamType::float_;
-    e.multi.clear();
-    e.iterTrack = lstTracker.insert( lstTracker.end() , Id );
-    return Id;
+    JitParamUnion p;
+    p.float_ = i;
+    return addJitParam( JitParamType::float_ , p );
   }
 
   int QDPCache::addJitParamDouble(double i)
   {
-    int Id = getNewId();
-    Entry& e = vecEntry[ Id ];
-    e.Id            = Id;
-    e.size         = 0;
-    e.flags         = Flags::JitParam;
-    e.param.double_ = i;
-    e.param_type   = JitParamType::double_;
-    e.multi.clear();
-    e.iterTrack = lstTracker.insert( lstTracker.end() , Id );
-    return Id;
+    JitParamUnion p;
+    p.double_ = i;
+    return addJitParam( JitParamType::double_ , p );
   }
 
   int QDPCache::addJitParamInt(int i)
   {
-    int Id = getNewId();
-    Entry& e = vecEntry[ Id ];
-    e.Id           = Id;
-    e.size         = 0;
-    e.flags        = Flags::JitParam;
-    e.param.int_   = i;
-    e.param_type   = JitParamType::int_;
-    e.multi.clear();
-    e.iterTrack = lstTracker.insert( lstTracker.end() , Id );
-    return Id;
+    JitParamUnion p;
+    p.int_ = i;
+    return addJitParam( JitParamType::int_ , p );
   }
 
   int QDPCache::addJitParamInt64(int64_t i)
   {
-    int Id = getNewId();
-    Entry& e = vecEntry[ Id ];
-    e.Id            = Id;
-    e.size         = 0;
-    e.flags         = Flags::JitParam;
-    e.param.int64_  = i;
-    e.param_type    = JitParamType::int64_;
-    e.multi.clear();
-    e.iterTrack = lstTracker.insert( lstTracker.end() , Id );
-    return Id;
+    JitParamUnion p;
+    p.int64_ = i;
+    return addJitParam( JitParamType::int64_ , p );
   }
 
   int QDPCache::addJitParamBool(bool i)
   {
-    int Id = getNewId();
-    Entry& e = vecEntry[ Id ];
-    e.Id           = Id;
-    e.size         = 0;
-    e.flags        = Flags::JitParam;
-    e.param.bool_  = i;
-    e.param_type   = JitParamType::bool_;
-    e.multi.clear();
-    e.iterTrack = lstTracker.insert( lstTracker.end() , Id );
-    return Id;
+    JitParamUnion p;
+    p.bool_ = i;
+    return addJitParam( JitParamType::bool_ , p );
   }
 
   
@@ -250,6 +223,8 @@ namespace QDP
 
     e.iterTrack = lstTracker.insert( lstTracker.end() , Id );
 
+    trace( 'a' , Id , e.size );
+
     return Id;
   }
 
@@ -276,8 +251,13 @@ namespace QDP
     int Id = getNewId();
     Entry& e = vecEntry[ Id ];
 
-    while (!pool_allocator.allocate( ptr , n_bytes )) {
-      if (!spill_lru()) {
+    bool compacted = false;
+    while (!pool_allocator.allocateStatic( ptr , n_bytes )) {
+      if (!compacted && compact( n_bytes )) {
+	compacted = true;
+	continue;
+      }
+      if (!spill( n_bytes )) {
 	QDP_error_exit("cache allocate_device_static: can't spill LRU object");
       }
     }
@@ -290,6 +270,8 @@ namespace QDP
 
     e.iterTrack = lstTracker.insert( lstTracker.end() , Id );
 
+    trace( 's' , Id , n_bytes );
+
     if (track_ptr)
       {
 	// Sanity: make sure the address is not already stored
@@ -326,10 +308,16 @@ namespace QDP
     e.fptr      = func;
     e.multi.clear();
 
+    e.last_use  = tick;
+    e.fixed     = false;
+
     e.iterTrack = lstTracker.insert( lstTracker.end() , Id );
 
     stackFree.pop();
 
+    if ( !( flags & Flags::JitParam ) )
+      trace( 'a' , Id , size );
+
     return Id;
   }
 
@@ -338,11 +326,23 @@ namespace QDP
   
 
   void QDPCache::signoff(int id) {
+    if (id >= jit_param_id_base) {
+      jitParamsFree.push_back( id - jit_param_id_base );
+      return;
+    }
+
     assert( vecEntry.size() > id );
+
+    // A queued statement may still use it
+    jit_deferred_signoff( id );
+
     Entry& e = vecEntry[id];
     
     lstTracker.erase( e.iterTrack );
 
+    if ( !( e.flags & Flags::JitParam ) )
+      trace( 'd' , id );
+
     if ( !( e.flags & ( Flags::JitParam | Flags::Static | Flags::Multi ) ) )
       {
 	freeHostMemory( e );
@@ -365,26 +365,59 @@ namespace QDP
   
 
   void QDPCache::assureOnHost(int id) {
+    jit_deferred_flush();
+
     Entry& e = vecEntry[id];
     assert(e.flags != Flags::JitParam);
     assert(e.flags != Flags::Static);
+    trace( 'w' , id );
     assureHost( e );
   }
 
 
   void QDPCache::getHostPtr(void ** ptr , int id) {
     assert( vecEntry.size() > id );
+
+    jit_deferred_flush();
     Entry& e = vecEntry[id];
 
     assert(e.flags != Flags::JitParam);
     assert(e.flags != Flags::Static);
 
+    trace( 'w' , id );
     assureHost( e );
 
     *ptr = e.hstPtr;
   }
 
 
+  void QDPCache::assureOnHostRead(int id) {
+    jit_deferred_flush();
+
+    Entry& e = vecEntry[id];
+    assert(e.flags != Flags::JitParam);
+    assert(e.flags != Flags::Static);
+    trace( 'r' , id );
+    assureHostRead( e );
+  }
+
+
+  void QDPCache::getHostPtrRead(void ** ptr , int id) {
+    assert( vecEntry.size() > id );
+
+    jit_deferred_flush();
+    Entry& e = vecEntry[id];
+
+    assert(e.flags != Flags::JitParam);
+    assert(e.flags != Flags::Static);
+
+    trace( 'r' , id );
+    assureHostRead( e );
+
+    *ptr = e.hstPtr;
+  }
+
+
 
   void QDPCache::freeHostMemory(Entry& e) {
     if ( e.flags & Flags::OwnHostMemory )
@@ -431,14 +464,24 @@ namespace QDP
     if (e.devPtr)
       return;
 
+    e.fixed = false;
+
+    // Compact once before spilling, moving is cheaper than the round trip to the host
+    bool compacted = false;
     while (!pool_allocator.allocate( &e.devPtr , e.size )) {
-      if (!spill_lru()) {
+      if (!compacted && compact( e.size )) {
+	compacted = true;
+	continue;
+      }
+      if (!spill( e.size )) {
 	QDP_info("Device pool:");
 	pool_allocator.printListPool();
 	//printLockSets();
 	QDP_error_exit("cache assureDevice: can't spill LRU object. Out of GPU memory!");
       }
     }
+
+    trace( 'A' , e.Id , qdp_evict_size<QDPCUDAAllocator>( e.size ) );
   }
 
   void QDPCache::printLockSet() {
@@ -461,19 +504,22 @@ namespace QDP
 
     pool_allocator.free( e.devPtr );
     e.devPtr = NULL;
+    e.fixed = false;
+
+    trace( 'F' , e.Id , qdp_evict_size<QDPCUDAAllocator>( e.size ) );
   }
 
 
-  void QDPCache::assureDevice(int id) {
-    if (id < 0)
+  void QDPCache::assureDevice(int id , bool write) {
+    if (id < 0 || id >= jit_param_id_base)
       return;
     assert( vecEntry.size() > id );
     Entry& e = vecEntry[id];
-    assureDevice(e);
+    assureDevice(e,write);
   }
   
   
-  void QDPCache::assureDevice(Entry& e) {
+  void QDPCache::assureDevice(Entry& e , bool write) {
     if (e.flags & Flags::JitParam)
       return;
     if (e.flags & Flags::Static)
@@ -481,9 +527,17 @@ namespace QDP
 
     // new
     lstTracker.splice( lstTracker.end(), lstTracker , e.iterTrack );
+    e.last_use = tick;
 
     if (e.status == Status::device)
       return;
+
+    // Both copies agree, they stay so unless the kernel writes the device one
+    if (e.status == Status::shared) {
+      if (write)
+	e.status = Status::device;
+      return;
+    }
     
     allocateDeviceMemory(e);
 
@@ -500,6 +554,7 @@ namespace QDP
 	  CudaMemcpyH2D( e.devPtr , e.hstPtr , e.size );
 	}
 	CudaSyncTransferStream();
+	trace( '>' , e.Id , e.size );
       }
 
     e.status = Status::device;
@@ -532,6 +587,7 @@ namespace QDP
 	} else {
 	  CudaMemcpyD2H( e.hstPtr , e.devPtr , e.size );
 	}
+	trace( '<' , e.Id , e.size );
       }
 
     e.status = Status::host;
@@ -540,46 +596,217 @@ namespace QDP
   }
 
 
+  void QDPCache::assureHostRead(Entry& e) {
+    assert(e.flags != Flags::JitParam);
+    assert(e.flags != Flags::Static);
+
+    if ( e.status == Status::host || e.status == Status::shared )
+      return;
+
+    allocateHostMemory(e);
+
+    if ( e.status == Status::device )
+      {
+	if (e.fptr) {
+	  char * tmp = new char[e.size];
+	  CudaMemcpyD2H( tmp , e.devPtr , e.size );
+	  e.fptr(false,e.hstPtr,tmp);
+	  delete[] tmp;
+	} else {
+	  CudaMemcpyD2H( e.hstPtr , e.devPtr , e.size );
+	}
+	trace( '<' , e.Id , e.size );
+	e.status = Status::shared;
+      }
+    else
+      {
+	e.status = Status::host;
+      }
+  }
+
+
 
 
-  bool QDPCache::spill_lru() {
+  bool QDPCache::spill( size_t n_bytes ) {
     if (lstTracker.size() < 1)
       return false;
 
-    list<int>::iterator it_key = lstTracker.begin();
-      
-    bool found=false;
-    Entry* e;
-
-    while ( !found  &&  it_key != lstTracker.end() ) {
-      e = &vecEntry[ *it_key ];
+    trace( 'S' , -1 , n_bytes );
 
-      found = ( (e->devPtr != NULL) &&
-		(e->flags != Flags::JitParam) &&
-		(e->flags != Flags::Static) &&
-		(e->flags != Flags::Multi) &&
-		( ! (e->flags & Flags::OwnDeviceMemory) ) );
-    
-      if (!found)
-	it_key++;
+    // Owners of the pool blocks
+    std::map<void*,int> owner;
+    for ( int id : lstTracker ) {
+      Entry& e = vecEntry[id];
+      if ( e.devPtr && !( e.flags & Flags::JitParam ) )
+	owner[ e.devPtr ] = id;
     }
 
-    if (found) {
+    std::vector<QDPEvictBlock> blocks = qdp_evict_blocks( pool_allocator , [&]( void* ptr , QDPEvictBlock& b ) {
+	auto it = owner.find( ptr );
+	if (it == owner.end())
+	  return;
+	Entry& e = vecEntry[ it->second ];
+	b.id        = e.Id;
+	b.clean     = e.status == Status::shared;
+	b.age       = tick - e.last_use;
+	b.evictable = ( (e.flags != Flags::Static) &&
+			(e.flags != Flags::Multi) &&
+			( ! (e.flags & Flags::OwnDeviceMemory) ) &&
+			// arguments of the kernel being set up
+			!( in_kernel_args && e.last_use == tick ) );
+      });
+
+    std::vector<int> victims = evict_policy->victims( blocks , qdp_evict_size<QDPCUDAAllocator>( n_bytes ) );
+
+    ++evict_calls;
+
+    size_t bytes = 0;
+    int clean = 0;
+    for ( int id : victims ) {
+      Entry& e = vecEntry[id];
+      assert( e.devPtr );
+
+      bytes += e.size;
+      if (e.status == Status::shared)
+	++clean;
+      else
+	evict_copied += e.size;
+
       //QDPIO::cout << "spill id = " << e->Id << "   size = " << e->size << "\n";
-      assureHost( *e );
-      return true;
-    } else {
+      // No copy if the entry is shared
+      assureHost( e );
+    }
+
+    evict_entries += victims.size();
+    evict_clean   += clean;
+    evict_bytes   += bytes;
+
+    if (evict_verbose)
+      QDP_info("cache evict (%s): need %lu bytes, spilled %d entries, %lu bytes, %d clean",
+	       evict_policy->name() , (unsigned long)n_bytes , (int)victims.size() , (unsigned long)bytes , clean );
+
+    return !victims.empty();
+  }
+
+
+  // Slides the movable entries of each arena together with device to device
+  // copies. Not moved: static entries and entries with their own memory,
+  // the arguments of the kernel being set up, and entries whose device
+  // pointer was handed out.
+  bool QDPCache::compact( size_t n_bytes ) {
+    if (!compact_enabled)
+      return false;
+
+    // Doesn't fit even without fragmentation
+    if ( pool_allocator.getStats().free < qdp_evict_size<QDPCUDAAllocator>( n_bytes ) )
       return false;
+
+    std::map<void*,int> owner;
+    for ( int id : lstTracker ) {
+      Entry& e = vecEntry[id];
+      if ( e.devPtr && !( e.flags & Flags::JitParam ) )
+	owner[ e.devPtr ] = id;
     }
+
+    auto start = std::chrono::steady_clock::now();
+
+    size_t bytes = pool_allocator.compact( [&]( void* ptr ) {
+	auto it = owner.find( ptr );
+	if (it == owner.end())
+	  return false;
+	Entry& e = vecEntry[ it->second ];
+	return ( !( e.flags & ( Flags::Static | Flags::OwnDeviceMemory ) ) &&
+		 !e.fixed &&
+		 !( in_kernel_args && e.last_use == tick ) );
+      },
+      []( void* dst , void* src , size_t n ) {
+	CudaMemcpyD2D( dst , src , n );
+      },
+      [&]( void* from , void* to ) {
+	vecEntry[ owner[from] ].devPtr = to;
+      });
+
+    double ms = std::chrono::duration< double , std::milli >( std::chrono::steady_clock::now() - start ).count();
+
+    trace( 'C' , -1 , bytes );
+
+    ++compact_calls;
+    compact_bytes += bytes;
+    compact_ms    += ms;
+
+    if (evict_verbose)
+      QDP_info("cache compact: need %lu bytes, moved %lu bytes in %f ms",
+	       (unsigned long)n_bytes , (unsigned long)bytes , ms );
+
+    return bytes > 0;
+  }
+
+
+  void QDPCache::setEvictionPolicy( const std::string& name ) {
+    QDPEvictionPolicy* p = qdp_eviction_policy_create( name );
+    if (!p)
+      QDP_error_exit("cache: unknown eviction policy %s (lru, cost)", name.c_str() );
+    delete evict_policy;
+    evict_policy = p;
   }
 
 
+  void QDPCache::printEvictionStats() {
+    QDPIO::cout << "Cache eviction policy:                 " << evict_policy->name() << "\n";
+    QDPIO::cout << "  spills:                              " << evict_calls << "\n";
+    QDPIO::cout << "  entries spilled:                     " << evict_entries << " (" << evict_clean << " clean)\n";
+    QDPIO::cout << "  bytes spilled:                       " << evict_bytes << "\n";
+    QDPIO::cout << "  bytes copied to host:                " << evict_copied << "\n";
+    QDPIO::cout << "Cache compaction:                      " << ( compact_enabled ? "on" : "off" ) << "\n";
+    QDPIO::cout << "  passes:                              " << compact_calls << "\n";
+    QDPIO::cout << "  bytes moved:                         " << compact_bytes << "\n";
+    QDPIO::cout << "  time (ms):                           " << compact_ms << "\n";
+  }
+
 
+  void QDPCache::setTrace( const std::string& fname ) {
+    trace_fname = fname;
+  }
 
 
+  void QDPCache::closeTrace() {
+    if (trace_writer.is_open() && !trace_writer.close())
+      QDP_info("cache: error writing trace file %s", trace_fname.c_str() );
+    trace_fname.clear();
+  }
 
 
-  QDPCache::QDPCache() : vecEntry(1024)  {
+  // Opened at the first event, QMP isn't up when the options are read
+  bool QDPCache::tracing() {
+    if (trace_fname.empty())
+      return false;
+
+    if (!trace_writer.is_open()) {
+      std::string fname = trace_fname;
+      if (QMP_get_number_of_nodes() > 1)
+	fname += "." + std::to_string( QMP_get_node_number() );
+
+      if (!trace_writer.open( fname ))
+	QDP_error_exit("cache: could not open trace file %s", fname.c_str() );
+    }
+    return true;
+  }
+
+
+  void QDPCache::trace( char ev , int id ) {
+    if (tracing())
+      trace_writer.write( ev , id , 0 );
+  }
+
+  void QDPCache::trace( char ev , int id , size_t size ) {
+    if (tracing())
+      trace_writer.write( ev , id , size );
+  }
+
+
+
+
+  QDPCache::QDPCache() : vecEntry(1024) , evict_policy( qdp_eviction_policy_create("cost") )  {
     for ( int i = vecEntry.size()-1 ; i >= 0 ; --i ) {
       stackFree.push(i);
     }
@@ -587,10 +814,22 @@ namespace QDP
   }
 
 
+  bool QDPCache::isMulti(int id) {
+    if (id < 0 || id >= jit_param_id_base)
+      return false;
+
+    assert( vecEntry.size() > id );
+    return vecEntry[id].flags & QDPCache::Flags::Multi;
+  }
+
+
   bool QDPCache::isOnDevice(int id) {
     // An id < 0 indicates a NULL pointer
     if (id < 0)
       return true;
+
+    if (id >= jit_param_id_base)
+      return true;
     
     assert( vecEntry.size() > id );
     Entry& e = vecEntry[id];
@@ -601,7 +840,7 @@ namespace QDP
     if (e.flags & QDPCache::Static)
       return true;
 
-    return ( e.status == QDPCache::Status::device );
+    return ( e.status == QDPCache::Status::device || e.status == QDPCache::Status::shared );
   }
 
   namespace {
@@ -641,6 +880,9 @@ namespace QDP
 	  case Status::device:
 	    QDPIO::cout << "device\n";
 	    break;
+	  case Status::shared:
+	    QDPIO::cout << "shared\n";
+	    break;
 	  default:
 	    QDPIO::cout << "unkown\n";
 	  }
@@ -709,19 +951,30 @@ namespace QDP
     return ret;
   }
 #else
-  std::vector<void*> QDPCache::get_kernel_args(std::vector<int>& ids , bool for_kernel )
+  std::vector<void*> QDPCache::get_kernel_args(std::vector<int>& ids , bool for_kernel , const std::vector<int>* written )
   {
+    // Queued statements run first
+    jit_deferred_flush();
+
+    ++tick;
+    in_kernel_args = true;
+
     // Here we do two cycles through the ids:
     // 1) cache all objects
     // 2) check all are cached
     // This should replace the old 'lock set'
 
     //QDPIO::cout << "ids: ";
-    std::vector<int> allids;
+    std::vector<int>& allids = kernel_ids;
+    std::vector<bool>& writes = kernel_writes;
+    allids.clear();
+    writes.clear();
     for ( auto i : ids )
       {
+	bool write = !written || std::find( written->begin() , written->end() , i ) != written->end();
 	allids.push_back(i);
-	if (i >= 0)
+	writes.push_back(write);
+	if (i >= 0 && i < jit_param_id_base)
 	  {
 	    //QDPIO::cout << i << " ";
 	    assert( vecEntry.size() > i );
@@ -731,18 +984,37 @@ namespace QDP
 		for ( auto u : e.multi )
 		  {
 		    allids.push_back(u);
+		    writes.push_back(write);
 		  }
 	      }
 	  }
       }
     //QDPIO::cout << "\n";
 
+    if (tracing()) {
+      std::vector<int> args;
+      for ( auto i : allids )
+	if ( i >= 0 && i < jit_param_id_base )
+	  args.push_back( i );
+      trace( 'k' , -1 , args.size() );
+      for ( auto i : args )
+	trace( 'u' , i );
+    }
+
     //QDPIO::cout << "allids: ";
-    for ( auto i : allids ) {
-      //QDPIO::cout << i << " ";
-      assureDevice(i);
+    for ( size_t q = 0 ; q < allids.size() ; ++q ) {
+      //QDPIO::cout << allids[q] << " ";
+      assureDevice( allids[q] , writes[q] );
     }
     //QDPIO::cout << "\n";
+
+    in_kernel_args = false;
+
+    // The caller keeps the pointers
+    if (!for_kernel)
+      for ( auto i : allids )
+	if (i >= 0 && i < jit_param_id_base)
+	  vecEntry[i].fixed = true;
     
     bool all = true;
     for ( auto i : allids )
@@ -751,7 +1023,7 @@ namespace QDP
     if (!all) {
       QDPIO::cout << "It was not possible to load all objects required by the kernel into device memory\n";
       for ( auto i : ids ) {
-	if (i >= 0) {
+	if (i >= 0 && i < jit_param_id_base) {
 	  assert( vecEntry.size() > i );
 	  Entry& e = vecEntry[i];
 	  QDPIO::cout << "id = " << i << "  size = " << e.size << "  flags = " << e.flags << "  status = ";
@@ -765,6 +1037,9 @@ namespace QDP
 	  case Status::device:
 	    QDPIO::cout << "device\n";
 	    break;
+	  case Status::shared:
+	    QDPIO::cout << "shared\n";
+	    break;
 	  default:
 	    QDPIO::cout << "unkown\n";
 	  }
@@ -779,7 +1054,7 @@ namespace QDP
     // Handle multi-ids
     for ( auto i : ids )
       {
-	if (i >= 0)
+	if (i >= 0 && i < jit_param_id_base)
 	  {
 	    Entry& e = vecEntry[i];
 	    if (e.flags & QDPCache::Flags::Multi)
@@ -817,42 +1092,42 @@ namespace QDP
       QDPIO::cout << "Jit function param: ";
     
     std::vector<void*> ret;
+    ret.reserve( ids.size() );
     for ( auto i : ids ) {
-      if (i >= 0) {
-	Entry& e = vecEntry[i];
-	if (e.flags & QDPCache::Flags::JitParam) {
+      if (i >= jit_param_id_base) {
+	JitParamSlot& p = jitParams[ i - jit_param_id_base ];
 	  
-	  if (print_param)
-	    {
-	      switch(e.param_type) {
-	      case JitParamType::float_: QDPIO::cout << (float)e.param.float_ << ", "; break;
-	      case JitParamType::double_: QDPIO::cout << (double)e.param.double_ << ", "; break;
-	      case JitParamType::int_: QDPIO::cout << (int)e.param.int_ << ", "; break;
-	      case JitParamType::int64_: QDPIO::cout << (int64_t)e.param.int64_ << ", "; break;
-	      case JitParamType::bool_:
-		if (e.param.bool_)
-		  QDPIO::cout << "true, ";
-		else
-		  QDPIO::cout << "false, ";
-		break;
-	      default:
-		QDPIO::cout << "(unkown jit param type)\n"; break;
-		assert(0);
-	      }
+	if (print_param)
+	  {
+	    switch(p.type) {
+	    case JitParamType::float_: QDPIO::cout << (float)p.param.float_ << ", "; break;
+	    case JitParamType::double_: QDPIO::cout << (double)p.param.double_ << ", "; break;
+	    case JitParamType::int_: QDPIO::cout << (int)p.param.int_ << ", "; break;
+	    case JitParamType::int64_: QDPIO::cout << (int64_t)p.param.int64_ << ", "; break;
+	    case JitParamType::bool_:
+	      if (p.param.bool_)
+		QDPIO::cout << "true, ";
+	      else
+		QDPIO::cout << "false, ";
+	      break;
+	    default:
+	      QDPIO::cout << "(unkown jit param type)\n"; break;
+	      assert(0);
 	    }
+	  }
 	  
-	  assert(for_kernel);
-	  ret.push_back( &e.param );
-	  
-	} else {
+	assert(for_kernel);
+	ret.push_back( &p.param );
+
+      } else if (i >= 0) {
+	Entry& e = vecEntry[i];
 	  
-	  if (print_param)
-	    {
-	      QDPIO::cout << (size_t)e.devPtr << ", ";
-	    }
+	if (print_param)
+	  {
+	    QDPIO::cout << (size_t)e.devPtr << ", ";
+	  }
 	  
-	  ret.push_back( for_kernel ? &e.devPtr : e.devPtr );
-	}
+	ret.push_back( for_kernel ? &e.devPtr : e.devPtr );
       } else {
 	
 	if (print_param)
@@ -0,0 +1,125 @@
+#include "qdp.h"
+
+
+namespace QDP
+{
+
+  namespace {
+
+    class EvictLRU: public QDPEvictionPolicy
+    {
+    public:
+      const char* name() const { return "lru"; }
+
+      std::vector<int> victims( const std::vector<QDPEvictBlock>& blocks , size_t n_bytes )
+      {
+	std::vector<int> ret;
+
+	const QDPEvictBlock* oldest = NULL;
+	for ( auto& b : blocks )
+	  if ( b.evictable && ( !oldest || b.age > oldest->age ) )
+	    oldest = &b;
+
+	if (oldest)
+	  ret.push_back( oldest->id );
+
+	return ret;
+      }
+    };
+
+
+    class EvictCost: public QDPEvictionPolicy
+    {
+    public:
+      const char* name() const { return "cost"; }
+
+      std::vector<int> victims( const std::vector<QDPEvictBlock>& blocks , size_t n_bytes )
+      {
+	std::vector<int> ret;
+
+	const int n = blocks.size();
+
+	double best_cost = -1.;
+	int    best_lo = 0, best_hi = 0;
+
+	// For each start the shortest run that fits, runs stop at blocks that can't move
+	// and at the end of the arena
+	for ( int lo = 0 ; lo < n ; ++lo )
+	  {
+	    size_t sum = 0;
+	    double cost = 0.;
+	    int    entries = 0;
+	    int    hi = lo;
+
+	    for ( ; hi < n && sum < n_bytes ; ++hi )
+	      {
+		const QDPEvictBlock& b = blocks[hi];
+		if ( b.arena != blocks[lo].arena )
+		  break;
+		if ( b.id >= 0 && !b.evictable )
+		  break;
+		sum += b.size;
+		if ( b.id >= 0 ) {
+		  cost += entry_cost( b );
+		  ++entries;
+		}
+	      }
+
+	    if ( sum < n_bytes || entries == 0 )
+	      continue;
+
+	    if ( best_cost < 0. || cost < best_cost ) {
+	      best_cost = cost;
+	      best_lo   = lo;
+	      best_hi   = hi;
+	    }
+	  }
+
+	if ( best_cost >= 0. )
+	  {
+	    for ( int i = best_lo ; i < best_hi ; ++i )
+	      if ( blocks[i].id >= 0 )
+		ret.push_back( blocks[i].id );
+	    return ret;
+	  }
+
+	// No run is large enough, free what costs least and let the pool coalesce
+	const QDPEvictBlock* cheapest = NULL;
+	for ( auto& b : blocks )
+	  if ( b.evictable && ( !cheapest || entry_cost( b ) < entry_cost( *cheapest ) ) )
+	    cheapest = &b;
+
+	if (cheapest)
+	  ret.push_back( cheapest->id );
+
+	return ret;
+      }
+
+    private:
+      // In bytes moved: the copy to the host now, the expected copy back,
+      // and a fixed amount per spill for the cache bookkeeping
+      static double entry_cost( const QDPEvictBlock& b )
+      {
+	const double per_spill = 64 * 1024;
+
+	double cost = per_spill;
+	if ( !b.clean )
+	  cost += b.size;
+	cost += (double)b.size / ( 1. + b.age );
+	return cost;
+      }
+    };
+
+  } // namespace
+
+
+  QDPEvictionPolicy* qdp_eviction_policy_create( const std::string& name )
+  {
+    if (name == "lru")
+      return new EvictLRU;
+    if (name == "cost")
+      return new EvictCost;
+    return NULL;
+  }
+
+}
@@ -0,0 +1,82 @@
+#include "qdp.h"
+
+#include <cstring>
+
+
+namespace QDP
+{
+
+  namespace {
+
+    const char     trace_magic[8] = { 'Q' , 'D' , 'P' , 'T' , 'R' , 'A' , 'C' , 'E' };
+    const uint32_t trace_version  = 1;
+
+    struct TraceHeader
+    {
+      char     magic[8];
+      uint32_t version;
+      uint32_t record_size;
+    };
+
+  } // namespace
+
+
+  bool QDPCacheTraceWriter::open( const std::string& fname )
+  {
+    file.open( fname.c_str() , std::ios::binary );
+    if (!file.good())
+      return false;
+
+    TraceHeader h;
+    std::memcpy( h.magic , trace_magic , sizeof(h.magic) );
+    h.version     = trace_version;
+    h.record_size = sizeof(QDPCacheTraceRecord);
+    file.write( (const char*)&h , sizeof(h) );
+
+    start = std::chrono::steady_clock::now();
+    return file.good();
+  }
+
+
+  void QDPCacheTraceWriter::write( char ev , int id , size_t size )
+  {
+    QDPCacheTraceRecord r;
+    r.time = std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - start ).count();
+    r.size = size;
+    r.id   = id;
+    r.ev   = ev;
+    std::memset( r.pad , 0 , sizeof(r.pad) );
+    file.write( (const char*)&r , sizeof(r) );
+  }
+
+
+  bool QDPCacheTraceWriter::close()
+  {
+    file.flush();
+    bool ok = file.good();
+    file.close();
+    return ok;
+  }
+
+
+  bool qdp_cache_trace_read( const std::string& fname , std::vector<QDPCacheTraceRecord>& records )
+  {
+    std::ifstream in( fname.c_str() , std::ios::binary );
+    if (!in.good())
+      return false;
+
+    TraceHeader h;
+    if ( !in.read( (char*)&h , sizeof(h) ) ||
+	 std::memcmp( h.magic , trace_magic , sizeof(h.magic) ) ||
+	 h.version != trace_version ||
+	 h.record_size != sizeof(QDPCacheTraceRecord) )
+      return false;
+
+    QDPCacheTraceRecord r;
+    while ( in.read( (char*)&r , sizeof(r) ) )
+      records.push_back( r );
+
+    return true;
+  }
+
+}
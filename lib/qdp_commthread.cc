@@ -0,0 +1,231 @@
+#include "qdp.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <list>
+
+namespace QDP {
+
+  namespace {
+
+    // One exchange of a resource, at most one in flight per resource
+    struct Exchange {
+      Exchange( const FnMapRsrc* r ): r(r), done( r->mh_a.size() , false ), left( r->mh_a.size() ) {}
+
+      const FnMapRsrc*  r;
+      bool              posted = false;     // receives started
+      bool              staged = false;     // sends started
+      std::vector<bool> done;               // per message
+      int               left;
+      bool              finished = false;   // set under the lock
+    };
+
+    std::thread             worker;
+    std::mutex              mutex;
+    std::condition_variable cond;
+    std::list<Exchange>     exchanges;
+    bool                    stopping = false;
+    bool                    running = false;
+    CUstream                stream;
+
+    // Messages can't be waited for together, without progress the thread
+    // sleeps this long or until an exchange is posted
+    const std::chrono::microseconds poll_interval( 20 );
+
+
+    void check( CUresult ret , const char* what )
+    {
+      if (ret != CUDA_SUCCESS) {
+	CudaCheckResult(ret);
+	QDP_error_exit("comm thread: %s failed", what);
+      }
+    }
+
+    void start( QMP_msghandle_t mh )
+    {
+      QMP_status_t err;
+      if ((err = QMP_start(mh)) != QMP_SUCCESS)
+	QDP_error_exit(QMP_error_string(err));
+    }
+
+
+    // Advances an exchange as far as it goes without blocking, true when finished
+    bool progress( Exchange& x )
+    {
+      const FnMapRsrc& r = *x.r;
+      const bool direct = DeviceParams::Instance().getGPUDirect();
+
+      if (!x.posted) {
+	// The copies of the resource's previous exchange read the receive
+	// buffer. With GPUDirect the messages land in the device buffer read
+	// by the previous face kernel; ev_gathered is recorded after it on
+	// the default stream.
+	if (!direct) {
+	  check( cuEventSynchronize( r.ev_landed ) , "cuEventSynchronize" );
+	} else {
+	  CUresult ret = cuEventQuery( r.ev_gathered );
+	  if (ret == CUDA_ERROR_NOT_READY)
+	    return false;
+	  check( ret , "cuEventQuery" );
+	}
+
+	for ( int i = 0 ; i < r.nrecv ; ++i )
+	  start( r.mh_a[i] );
+	x.posted = true;
+      }
+
+      if (!x.staged) {
+	// The send buffer is written by the gather kernel
+	CUresult ret = cuEventQuery( r.ev_gathered );
+	if (ret == CUDA_ERROR_NOT_READY)
+	  return false;
+	check( ret , "cuEventQuery" );
+
+	if (!direct) {
+	  check( cuMemcpyDtoHAsync( r.send_buf , (CUdeviceptr)r.send_buf_dev , r.dstnum , stream ) , "cuMemcpyDtoHAsync" );
+	  check( cuStreamSynchronize( stream ) , "cuStreamSynchronize" );
+	}
+
+	for ( int i = r.nrecv ; i < r.mh_a.size() ; ++i )
+	  start( r.mh_a[i] );
+	x.staged = true;
+      }
+
+      for ( int i = 0 ; i < r.mh_a.size() ; ++i ) {
+	if (x.done[i] || QMP_is_complete( r.mh_a[i] ) != QMP_TRUE)
+	  continue;
+
+	// Receives go to the device as they land
+	if (i < r.nrecv && !direct)
+	  for ( const FnMapRsrc::Block& b : r.mh_blocks[i] )
+	    check( cuMemcpyHtoDAsync( (CUdeviceptr)r.recv_buf_dev + b.offset ,
+				      (char*)r.recv_buf + b.offset , b.size , stream ) , "cuMemcpyHtoDAsync" );
+	x.done[i] = true;
+	--x.left;
+      }
+
+      if (x.left > 0)
+	return false;
+
+      check( cuEventRecord( r.ev_landed , stream ) , "cuEventRecord" );
+      return true;
+    }
+
+
+    bool pending()
+    {
+      for ( auto& x : exchanges )
+	if (!x.finished)
+	  return true;
+      return false;
+    }
+
+
+    void run()
+    {
+      CudaSetCurrentContext();
+
+      std::unique_lock<std::mutex> lock( mutex );
+      while (true) {
+	cond.wait( lock , []() { return stopping || pending(); } );
+	if (!pending())
+	  return;
+
+	// Unfinished exchanges aren't removed from the list
+	std::vector<Exchange*> work;
+	for ( auto& x : exchanges )
+	  if (!x.finished)
+	    work.push_back( &x );
+
+	lock.unlock();
+
+	std::vector<Exchange*> finished;
+	for ( auto x : work )
+	  if (progress( *x ))
+	    finished.push_back( x );
+
+	lock.lock();
+	for ( auto x : finished )
+	  x->finished = true;
+	if (!finished.empty())
+	  cond.notify_all();
+	else
+	  cond.wait_for( lock , poll_interval );
+      }
+    }
+
+  } // namespace
+
+
+  void comm_thread_start()
+  {
+    if (running)
+      return;
+
+    check( cuStreamCreate( &stream , CU_STREAM_NON_BLOCKING ) , "cuStreamCreate" );
+
+    stopping = false;
+    worker = std::thread( run );
+    running = true;
+
+    QDP_info_primary("Communication progress thread started");
+  }
+
+
+  void comm_thread_stop()
+  {
+    if (!running)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock( mutex );
+      stopping = true;
+    }
+    cond.notify_all();
+    worker.join();
+    running = false;
+
+    exchanges.clear();
+    cuStreamDestroy( stream );
+  }
+
+
+  bool comm_thread_running()
+  {
+    return running;
+  }
+
+
+  void comm_thread_post( const FnMapRsrc& r )
+  {
+    // Launches go to the default stream
+    check( cuEventRecord( r.ev_gathered , 0 ) , "cuEventRecord" );
+
+    {
+      std::lock_guard<std::mutex> lock( mutex );
+      exchanges.push_back( Exchange( &r ) );
+    }
+    cond.notify_all();
+  }
+
+
+  void comm_thread_wait( const FnMapRsrc& r )
+  {
+    std::unique_lock<std::mutex> lock( mutex );
+
+    auto x = exchanges.begin();
+    while (x != exchanges.end() && x->r != &r)
+      ++x;
+    if (x == exchanges.end())
+      QDP_error_exit("comm thread: waiting for an exchange that wasn't posted");
+
+    cond.wait( lock , [&]() { return x->finished; } );
+    exchanges.erase( x );
+    lock.unlock();
+
+    check( cuStreamWaitEvent( 0 , r.ev_landed , 0 ) , "cuStreamWaitEvent" );
+  }
+
+}
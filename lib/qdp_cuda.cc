@@ -12,6 +12,9 @@
 // #include "cuda.h"
 
 #include <string>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
 
 #include "cudaProfiler.h"
 
@@ -78,6 +81,64 @@ namespace QDP {
 
 
 
+  namespace launch_log {
+    struct Launch {
+      CUfunction f;
+      unsigned   grid_x, grid_y, block_x;
+    };
+
+    // The most recent launches since the last sync, n counts all
+    const size_t size = 64;
+    std::vector< Launch > ring( size );
+    size_t n = 0;
+  }
+
+
+  void CudaLaunchLogAdd( CUfunction f , unsigned gridDimX , unsigned gridDimY , unsigned blockDimX )
+  {
+    launch_log::ring[ launch_log::n % launch_log::size ] = launch_log::Launch{ f , gridDimX , gridDimY , blockDimX };
+    ++launch_log::n;
+  }
+
+
+  void CudaLaunchLogReport()
+  {
+    if (launch_log::n == 0)
+      return;
+
+    size_t first = launch_log::n > launch_log::size ? launch_log::n - launch_log::size : 0;
+
+    QDP_info("%lu kernels were launched without sync since the last sync, the error may come from any of them (latest last):",
+	     (unsigned long)launch_log::n);
+    if (first > 0)
+      QDP_info("  (%lu earlier launches not kept)", (unsigned long)first);
+
+    for ( size_t i = first ; i < launch_log::n ; ++i ) {
+      const launch_log::Launch& l = launch_log::ring[ i % launch_log::size ];
+      std::string id = llvm_get_kernel_id( l.f );
+      QDP_info("  grid=(%u,%u,1), block=(%u,1,1) %s", l.grid_x, l.grid_y, l.block_x, id.empty() ? "(unknown kernel)" : id.c_str());
+    }
+
+    QDP_info("Run without -launch-async to find the failing kernel");
+    launch_log::n = 0;
+  }
+
+
+  void CudaLaunchSync( const char * where )
+  {
+    if (launch_log::n == 0)
+      return;
+
+    CUresult ret = cuCtxSynchronize();
+    if (ret != CUDA_SUCCESS) {
+      CudaCheckResult(ret);
+      CudaLaunchLogReport();
+      QDP_error_exit("CUDA error on sync (%s)", where);
+    }
+    launch_log::n = 0;
+  }
+
+
   void CudaLaunchKernel( CUfunction f, 
 			 unsigned int  gridDimX, unsigned int  gridDimY, unsigned int  gridDimZ, 
 			 unsigned int  blockDimX, unsigned int  blockDimY, unsigned int  blockDimZ, 
@@ -94,6 +155,8 @@ namespace QDP {
     QDP_debug_deep("CudaLaunchKernel ... ");
 #endif
 
+    f = llvm_resolve_cufunction( f );
+
     //std::cout << "shmem = " << sharedMemBytes << "\n";
 
     // std::cout << "CudaLaunchKernel:"
@@ -136,10 +199,12 @@ namespace QDP {
 	std::cout << " Error: " << mapCuErrorString.at(result) << "\n";
       else
 	std::cout << " Error: (not known)\n";
-      
+
+      CudaLaunchLogReport();
       QDP_error_exit("CUDA launch error (CudaLaunchKernel, on sync): grid=(%u,%u,%u), block=(%u,%u,%u), shmem=%u",
 		     gridDimX, gridDimY, gridDimZ, blockDimX, blockDimY, blockDimZ, sharedMemBytes );
     }
+    launch_log::n = 0;
 #endif
     //CudaDeviceSynchronize();
 
@@ -163,6 +228,7 @@ namespace QDP {
 	std::cout << s << " Error: " << mapCuErrorString.at(ret) << "\n";
       else
 	std::cout << s << " Error: (not known)\n";
+      CudaLaunchLogReport();
       exit(1);
     }
   }
@@ -171,7 +237,7 @@ namespace QDP {
   int CudaAttributeNumRegs( CUfunction f ) {
     int pi;
     CUresult res;
-    res = cuFuncGetAttribute ( &pi, CU_FUNC_ATTRIBUTE_NUM_REGS , f );
+    res = cuFuncGetAttribute ( &pi, CU_FUNC_ATTRIBUTE_NUM_REGS , llvm_resolve_cufunction(f) );
     CudaRes("CudaAttributeNumRegs",res);
     return pi;
   }
@@ -179,7 +245,7 @@ namespace QDP {
   int CudaAttributeLocalSize( CUfunction f ) {
     int pi;
     CUresult res;
-    res = cuFuncGetAttribute ( &pi, CU_FUNC_ATTRIBUTE_LOCAL_SIZE_BYTES , f );
+    res = cuFuncGetAttribute ( &pi, CU_FUNC_ATTRIBUTE_LOCAL_SIZE_BYTES , llvm_resolve_cufunction(f) );
     CudaRes("CudaAttributeLocalSize",res);
     return pi;
   }
@@ -187,7 +253,7 @@ namespace QDP {
   int CudaAttributeConstSize( CUfunction f ) {
     int pi;
     CUresult res;
-    res = cuFuncGetAttribute ( &pi, CU_FUNC_ATTRIBUTE_CONST_SIZE_BYTES , f );
+    res = cuFuncGetAttribute ( &pi, CU_FUNC_ATTRIBUTE_CONST_SIZE_BYTES , llvm_resolve_cufunction(f) );
     CudaRes("CudaAttributeConstSize",res);
     return pi;
   }
@@ -238,13 +304,12 @@ namespace QDP {
 
   void CudaInit() {
     //QDP_info_primary("CUDA initialization");
-    cuInit(0);
-
     int deviceCount = 0;
-    cuDeviceGetCount(&deviceCount);
+    if (cuInit(0) == CUDA_SUCCESS)
+      cuDeviceGetCount(&deviceCount);
     if (deviceCount == 0) { 
-      std::cout << "There is no device supporting CUDA.\n"; 
-      exit(1); 
+      std::cout << "There is no device supporting CUDA, JIT kernels run on the host.\n"; 
+      jit_host_set_mode(true);
     }
   }
 
@@ -260,6 +325,8 @@ namespace QDP {
   }
 
   void CudaCreateStreams() {
+    if (jit_host_mode())
+      return;
     QDPcudastreams = new CUstream[2];
     for (int i=0; i<2; i++) {
       QDP_info_primary("JIT: Creating CUDA stream %d",i);
@@ -271,16 +338,22 @@ namespace QDP {
   }
 
   void CudaSyncKernelStream() {
+    if (jit_host_mode())
+      return;
     CUresult ret = cuStreamSynchronize(QDPcudastreams[KERNEL]);
     CudaRes("cuStreamSynchronize",ret);    
   }
 
   void CudaSyncTransferStream() {
+    if (jit_host_mode())
+      return;
     CUresult ret = cuStreamSynchronize(QDPcudastreams[TRANSFER]);
     CudaRes("cuStreamSynchronize",ret);    
   }
 
   void CudaRecordAndWaitEvent() {
+    if (jit_host_mode())
+      return;
     cuEventRecord( *QDPevCopied , QDPcudastreams[TRANSFER] );
     cuStreamWaitEvent( QDPcudastreams[KERNEL] , *QDPevCopied , 0);
   }
@@ -306,10 +379,33 @@ namespace QDP {
 
 
 
+  // Needed by threads other than the one that created the context
+  void CudaSetCurrentContext()
+  {
+    if (jit_host_mode())
+      return;
+    CUresult ret = cuCtxSetCurrent( cuContext );
+    CudaRes(__func__,ret);
+  }
+
+
+
   void CudaGetDeviceProps()
   {
     CUresult ret;
 
+    if (jit_host_mode()) {
+      DeviceParams::Instance().setHost();
+      if (!setPoolSize) {
+	// The host copies of the fields need memory too
+	size_t val = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGE_SIZE) / 2;
+	QDP_info_primary("Using host memory pool size: %d MiB",(int)(val/1024/1024));
+	QDP_get_global_cache().get_allocator().setPoolSize( val );
+	setPoolSize = true;
+      }
+      return;
+    }
+
     DeviceParams::Instance().autoDetect();
 
     size_t free, total;
@@ -365,6 +461,8 @@ namespace QDP {
 
   bool CudaHostRegister(void * ptr , size_t size)
   {
+    if (jit_host_mode())
+      return true;
     CUresult ret;
     int flags = 0;
     QDP_info_primary("CUDA host register ptr=%p (%u) size=%lu (%u)",ptr,(unsigned)((size_t)ptr%4096) ,(unsigned long)size,(unsigned)((size_t)size%4096));
@@ -376,6 +474,8 @@ namespace QDP {
   
   void CudaHostUnregister(void * ptr )
   {
+    if (jit_host_mode())
+      return;
     CUresult ret;
     ret = cuMemHostUnregister(ptr);
     CudaRes("cuMemHostUnregister",ret);
@@ -384,6 +484,10 @@ namespace QDP {
 
   bool CudaHostAlloc(void **mem , const size_t size, const int flags)
   {
+    if (jit_host_mode()) {
+      *mem = malloc( size );
+      return *mem != NULL;
+    }
     CUresult ret;
     ret = cuMemHostAlloc(mem,size,flags);
     CudaRes("cudaHostAlloc",ret);
@@ -393,6 +497,10 @@ namespace QDP {
 
   void CudaHostFree(void *mem)
   {
+    if (jit_host_mode()) {
+      free( mem );
+      return;
+    }
     CUresult ret;
     ret = cuMemFreeHost(mem);
     CudaRes("cuMemFreeHost",ret);
@@ -444,6 +552,10 @@ namespace QDP {
 #ifdef GPU_DEBUG_DEEP
     QDP_debug_deep("CudaMemcpyH2DAsync dest=%p src=%p size=%d" ,  dest , src , size );
 #endif
+    if (jit_host_mode()) {
+      memcpy( dest , src , size );
+      return;
+    }
 
     if (DeviceParams::Instance().getAsyncTransfers()) {
       ret = cuMemcpyHtoDAsync((CUdeviceptr)const_cast<void*>(dest),
@@ -465,6 +577,10 @@ namespace QDP {
 #ifdef GPU_DEBUG_DEEP
     QDP_debug_deep("CudaMemcpyD2HAsync dest=%p src=%p size=%d" ,  dest , src , size );
 #endif
+    if (jit_host_mode()) {
+      memcpy( dest , src , size );
+      return;
+    }
 
     if (DeviceParams::Instance().getAsyncTransfers()) {
       ret = cuMemcpyDtoHAsync( dest,
@@ -487,8 +603,13 @@ namespace QDP {
 #ifdef GPU_DEBUG_DEEP
     QDP_debug_deep("CudaMemcpyH2D dest=%p src=%p size=%d" ,  dest , src , size );
 #endif
+    if (jit_host_mode()) {
+      memcpy( dest , src , size );
+      return;
+    }
     ret = cuMemcpyHtoD((CUdeviceptr)const_cast<void*>(dest), src, size);
     CudaRes("cuMemcpyH2D",ret);
+    launch_log::n = 0;
   }
 
   void CudaMemcpyD2H( void * dest , const void * src , size_t size )
@@ -497,13 +618,36 @@ namespace QDP {
 #ifdef GPU_DEBUG_DEEP
     QDP_debug_deep("CudaMemcpyD2H dest=%p src=%p size=%d" ,  dest , src , size );
 #endif
+    if (jit_host_mode()) {
+      memcpy( dest , src , size );
+      return;
+    }
     ret = cuMemcpyDtoH( dest, (CUdeviceptr)const_cast<void*>(src), size);
     CudaRes("cuMemcpyD2H",ret);
+    launch_log::n = 0;
+  }
+
+  void CudaMemcpyD2D( void * dest , const void * src , size_t size )
+  {
+    CUresult ret;
+#ifdef GPU_DEBUG_DEEP
+    QDP_debug_deep("CudaMemcpyD2D dest=%p src=%p size=%d" ,  dest , src , size );
+#endif
+    if (jit_host_mode()) {
+      memmove( dest , src , size );
+      return;
+    }
+    ret = cuMemcpyDtoD( (CUdeviceptr)dest, (CUdeviceptr)const_cast<void*>(src), size);
+    CudaRes("cuMemcpyD2D",ret);
   }
 
 
   bool CudaMalloc(void **mem , size_t size )
   {
+    // Device memory is host memory, aligned as from cuMemAlloc
+    if (jit_host_mode())
+      return posix_memalign( mem , 256 , size ) == 0;
+
     CUresult ret;
 #ifndef QDP_USE_CUDA_MANAGED_MEMORY
     ret = cuMemAlloc( (CUdeviceptr*)mem,size);
@@ -515,6 +659,10 @@ namespace QDP {
     QDP_debug_deep( "CudaMalloc %p", *mem );
 #endif
 
+    // Out of memory is left to the pool, it may release arenas and retry
+    if (ret == CUDA_ERROR_OUT_OF_MEMORY)
+      return false;
+
 #ifndef  QDP_USE_CUDA_MANAGED_MEMORY
     CudaRes("cuMemAlloc",ret);
 #else 
@@ -529,6 +677,10 @@ namespace QDP {
 #ifdef GPU_DEBUG_DEEP
     QDP_debug_deep( "CudaFree %p", mem );
 #endif
+    if (jit_host_mode()) {
+      free( const_cast<void*>(mem) );
+      return;
+    }
     CUresult ret;
     ret = cuMemFree((CUdeviceptr)const_cast<void*>(mem));
     CudaRes("cuMemFree",ret);
@@ -539,6 +691,8 @@ namespace QDP {
 #ifdef GPU_DEBUG_DEEP
     QDP_debug_deep( "cudaThreadSynchronize" );
 #endif
+    if (jit_host_mode())
+      return;
     cuCtxSynchronize();
   }
 
@@ -547,8 +701,11 @@ namespace QDP {
 #ifdef GPU_DEBUG_DEEP
     QDP_debug_deep( "cudaDeviceSynchronize" );
 #endif
+    if (jit_host_mode())
+      return;
     CUresult ret = cuCtxSynchronize();
     CudaRes("cuCtxSynchronize",ret);
+    launch_log::n = 0;
   }
 
 }
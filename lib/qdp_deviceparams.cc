@@ -57,6 +57,21 @@ namespace QDP {
     QDP_info_primary("max_blockz                              = %d",max_blockz);
   }
 
+  // Host mode, the limits only bound the site count of a launch
+  void DeviceParams::setHost() {
+    unifiedAddressing = true;
+    asyncTransfers = false;
+    smem = 0;
+    smem_default = 0;
+    max_gridx = max_gridy = max_gridz = 1 << 30;
+    max_blockx = max_blocky = max_blockz = 1024;
+    if (!boolNoReadSM)
+      major = minor = 0;
+    divRnd = true;
+
+    QDP_info_primary("No device, JIT kernels run on the host");
+  }
+
   void DeviceParams::setSM(int sm) {
     QDP_info_primary("Compiling LLVM IR to PTX for compute capability sm_%d (instead of autodetect)",sm);
     major = sm / 10;
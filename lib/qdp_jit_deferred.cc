@@ -0,0 +1,256 @@
+#include "qdp.h"
+
+#include <unordered_set>
+#include <unordered_map>
+
+namespace QDP {
+
+  namespace jit_deferred {
+    int max_stmts = 0;     // 0: off
+    bool flushing = false;
+
+    std::vector< std::unique_ptr< JitDeferred > > queue;
+    const Subset* subset = NULL;
+    std::unordered_set< int > ids;
+
+    // Fused kernels by the statements' kernel code
+    std::unordered_map< std::string , CUfunction > kernels;
+  }
+
+
+  void llvm_set_fuse( int n ) {
+    jit_deferred::max_stmts = n;
+  }
+
+
+  bool jit_deferred_enabled() {
+    return jit_deferred::max_stmts > 0;
+  }
+
+
+  namespace {
+
+    // Statement ids as passed to the kernel, an id already passed is left out
+    std::vector<int> jit_deferred_param_ids( const std::vector< std::unique_ptr< JitDeferred > >& stmts )
+    {
+      std::vector<int> ids;
+      std::unordered_set<int> seen;
+      for ( auto& stmt : stmts )
+	for ( int id : stmt->ids() )
+	  if (id < 0 || seen.insert( id ).second)
+	    ids.push_back( id );
+      return ids;
+    }
+
+
+    // Where the statement ids repeat: the position of the first occurrence of
+    // every id. Part of the kernel key, the parameters depend on it.
+    std::string jit_deferred_alias_pattern( const std::vector< std::unique_ptr< JitDeferred > >& stmts )
+    {
+      std::ostringstream os;
+      std::unordered_map<int,int> first;
+      int pos = 0;
+      for ( auto& stmt : stmts )
+	for ( int id : stmt->ids() ) {
+	  if (id < 0)
+	    os << "-1 ";
+	  else
+	    os << first.insert( std::make_pair( id , pos ) ).first->second << " ";
+	  ++pos;
+	}
+      return os.str();
+    }
+
+
+    // Same kernel layout as function_build, with the statements' parameters
+    // and bodies one after the other. An object used by several statements
+    // is one parameter, so distinct pointer parameters are distinct memory.
+    CUfunction jit_deferred_build( std::vector< std::unique_ptr< JitDeferred > >& stmts , const std::string& pretty )
+    {
+      if (ptx_db::db_enabled) {
+	CUfunction func = llvm_ptx_db( pretty.c_str() );
+	if (func)
+	  return func;
+      }
+
+      llvm_start_new_function();
+
+      ParamRef p_ordered      = llvm_add_param<bool>();
+      ParamRef p_th_count     = llvm_add_param<int>();
+      ParamRef p_start        = llvm_add_param<int>();
+      ParamRef p_end          = llvm_add_param<int>();
+      ParamRef p_do_site_perm = llvm_add_param<bool>();
+      ParamRef p_site_table   = llvm_add_param<int*>();
+      ParamRef p_member_array = llvm_add_param<bool*>();
+
+      bool multi = false;
+      for ( auto& stmt : stmts ) {
+	llvm_param_ids( stmt->ids() );
+	stmt->build_params();
+	if (!llvm_param_ids_done())
+	  QDP_error_exit("jit_deferred: statement has %d ids but added a different number of parameters", (int)stmt->ids().size());
+
+	for ( int id : stmt->ids() )
+	  multi = multi || QDP_get_global_cache().isMulti( id );
+      }
+      llvm_param_ids( std::vector<int>() );
+
+      llvm::Value * r_ordered      = llvm_derefParam( p_ordered );
+      llvm::Value * r_th_count     = llvm_derefParam( p_th_count );
+      llvm::Value * r_start        = llvm_derefParam( p_start );
+      llvm::Value * r_end          = llvm_derefParam( p_end );
+      llvm::Value * r_do_site_perm = llvm_derefParam( p_do_site_perm );
+
+      llvm::Value* r_no_site_perm = llvm_not( r_do_site_perm );
+      llvm::Value* r_idx_thread = llvm_thread_idx();
+
+      llvm_cond_exit( llvm_ge( r_idx_thread , r_th_count ) );
+
+      llvm::BasicBlock * block_no_site_perm_exit = llvm_new_basic_block();
+      llvm::BasicBlock * block_no_site_perm = llvm_new_basic_block();
+      llvm::BasicBlock * block_site_perm = llvm_new_basic_block();
+      llvm::BasicBlock * block_add_start = llvm_new_basic_block();
+      llvm::BasicBlock * block_add_start_else = llvm_new_basic_block();
+
+      llvm::Value* r_idx_perm_phi0;
+      llvm::Value* r_idx_perm_phi1;
+
+      llvm_cond_branch( r_no_site_perm , block_no_site_perm , block_site_perm );
+      {
+	llvm_set_insert_point(block_site_perm);
+	r_idx_perm_phi0 = llvm_array_type_indirection( p_site_table , r_idx_thread ); // PHI 0
+	llvm_branch( block_no_site_perm_exit );
+      }
+      {
+	llvm_set_insert_point(block_no_site_perm);
+	llvm_cond_branch( r_ordered , block_add_start , block_add_start_else );
+	{
+	  llvm_set_insert_point(block_add_start);
+	  r_idx_perm_phi1 = llvm_add( r_idx_thread , r_start ); // PHI 1
+	  llvm_branch( block_no_site_perm_exit );
+	  llvm_set_insert_point(block_add_start_else);
+	  llvm_branch( block_no_site_perm_exit );
+	}
+      }
+      llvm_set_insert_point(block_no_site_perm_exit);
+
+      llvm::PHINode* r_idx = llvm_phi( r_idx_perm_phi0->getType() , 3 );
+
+      r_idx->addIncoming( r_idx_perm_phi0 , block_site_perm );
+      r_idx->addIncoming( r_idx_perm_phi1 , block_add_start );
+      r_idx->addIncoming( r_idx_thread , block_add_start_else );
+
+      llvm::BasicBlock * block_ordered = llvm_new_basic_block();
+      llvm::BasicBlock * block_not_ordered = llvm_new_basic_block();
+      llvm::BasicBlock * block_ordered_exit = llvm_new_basic_block();
+      llvm_cond_branch( r_ordered , block_ordered , block_not_ordered );
+      {
+	llvm_set_insert_point(block_not_ordered);
+	llvm::Value* r_ismember     = llvm_array_type_indirection( p_member_array , r_idx );
+	llvm::Value* r_ismember_not = llvm_not( r_ismember );
+	llvm_cond_exit( r_ismember_not );
+	llvm_branch( block_ordered_exit );
+      }
+      {
+	llvm_set_insert_point(block_ordered);
+	llvm_cond_exit( llvm_gt( r_idx , r_end ) );
+	llvm_cond_exit( llvm_lt( r_idx , r_start ) );
+	llvm_branch( block_ordered_exit );
+      }
+      llvm_set_insert_point(block_ordered_exit);
+
+      for ( auto& stmt : stmts )
+	stmt->build_body( r_idx );
+
+      // Entries of a multi object are pointed to from device memory
+      if (!multi)
+	llvm_set_params_noalias();
+
+      return jit_function_epilogue_get_cuf( "jit_eval_fused.ptx" , pretty.c_str() );
+    }
+
+  } // namespace
+
+
+  void jit_deferred_enqueue( JitDeferred* stmt , const Subset& s )
+  {
+    std::unique_ptr< JitDeferred > p( stmt );
+
+    if ( !jit_deferred::queue.empty() && jit_deferred::subset != &s )
+      jit_deferred_flush();
+
+    jit_deferred::subset = &s;
+
+    for ( int id : p->ids() )
+      if (id >= 0)
+	jit_deferred::ids.insert( id );
+
+    jit_deferred::queue.push_back( std::move( p ) );
+
+    if ( (int)jit_deferred::queue.size() >= jit_deferred::max_stmts )
+      jit_deferred_flush();
+  }
+
+
+  void jit_deferred_flush()
+  {
+    if ( jit_deferred::queue.empty() || jit_deferred::flushing )
+      return;
+
+    jit_deferred::flushing = true;
+
+    std::vector< std::unique_ptr< JitDeferred > > stmts;
+    stmts.swap( jit_deferred::queue );
+    jit_deferred::ids.clear();
+
+    const Subset& s = *jit_deferred::subset;
+
+    std::string pretty;
+    for ( auto& stmt : stmts ) {
+      pretty += stmt->pretty();
+      pretty += " | ";
+    }
+    pretty += jit_deferred_alias_pattern( stmts );
+
+    CUfunction& function = jit_deferred::kernels[ pretty ];
+    if (function == NULL)
+      function = jit_deferred_build( stmts , pretty );
+
+    int th_count = s.hasOrderedRep() ? s.numSiteTable() : Layout::sitesOnNode();
+
+    JitParam jit_ordered( QDP_get_global_cache().addJitParamBool( s.hasOrderedRep() ) );
+    JitParam jit_th_count( QDP_get_global_cache().addJitParamInt( th_count ) );
+    JitParam jit_start( QDP_get_global_cache().addJitParamInt( s.start() ) );
+    JitParam jit_end( QDP_get_global_cache().addJitParamInt( s.end() ) );
+    JitParam jit_do_soffset_index( QDP_get_global_cache().addJitParamBool( false ) );   // do soffset index
+
+    std::vector<int> ids;
+    ids.push_back( jit_ordered.get_id() );
+    ids.push_back( jit_th_count.get_id() );
+    ids.push_back( jit_start.get_id() );
+    ids.push_back( jit_end.get_id() );
+    ids.push_back( jit_do_soffset_index.get_id() );
+    ids.push_back( -1 );  // soffset index table
+    ids.push_back( s.getIdMemberTable() );
+    std::vector<int> stmt_ids = jit_deferred_param_ids( stmts );
+    ids.insert( ids.end() , stmt_ids.begin() , stmt_ids.end() );
+
+    jit_launch(function,th_count,ids);
+
+    // Signs off the scalars of the statements
+    stmts.clear();
+
+    jit_deferred::flushing = false;
+  }
+
+
+  void jit_deferred_signoff( int id )
+  {
+    if ( jit_deferred::queue.empty() || jit_deferred::flushing )
+      return;
+
+    if ( jit_deferred::ids.count( id ) )
+      jit_deferred_flush();
+  }
+
+}
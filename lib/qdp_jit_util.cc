@@ -2,27 +2,26 @@
 
 namespace QDP {
 
-  extern llvm::IRBuilder<>  *builder;
-  extern llvm::Module       *Mod;
-
-
-  llvm::Function    *func_seed2float;
-  llvm::Function    *func_seedMultiply;
-
   namespace JITSTATS {
     long lattice2dev  = 0;   // changing lattice data layout to device format
     long lattice2host = 0;   // changing lattice data layout to host format
     long jitted       = 0;   // functions not in DB, thus jit-built
+    long async        = 0;   // functions with codegen in the background
+    long async_waited = 0;   // of which codegen wasn't finished at first launch
   }
 
 
   void jit_stats_lattice2dev()  { ++JITSTATS::lattice2dev; }
   void jit_stats_lattice2host() { ++JITSTATS::lattice2host; }
   void jit_stats_jitted()       { ++JITSTATS::jitted; }
+  void jit_stats_async()        { ++JITSTATS::async; }
+  void jit_stats_async_waited() { ++JITSTATS::async_waited; }
 
   long get_jit_stats_lattice2dev()  { return JITSTATS::lattice2dev; }
   long get_jit_stats_lattice2host() { return JITSTATS::lattice2host; }
   long get_jit_stats_jitted()       { return JITSTATS::jitted; }
+  long get_jit_stats_async()        { return JITSTATS::async; }
+  long get_jit_stats_async_waited() { return JITSTATS::async_waited; }
 
 
   // seedMultiply
@@ -31,34 +30,36 @@ namespace QDP {
   // and returns 1 seed (as a literal aggregate)
   //
   void jit_build_seedMultiply() {
-    assert(builder && "no builder");
-    assert(Mod && "no module");
+    JitCompilation& c = jit_current();
+
+    assert(c.builder && "no builder");
+    assert(c.Mod && "no module");
 
     std::vector< llvm::Type* > vecArgTypes;
 
-    vecArgTypes.push_back( builder->getInt32Ty() );
-    vecArgTypes.push_back( builder->getInt32Ty() );
-    vecArgTypes.push_back( builder->getInt32Ty() );
-    vecArgTypes.push_back( builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
 
-    vecArgTypes.push_back( builder->getInt32Ty() );
-    vecArgTypes.push_back( builder->getInt32Ty() );
-    vecArgTypes.push_back( builder->getInt32Ty() );
-    vecArgTypes.push_back( builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
 
-    llvm::Type* ret_types[] = { builder->getInt32Ty(),
-				builder->getInt32Ty(),
-				builder->getInt32Ty(),
-				builder->getInt32Ty() };
+    llvm::Type* ret_types[] = { c.builder->getInt32Ty(),
+				c.builder->getInt32Ty(),
+				c.builder->getInt32Ty(),
+				c.builder->getInt32Ty() };
     
-    llvm::StructType* ret_type = llvm::StructType::get(TheContext, 
+    llvm::StructType* ret_type = llvm::StructType::get(c.context, 
 						       llvm::ArrayRef< llvm::Type * >( ret_types , 4 ) );
 
     llvm::FunctionType *funcType = llvm::FunctionType::get( ret_type , 
 							    llvm::ArrayRef<llvm::Type*>( vecArgTypes.data() , 
 											 vecArgTypes.size() ) ,
 							    false );
-    llvm::Function* F = llvm::Function::Create(funcType, llvm::Function::InternalLinkage, "seedMultiply", Mod);
+    llvm::Function* F = llvm::Function::Create(funcType, llvm::Function::InternalLinkage, "seedMultiply", c.Mod.get());
 
     std::vector< llvm::Value* > args;
     unsigned Idx = 0;
@@ -69,8 +70,8 @@ namespace QDP {
       args.push_back(&*AI);
     }
 
-    llvm::BasicBlock* entry = llvm::BasicBlock::Create(TheContext, "entrypoint", F);
-    builder->SetInsertPoint(entry);
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(c.context, "entrypoint", F);
+    c.builder->SetInsertPoint(entry);
 
     typedef RScalar<WordREG<int> >  T;
     PSeedREG<T> s1,s2;
@@ -92,9 +93,9 @@ namespace QDP {
 			       s1.elem(2).elem().get_val() ,
 			       s1.elem(3).elem().get_val() };
 
-    builder->CreateAggregateRet( ret_val , 4 );
+    c.builder->CreateAggregateRet( ret_val , 4 );
 
-    func_seedMultiply = F;
+    c.func_seedMultiply = F;
   }
 
 
@@ -109,17 +110,19 @@ namespace QDP {
     assert(a6 && "llvm_seedToFloat a6");
     assert(a7 && "llvm_seedToFloat a7");
 
-    assert(func_seedMultiply && "llvm_seedMultiply func_seedMultiply");
+    JitCompilation& c = jit_current();
+
+    assert(c.func_seedMultiply && "llvm_seedMultiply func_seedMultiply");
 
     llvm::Value* pack[] = { a0,a1,a2,a3,a4,a5,a6,a7 };
 
-    llvm::Value* ret_val = builder->CreateCall( func_seedMultiply , llvm::ArrayRef< llvm::Value *>( pack ,  8 ) );
+    llvm::Value* ret_val = c.builder->CreateCall( c.func_seedMultiply , llvm::ArrayRef< llvm::Value *>( pack ,  8 ) );
 
     std::vector<llvm::Value *> ret;
-    ret.push_back( builder->CreateExtractValue( ret_val , 0 ) );
-    ret.push_back( builder->CreateExtractValue( ret_val , 1 ) );
-    ret.push_back( builder->CreateExtractValue( ret_val , 2 ) );
-    ret.push_back( builder->CreateExtractValue( ret_val , 3 ) );
+    ret.push_back( c.builder->CreateExtractValue( ret_val , 0 ) );
+    ret.push_back( c.builder->CreateExtractValue( ret_val , 1 ) );
+    ret.push_back( c.builder->CreateExtractValue( ret_val , 2 ) );
+    ret.push_back( c.builder->CreateExtractValue( ret_val , 3 ) );
 
     return ret;
   }
@@ -127,20 +130,22 @@ namespace QDP {
 
 
   void jit_build_seedToFloat() {
-    assert(builder && "no builder");
-    assert(Mod && "no module");
+    JitCompilation& c = jit_current();
+
+    assert(c.builder && "no builder");
+    assert(c.Mod && "no module");
 
     std::vector< llvm::Type* > vecArgTypes;
-    vecArgTypes.push_back( builder->getInt32Ty() );
-    vecArgTypes.push_back( builder->getInt32Ty() );
-    vecArgTypes.push_back( builder->getInt32Ty() );
-    vecArgTypes.push_back( builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
+    vecArgTypes.push_back( c.builder->getInt32Ty() );
 
-    llvm::FunctionType *funcType = llvm::FunctionType::get( builder->getFloatTy(), 
+    llvm::FunctionType *funcType = llvm::FunctionType::get( c.builder->getFloatTy(), 
 							    llvm::ArrayRef<llvm::Type*>( vecArgTypes.data() , 
 											 vecArgTypes.size() ) ,
 							    false );
-    llvm::Function* F = llvm::Function::Create(funcType, llvm::Function::InternalLinkage, "seedToFloat", Mod);
+    llvm::Function* F = llvm::Function::Create(funcType, llvm::Function::InternalLinkage, "seedToFloat", c.Mod.get());
 
     std::vector< llvm::Value* > args;
     unsigned Idx = 0;
@@ -151,8 +156,8 @@ namespace QDP {
       args.push_back(&*AI);
     }
 
-    llvm::BasicBlock* entry = llvm::BasicBlock::Create(TheContext, "entrypoint", F);
-    builder->SetInsertPoint(entry);
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(c.context, "entrypoint", F);
+    c.builder->SetInsertPoint(entry);
 
     typedef RScalar<WordREG<int> >  T;
     PSeedREG<T> s1;
@@ -187,9 +192,9 @@ namespace QDP {
     fs2 = fs1 + d.elem();
     d.elem() = twom11 * fs2;
 
-    builder->CreateRet( d.elem().elem().get_val() );
+    c.builder->CreateRet( d.elem().elem().get_val() );
 
-    func_seed2float = F;
+    c.func_seed2float = F;
   }
 
 
@@ -198,8 +203,9 @@ namespace QDP {
     assert(a1 && "llvm_seedToFloat a1");
     assert(a2 && "llvm_seedToFloat a2");
     assert(a3 && "llvm_seedToFloat a3");
-    assert(func_seed2float && "llvm_seedToFloat func_seed2float");
-    return builder->CreateCall( func_seed2float , {a0,a1,a2,a3} );
+    JitCompilation& c = jit_current();
+    assert(c.func_seed2float && "llvm_seedToFloat func_seed2float");
+    return c.builder->CreateCall( c.func_seed2float , {a0,a1,a2,a3} );
   }
 
 
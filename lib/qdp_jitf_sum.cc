@@ -58,6 +58,85 @@ namespace QDP {
 
 
 
+  void
+  function_sum_expr_exec( CUfunction function, 
+			  int size, int threads, int blocks, int shared_mem_usage,
+			  const std::vector<int>& leaf_ids, int out_id, int siteTableId )
+  {
+    int lo = 0;
+    int hi = size;
+
+    JitParam jit_lo( QDP_get_global_cache().addJitParamInt( lo ) );
+    JitParam jit_hi( QDP_get_global_cache().addJitParamInt( hi ) );
+  
+    std::vector<int> ids;
+    ids.push_back( jit_lo.get_id() );
+    ids.push_back( jit_hi.get_id() );
+    ids.push_back( siteTableId );
+    ids.insert( ids.end() , leaf_ids.begin() , leaf_ids.end() );
+    ids.push_back( out_id );
+ 
+    std::vector<void*> args( QDP_get_global_cache().get_kernel_args(ids) );
+    kernel_geom_t now = getGeom( hi-lo , threads );
+
+    CudaLaunchKernel(function,   now.Nblock_x,now.Nblock_y,1,    threads,1,1,    shared_mem_usage, 0, &args[0] , 0);
+  }
+
+
+  void
+  function_sum_host_exec( JitHostFunction* function, 
+			  int size, int nchunks,
+			  const std::vector<int>& input_ids, int tmp_id, int out_id, int siteTableId )
+  {
+    int chunk = ( size + nchunks - 1 ) / nchunks;
+
+    JitParam jit_size(  QDP_get_global_cache().addJitParamInt( size ) );
+    JitParam jit_chunk( QDP_get_global_cache().addJitParamInt( chunk ) );
+
+    std::vector<int> ids;
+    ids.push_back( jit_size.get_id() );
+    ids.push_back( jit_chunk.get_id() );
+    ids.push_back( siteTableId );
+    ids.insert( ids.end() , input_ids.begin() , input_ids.end() );
+    ids.push_back( tmp_id );
+    ids.push_back( out_id );
+
+    std::vector<void*> args( QDP_get_global_cache().get_kernel_args(ids) );
+
+    jit_host_launch( function , nchunks , args );
+  }
+
+
+  void
+  function_summulti_expr_exec( CUfunction function, 
+			       int size, int threads, int blocks, int shared_mem_usage,
+			       const std::vector<int>& leaf_ids, int out_id,
+			       int numsubsets,
+			       const multi1d<int>& sizes,
+			       const multi1d<int>& table_ids )
+  {
+    int sizes_id = QDP_get_global_cache().add( sizes.size()*sizeof(int) , QDPCache::Flags::OwnHostMemory , QDPCache::Status::host , sizes.slice() , NULL , NULL );
+
+    JitParam jit_numsubsets( QDP_get_global_cache().addJitParamInt( numsubsets ) );
+    JitParam jit_tables(     QDP_get_global_cache().addMulti(       table_ids  ) );
+						      
+    std::vector<int> ids;
+    ids.push_back( jit_numsubsets.get_id() );
+    ids.push_back( sizes_id );
+    ids.push_back( jit_tables.get_id() );
+    ids.insert( ids.end() , leaf_ids.begin() , leaf_ids.end() );
+    ids.push_back( out_id );
+ 
+    std::vector<void*> args( QDP_get_global_cache().get_kernel_args(ids) );
+    kernel_geom_t now = getGeom( size , threads );
+
+    CudaLaunchKernel(function,   now.Nblock_x,now.Nblock_y,1,    threads,1,1,    shared_mem_usage, 0, &args[0] , 0);
+
+    QDP_get_global_cache().signoff(sizes_id);
+  }
+
+
+
   void
   function_summulti_exec( CUfunction function, 
 			  int size, int threads, int blocks, int shared_mem_usage,
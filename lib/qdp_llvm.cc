@@ -23,32 +23,96 @@
 #include "llvm/Transforms/Utils/Cloning.h"
 
 #include <memory>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
 
 namespace QDP {
 
-  llvm::LLVMContext TheContext;
+  namespace jit_pool {
+    // Compilation being built on this thread
+    thread_local JitCompilation* current = NULL;
 
+    // Compilations not in use. They keep their context.
+    std::mutex mutex;
+    std::vector< std::unique_ptr< JitCompilation > > free;
 
-  llvm::BasicBlock  *entry;
-  llvm::Function    *mainFunc;
+    // Optimization and codegen
+    ThreadPool workers;
+    int nthreads = -1;     // -1: choose at init
+  }
 
 
-  std::unique_ptr< llvm::Module >      Mod;
-  std::unique_ptr< llvm::Module >      module_libdevice;
-  std::unique_ptr< llvm::IRBuilder<> > builder;
+  namespace jit_async {
+    // Kernel whose PTX is generated in the background. Its address
+    // is handed out as CUfunction and resolved at first launch. The
+    // entries are kept, so the address can't be reused by the driver.
+    struct Pending {
+      std::future< std::string > ptx;
+      std::string fname;
+      std::string db_id;
+      PtxIrHash   ir_hash;
+      CUfunction  func;
+      std::shared_ptr< JitKernelStats > stats;
+    };
 
+    std::unordered_map< CUfunction , std::unique_ptr< Pending > > pending;
+  }
 
 
-  std::map<CUfunction,std::string> mapCUFuncPTX;
+  namespace jit_manifest {
+    // Kernel IDs (see get_ptx_db_id) used by this job, recorded on the primary node
+    std::string fname;
+    std::set< std::string > ids;
+    std::ofstream out;
 
-  std::string getPTXfromCUFunc(CUfunction f) {
-    return mapCUFuncPTX[f];
+    // Kernels from the manifest, loaded from the PTX DB ahead of time
+    struct Loaded {
+      CUfunction  func;
+      std::string ptx;
+    };
+    std::map< std::string , std::future< Loaded > > warm;
+    std::string loaded_prefix;   // device and subgrid of the kernels in warm
+  }
+
+
+  namespace jit_bcast {
+    bool enabled = false;        // primary node compiles, PTX broadcast to the others
+    std::string prefix;          // device/subgrid part of this node's kernel IDs
+    std::string primary_prefix;  // same on the primary node
+    bool same = true;            // both agree, kernels built on the primary are usable here
+    bool local_only = false;     // primary got the kernel from the DB, build it locally without communication
   }
 
-  bool function_created;
 
-  std::vector< llvm::Type* > vecParamType;
-  std::vector< llvm::Value* > vecArgument;
+  namespace jit_kernel_stats {
+    // Every kernel built, in build order
+    std::vector< std::shared_ptr< JitKernelStats > > all;
+    bool print = false;
+    std::string json;
+  }
+
+
+  std::map<CUfunction,std::string> mapCUFuncPTX;
+
+  // PTX DB id of each loaded kernel (see get_ptx_db_id)
+  std::unordered_map<CUfunction,std::string> mapCUFuncId;
+
+  std::string llvm_get_kernel_id( CUfunction f )
+  {
+    auto it = mapCUFuncId.find( llvm_resolve_cufunction(f) );
+    return it == mapCUFuncId.end() ? std::string() : it->second;
+  }
+
+  std::string getPTXfromCUFunc(CUfunction f) {
+    return mapCUFuncPTX[ llvm_resolve_cufunction(f) ];
+  }
 
   llvm::Value *r_arg_lo;
   llvm::Value *r_arg_hi;
@@ -56,18 +120,14 @@ namespace QDP {
   llvm::Value *r_arg_ordered;
   llvm::Value *r_arg_start;
 
-  llvm::Type* llvm_type<float>::value;
-  llvm::Type* llvm_type<double>::value;
-  llvm::Type* llvm_type<int>::value;
-  llvm::Type* llvm_type<bool>::value;
-  llvm::Type* llvm_type<float*>::value;
-  llvm::Type* llvm_type<double*>::value;
-  llvm::Type* llvm_type<int*>::value;
-  llvm::Type* llvm_type<bool*>::value;
-
-  namespace llvm_counters {
-    int label_counter;
-  }
+  thread_local llvm::Type* llvm_type<float>::value;
+  thread_local llvm::Type* llvm_type<double>::value;
+  thread_local llvm::Type* llvm_type<int>::value;
+  thread_local llvm::Type* llvm_type<bool>::value;
+  thread_local llvm::Type* llvm_type<float*>::value;
+  thread_local llvm::Type* llvm_type<double*>::value;
+  thread_local llvm::Type* llvm_type<int*>::value;
+  thread_local llvm::Type* llvm_type<bool*>::value;
 
   namespace llvm_debug {
     bool debug_func_build      = false;
@@ -91,8 +151,7 @@ namespace QDP {
   namespace ptx_db {
     bool db_enabled = false;
     std::string dbname = "dummy.dat";
-    typedef std::map< std::string , std::string > DBType;
-    DBType db;
+    PtxDB db;
   }
 
 
@@ -121,6 +180,33 @@ namespace QDP {
   }
 
 
+  void jit_manifest_load( const std::string& prefix );
+
+
+  // Compare this node's device and subgrid with the primary node's.
+  // Collective, redone when the layout changes.
+  bool jit_same_as_primary()
+  {
+    std::string prefix = get_ptx_db_id( "" );
+    if ( prefix == jit_bcast::prefix )
+      return jit_bcast::same;
+
+    jit_bcast::prefix = prefix;
+    jit_bcast::primary_prefix = prefix;
+    QDPInternal::broadcast_str( jit_bcast::primary_prefix );
+    jit_bcast::same = ( prefix == jit_bcast::primary_prefix );
+
+    int differ = jit_bcast::same ? 0 : 1;
+    QDPInternal::globalSum( differ );
+    if (differ > 0)
+      QDPIO::cout << "JIT: " << differ << " nodes differ in device or subgrid from the primary node, these compile their kernels locally\n";
+
+    jit_manifest_load( jit_bcast::primary_prefix );
+
+    return jit_bcast::same;
+  }
+
+
   CUfunction get_fptr_from_ptx( const char* fname , const std::string& kernel )
   {
     CUfunction func;
@@ -156,20 +242,277 @@ namespace QDP {
 
 
 
-  CUfunction llvm_ptx_db( const char * pretty )
+  double jit_us_since( const std::chrono::steady_clock::time_point& start )
   {
-    std::string id = get_ptx_db_id( pretty );
-    
-    ptx_db::DBType::iterator it = ptx_db::db.find( id );
+    return std::chrono::duration< double , std::micro >( std::chrono::steady_clock::now() - start ).count();
+  }
 
-    if ( it != ptx_db::db.end() )
-      {
-	return get_fptr_from_ptx( "generic.ptx" , it->second );
+
+  long llvm_count_instructions( const llvm::Module& M )
+  {
+    long n = 0;
+    for ( const llvm::Function& F : M )
+      for ( const llvm::BasicBlock& BB : F )
+	n += BB.size();
+    return n;
+  }
+
+
+  void llvm_set_kernel_stats( bool print ) {
+    jit_kernel_stats::print = print;
+  }
+
+  void llvm_set_kernel_stats_json( const char * c_str ) {
+    jit_kernel_stats::json = std::string( c_str );
+  }
+
+
+  namespace {
+    std::string json_escape( const std::string& str )
+    {
+      std::ostringstream oss;
+      for ( char ch : str ) {
+	switch (ch) {
+	case '"':  oss << "\\\""; break;
+	case '\\': oss << "\\\\"; break;
+	case '\n': oss << "\\n"; break;
+	case '\t': oss << "\\t"; break;
+	default:
+	  if ((unsigned char)ch < 0x20)
+	    oss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)(unsigned char)ch << std::dec << std::setfill(' ');
+	  else
+	    oss << ch;
+	}
       }
-    else
-      {
-	return NULL;
+      return oss.str();
+    }
+  }
+
+
+  // Sorted by total build time, slowest first
+  void llvm_kernel_stats_report()
+  {
+    if ( !jit_kernel_stats::print && jit_kernel_stats::json.empty() )
+      return;
+
+    std::vector< JitKernelStats* > v;
+    for ( auto& k : jit_kernel_stats::all )
+      if ( !k->pretty.empty() )
+	v.push_back( k.get() );
+
+    std::stable_sort( v.begin() , v.end() , []( const JitKernelStats* a , const JitKernelStats* b ) { return a->total() > b->total(); } );
+
+    if ( jit_kernel_stats::print ) {
+      JitKernelStats sum;
+      std::ostringstream oss;
+
+      oss << "\nJIT kernel builds: " << v.size() << ", times in us, slowest first\n";
+      oss << std::setw(10) << "total" << std::setw(10) << "build" << std::setw(10) << "libdev"
+	  << std::setw(10) << "opt" << std::setw(10) << "codegen" << std::setw(10) << "load"
+	  << std::setw(10) << "inst" << std::setw(10) << "inst opt" << std::setw(10) << "ptx"
+	  << "  kernel\n";
+
+      for ( const JitKernelStats* k : v ) {
+	oss << std::fixed << std::setprecision(0)
+	    << std::setw(10) << k->total() << std::setw(10) << k->build << std::setw(10) << k->libdevice
+	    << std::setw(10) << k->optimize << std::setw(10) << k->codegen << std::setw(10) << k->load
+	    << std::setw(10) << k->inst_before << std::setw(10) << k->inst_after << std::setw(10) << k->ptx_size
+	    << "  " << ( k->from_db ? "(db) " : "" ) << ( k->host ? "(host) " : "" ) << k->pretty.substr( 0 , 160 ) << "\n";
+
+	sum.build     += k->build;
+	sum.libdevice += k->libdevice;
+	sum.optimize  += k->optimize;
+	sum.codegen   += k->codegen;
+	sum.load      += k->load;
+      }
+
+      oss << std::setw(10) << sum.total() << std::setw(10) << sum.build << std::setw(10) << sum.libdevice
+	  << std::setw(10) << sum.optimize << std::setw(10) << sum.codegen << std::setw(10) << sum.load
+	  << "  (sum)\n";
+
+      QDPIO::cout << oss.str();
+    }
+
+    if ( !jit_kernel_stats::json.empty() && Layout::primaryNode() ) {
+      std::ofstream out( jit_kernel_stats::json );
+      if (!out)
+	QDP_error_exit("Can't open %s for writing", jit_kernel_stats::json.c_str());
+
+      out << "[\n";
+      for ( size_t i = 0 ; i < v.size() ; ++i ) {
+	const JitKernelStats* k = v[i];
+	out << "  { \"kernel\": \"" << json_escape( k->pretty ) << "\""
+	    << ", \"from_db\": " << ( k->from_db ? "true" : "false" )
+	    << ", \"host\": " << ( k->host ? "true" : "false" )
+	    << ", \"total_us\": " << k->total()
+	    << ", \"build_us\": " << k->build
+	    << ", \"libdevice_us\": " << k->libdevice
+	    << ", \"optimize_us\": " << k->optimize
+	    << ", \"codegen_us\": " << k->codegen
+	    << ", \"load_us\": " << k->load
+	    << ", \"inst_before\": " << k->inst_before
+	    << ", \"inst_after\": " << k->inst_after
+	    << ", \"ptx_bytes\": " << k->ptx_size
+	    << " }" << ( i + 1 < v.size() ? "," : "" ) << "\n";
       }
+      out << "]\n";
+
+      QDPIO::cout << "JIT kernel build profile written to " << jit_kernel_stats::json << "\n";
+    }
+  }
+
+
+  void llvm_set_manifest( const char * c_str ) {
+    jit_manifest::fname = std::string( c_str );
+  }
+
+
+  void jit_manifest_record( const std::string& id )
+  {
+    if ( !jit_manifest::out.is_open() )
+      return;
+
+    if ( jit_manifest::ids.insert( id ).second )
+      jit_manifest::out << id << std::endl;
+  }
+
+
+  // Read the manifest. The kernels are loaded once the layout is known,
+  // see jit_manifest_load.
+  void jit_manifest_warmup()
+  {
+    if ( jit_manifest::fname.empty() )
+      return;
+
+    if (Layout::primaryNode()) {
+      std::ifstream in( jit_manifest::fname );
+      std::string id;
+      while (std::getline( in , id ))
+	if (!id.empty())
+	  jit_manifest::ids.insert( id );
+
+      jit_manifest::out.open( jit_manifest::fname , std::ios::app );
+      if (!jit_manifest::out)
+	QDP_error_exit("Can't open kernel manifest %s for writing", jit_manifest::fname.c_str());
+    }
+
+    QDPIO::cout << "Kernel manifest " << jit_manifest::fname << ": " << jit_manifest::ids.size() << " kernels\n";
+
+    if (!ptx_db::db_enabled)
+      QDPIO::cout << "Kernel manifest: no warm-up without PTX DB (-ptxdb)\n";
+  }
+
+
+  // Load the manifest's kernels with the primary node's device and subgrid
+  // prefix found in the PTX DB on the LLVM worker threads. The kernels are
+  // picked up by llvm_ptx_db(). Collective, once per prefix.
+  void jit_manifest_load( const std::string& prefix )
+  {
+    if ( jit_manifest::fname.empty() || !ptx_db::db_enabled || prefix == jit_manifest::loaded_prefix )
+      return;
+
+    jit_manifest::loaded_prefix = prefix;
+
+    std::vector< std::string > ids;
+    std::vector< std::string > ptxs;
+    int missing = 0;
+
+    if (Layout::primaryNode()) {
+      for ( const std::string& id : jit_manifest::ids ) {
+	if (id.compare( 0 , prefix.size() , prefix ) != 0)
+	  continue;
+	std::string ptx;
+	if (ptx_db::db.find( id , ptx )) {
+	  ids.push_back( id );
+	  ptxs.push_back( ptx );
+	} else {
+	  ++missing;
+	}
+      }
+    }
+
+    int n = ids.size();
+    QDPInternal::broadcast( n );
+    ids.resize( n );
+    ptxs.resize( n );
+
+    for ( int i = 0 ; i < n ; ++i ) {
+      QDPInternal::broadcast_str( ids[i] );
+      QDPInternal::broadcast_str( ptxs[i] );
+
+      std::string ptx = std::move( ptxs[i] );
+
+      jit_manifest::warm[ ids[i] ] = jit_pool::workers.submit( [ptx]() {
+	  jit_manifest::Loaded l;
+	  l.ptx = ptx;
+	  l.func = NULL;
+
+	  CudaSetCurrentContext();
+
+	  CUmodule cuModule;
+	  if (cuModuleLoadData( &cuModule , (const void *)ptx.c_str() ) == CUDA_SUCCESS)
+	    if (cuModuleGetFunction( &l.func , cuModule , "main" ) != CUDA_SUCCESS)
+	      l.func = NULL;
+	  return l;
+	} );
+    }
+
+    QDPIO::cout << "Kernel manifest: loading " << n << " kernels from PTX DB, " << missing << " not in DB\n";
+  }
+
+
+
+  CUfunction llvm_ptx_db( const char * pretty )
+  {
+    // All nodes take the same branches as the primary node, those
+    // with a different subgrid drop the result and build locally.
+    bool same = jit_same_as_primary();
+
+    std::string id = jit_bcast::primary_prefix + pretty;
+
+    jit_manifest_record( id );
+
+    // The same ids are warm on all nodes. A kernel is used only if it
+    // loaded everywhere, otherwise all nodes go on to the DB below.
+    auto w = jit_manifest::warm.find( id );
+    if ( w != jit_manifest::warm.end() ) {
+      jit_manifest::Loaded l = w->second.get();
+      jit_manifest::warm.erase( w );
+
+      int failed = l.func ? 0 : 1;
+      QDPInternal::globalSum( failed );
+
+      if (failed == 0) {
+	if (!same) {
+	  jit_bcast::local_only = true;
+	  return NULL;
+	}
+	mapCUFuncPTX[ l.func ] = l.ptx;
+	mapCUFuncId[ l.func ] = id;
+	return l.func;
+      }
+    }
+
+    // The DB lives on the primary node
+    std::string ptx;
+    bool found = false;
+    if (Layout::primaryNode())
+      found = ptx_db::db.find( id , ptx );
+
+    QDPInternal::broadcast( found );
+    if (!found)
+      return NULL;
+
+    QDPInternal::broadcast_str( ptx );
+
+    if (!same) {
+      jit_bcast::local_only = true;
+      return NULL;
+    }
+
+    CUfunction func = get_fptr_from_ptx( "generic.ptx" , ptx );
+    mapCUFuncId[ func ] = id;
+    return func;
   }
 
 
@@ -251,171 +594,217 @@ namespace QDP {
     QDP_error_exit("unknown debug argument: %s",c_str);
   }
 
-  llvm::Function *func_sin_f32;
-  llvm::Function *func_acos_f32;
-  llvm::Function *func_asin_f32;
-  llvm::Function *func_atan_f32;
-  llvm::Function *func_ceil_f32;
-  llvm::Function *func_floor_f32;
-  llvm::Function *func_cos_f32;
-  llvm::Function *func_cosh_f32;
-  llvm::Function *func_exp_f32;
-  llvm::Function *func_log_f32;
-  llvm::Function *func_log10_f32;
-  llvm::Function *func_sinh_f32;
-  llvm::Function *func_tan_f32;
-  llvm::Function *func_tanh_f32;
-  llvm::Function *func_fabs_f32;
-  llvm::Function *func_sqrt_f32;
-  llvm::Function *func_isfinite_f32;
-
-  //Imported PTX Binary operations single precision
-  llvm::Function *func_pow_f32;
-  llvm::Function *func_atan2_f32;
-
-  //Imported PTX Unary operations double precision
-  llvm::Function *func_sin_f64;
-  llvm::Function *func_acos_f64;
-  llvm::Function *func_asin_f64;
-  llvm::Function *func_atan_f64;
-  llvm::Function *func_ceil_f64;
-  llvm::Function *func_floor_f64;
-  llvm::Function *func_cos_f64;
-  llvm::Function *func_cosh_f64;
-  llvm::Function *func_exp_f64;
-  llvm::Function *func_log_f64;
-  llvm::Function *func_log10_f64;
-  llvm::Function *func_sinh_f64;
-  llvm::Function *func_tan_f64;
-  llvm::Function *func_tanh_f64;
-  llvm::Function *func_fabs_f64;
-  llvm::Function *func_sqrt_f64;
-  llvm::Function *func_isfinite_f64;
-  
-  //Imported PTX Binary operations double precision
-  llvm::Function *func_pow_f64;
-  llvm::Function *func_atan2_f64;
+  JitCompilation::JitCompilation():
+    mainFunc(NULL), function_created(false), label_counter(0), host(false), param_ids_next(0),
+    func_seed2float(NULL), func_seedMultiply(NULL)
+  {}
 
 
-  llvm::Function *llvm_get_func( const char * name )
+  void jit_compilation_release( JitCompilation* c );
+
+
+  JitCompilation& jit_current()
   {
-    llvm::Function *func = Mod->getFunction(name);
-    if (!func)
-      QDP_error_exit("Function %s not found.\n",name);
-    return func;
+    assert( jit_pool::current && "no JIT compilation on this thread" );
+    return *jit_pool::current;
   }
 
 
-  void llvm_init_libdevice()
+  void jit_release_current()
   {
-    std::string ErrorMessage;
+    if (jit_pool::current)
+      jit_compilation_release( jit_pool::current );
+  }
+
+
+  void llvm_set_threads( int n ) {
+    jit_pool::nthreads = n;
+  }
+
+
+  void llvm_set_bcast( bool b ) {
+    jit_bcast::enabled = b;
+  }
+
+
+  // Function bodies are only parsed from the embedded bitcode when
+  // a kernel first references them (lazy bitcode module).
+  void llvm_init_libdevice( JitCompilation& c )
+  {
+    if (c.libdevice)
+      return;
 
     llvm::StringRef libdevice_bc( (const char *) QDP::LIBDEVICE::libdevice_bc, 
 				  (size_t) QDP::LIBDEVICE::libdevice_bc_len );
 
+    // The embedded bitcode lives for the whole process. No copy needed.
+    std::unique_ptr<llvm::MemoryBuffer> buffer = llvm::MemoryBuffer::getMemBuffer( libdevice_bc , "libdevice" , false );
+
+    llvm::Expected<std::unique_ptr<llvm::Module> > ModuleOrErr = llvm::getOwningLazyBitcodeModule( std::move(buffer) , c.context );
+
+    if (llvm::Error Err = ModuleOrErr.takeError()) {
+      llvm::errs() << "libdevice bitcode didn't read correctly: " << llvm::toString(std::move(Err)) << "\n";
+      QDP_abort( 1 );
+    }
+
+    c.libdevice = std::move( ModuleOrErr.get() );
+  }
+
+
+  JitCompilation* jit_compilation_acquire()
+  {
+    std::unique_ptr< JitCompilation > c;
     {
-      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer> > BufferOrErr =
-	llvm::MemoryBuffer::getMemBufferCopy(libdevice_bc );
-      
-      if (std::error_code ec = BufferOrErr.getError())
-	ErrorMessage = ec.message();
-      else {
-	std::unique_ptr<llvm::MemoryBuffer> &BufferPtr = BufferOrErr.get();
-	
-	llvm::Expected<std::unique_ptr<llvm::Module> > ModuleOrErr = llvm::parseBitcodeFile(BufferPtr.get()->getMemBufferRef(), TheContext);
-	
-	if (llvm::Error Err = ModuleOrErr.takeError()) {
-	  ErrorMessage = llvm::toString(std::move(Err));
-	}
-	else
-	  {
-	    module_libdevice.reset( ModuleOrErr.get().release() );
-	  }
+      std::lock_guard< std::mutex > lock( jit_pool::mutex );
+      if (!jit_pool::free.empty()) {
+	c = std::move( jit_pool::free.back() );
+	jit_pool::free.pop_back();
       }
     }
 
-    if (!module_libdevice) {
-      if (ErrorMessage.size())
-	llvm::errs() << ErrorMessage << "\n";
-      else
-	llvm::errs() << "libdevice bitcode didn't read correctly.\n";
-      QDP_abort( 1 );
+    if (!c) {
+      c.reset( new JitCompilation );
+      llvm_init_libdevice( *c );
     }
+
+    return c.release();
   }
 
 
-  void llvm_setup_math_functions() 
+  // Drops the kernel, the context and libdevice are kept for the next one
+  void jit_compilation_release( JitCompilation* c )
+  {
+    if (c == jit_pool::current)
+      jit_pool::current = NULL;
+
+    c->builder.reset();
+    c->Mod.reset();
+    c->mainFunc = NULL;
+    c->vecParamType.clear();
+    c->vecArgument.clear();
+    c->function_created = false;
+    c->label_counter = 0;
+    c->host = false;
+    c->param_ids.clear();
+    c->param_ids_next = 0;
+    c->param_by_id.clear();
+    c->stats.reset();
+    c->func_seed2float = NULL;
+    c->func_seedMultiply = NULL;
+
+    std::lock_guard< std::mutex > lock( jit_pool::mutex );
+    jit_pool::free.emplace_back( c );
+  }
+
+
+  // Returns the declaration of the libdevice function 'name' in the current module.
+  // The body gets linked in by llvm_link_libdevice() when the kernel is finalized.
+  llvm::Function *llvm_get_func( const char * name )
   {
-    //QDPIO::cout << "Setup math functions..\n";
+    if (llvm::Function *func = jit_current().Mod->getFunction(name))
+      return func;
+
+    llvm::Function *func_libdevice = jit_current().libdevice->getFunction(name);
+    if (!func_libdevice)
+      QDP_error_exit("Function %s not found.\n",name);
+
+    llvm::Function *func = llvm::Function::Create( func_libdevice->getFunctionType() , llvm::Function::ExternalLinkage , name , jit_current().Mod.get() );
+    func->copyAttributesFrom( func_libdevice );
+    return func;
+  }
 
-    // Cloning a module takes more time than creating the module from scratch
-    // So, I am creating the libdevice module from the embedded bitcode.
-    //
-#if 0
-    std::unique_ptr<llvm::Module> libdevice_clone( CloneModule( module_libdevice.get() ) );
 
-    std::string ErrorMsg;
-    if (llvm::Linker::linkModules( *Mod , std::move( libdevice_clone ) )) {  // llvm::Linker::PreserveSource
-      QDP_error_exit("Linking libdevice failed: %s",ErrorMsg.c_str());
+  void llvm_libdevice_collect( llvm::Value* val , std::vector< llvm::GlobalValue* >& vec , std::set< llvm::Value* >& visited )
+  {
+    if (!visited.insert( val ).second)
+      return;
+
+    if (llvm::GlobalValue* gv = llvm::dyn_cast<llvm::GlobalValue>( val )) {
+      vec.push_back( gv );
+      return;
     }
-#else
-    llvm_init_libdevice();
 
-    std::string ErrorMsg;
-    if (llvm::Linker::linkModules( *Mod , std::move( module_libdevice ) )) {  // llvm::Linker::PreserveSource
-      QDP_error_exit("Linking libdevice failed: %s",ErrorMsg.c_str());
+    if (llvm::Constant* c = llvm::dyn_cast<llvm::Constant>( val ))
+      for ( llvm::Value* op : c->operands() )
+	llvm_libdevice_collect( op , vec , visited );
+  }
+
+
+  const std::vector< llvm::GlobalValue* >& llvm_libdevice_deps( llvm::Function* func )
+  {
+    std::map< const llvm::Function* , std::vector< llvm::GlobalValue* > >& deps = jit_current().libdevice_deps;
+
+    auto it = deps.find( func );
+    if (it != deps.end())
+      return it->second;
+
+    if (func->isMaterializable())
+      if (llvm::Error Err = func->materialize())
+	QDP_error_exit("libdevice: materializing %s failed: %s", func->getName().str().c_str() , llvm::toString(std::move(Err)).c_str() );
+
+    std::vector< llvm::GlobalValue* >& vec = deps[ func ];
+    std::set< llvm::Value* > visited;
+
+    for ( llvm::BasicBlock& BB : *func )
+      for ( llvm::Instruction& I : BB )
+	for ( llvm::Value* op : I.operands() )
+	  llvm_libdevice_collect( op , vec , visited );
+
+    return vec;
+  }
+
+
+  // Link the libdevice functions the current module calls (and their
+  // transitive callees) into the module. Nothing else is cloned.
+  void llvm_link_libdevice()
+  {
+    JitCompilation& c = jit_current();
+
+    std::vector< llvm::GlobalValue* > worklist;
+
+    for ( llvm::Function& F : *c.Mod )
+      if ( F.isDeclaration() && F.getName().startswith("__nv_") )
+	if ( llvm::GlobalValue* gv = c.libdevice->getNamedValue( F.getName() ) )
+	  worklist.push_back( gv );
+
+    if (worklist.empty())
+      return;
+
+    std::set< const llvm::GlobalValue* > needed;
+
+    while (!worklist.empty()) {
+      llvm::GlobalValue* gv = worklist.back();
+      worklist.pop_back();
+
+      if (!needed.insert( gv ).second)
+	continue;
+
+      if (llvm::Function* func = llvm::dyn_cast<llvm::Function>( gv )) {
+	if (func->isDeclaration() && !func->isMaterializable())
+	  continue;
+	const std::vector< llvm::GlobalValue* >& deps = llvm_libdevice_deps( func );
+	worklist.insert( worklist.end() , deps.begin() , deps.end() );
+      } else if (llvm::GlobalVariable* var = llvm::dyn_cast<llvm::GlobalVariable>( gv )) {
+	if (var->hasInitializer()) {
+	  std::vector< llvm::GlobalValue* > deps;
+	  std::set< llvm::Value* > visited;
+	  llvm_libdevice_collect( var->getInitializer() , deps , visited );
+	  worklist.insert( worklist.end() , deps.begin() , deps.end() );
+	}
+      }
+    }
+
+    llvm::ValueToValueMapTy VMap;
+    std::unique_ptr<llvm::Module> module_subset = llvm::CloneModule( *c.libdevice , VMap , 
+								     [&needed](const llvm::GlobalValue* gv) { return needed.count(gv) > 0; } );
+
+    if (llvm::Linker::linkModules( *c.Mod , std::move( module_subset ) , llvm::Linker::LinkOnlyNeeded )) {
+      QDP_error_exit("Linking libdevice failed");
     }
-#endif    
-
-    func_sin_f32 = llvm_get_func( "__nv_sinf" );
-    func_acos_f32 = llvm_get_func( "__nv_acosf" );
-    func_asin_f32 = llvm_get_func( "__nv_asinf" );
-    func_atan_f32 = llvm_get_func( "__nv_atanf" );
-    func_ceil_f32 = llvm_get_func( "__nv_ceilf" );
-    func_floor_f32 = llvm_get_func( "__nv_floorf" );
-    func_cos_f32 = llvm_get_func( "__nv_cosf" );
-    func_cosh_f32 = llvm_get_func( "__nv_coshf" );
-    func_exp_f32 = llvm_get_func( "__nv_expf" );
-    func_log_f32 = llvm_get_func( "__nv_logf" );
-    func_log10_f32 = llvm_get_func( "__nv_log10f" );
-    func_sinh_f32 = llvm_get_func( "__nv_sinhf" );
-    func_tan_f32 = llvm_get_func( "__nv_tanf" );
-    func_tanh_f32 = llvm_get_func( "__nv_tanhf" );
-    func_fabs_f32 = llvm_get_func( "__nv_fabsf" );
-    func_sqrt_f32 = llvm_get_func( "__nv_fsqrt_rn" );
-    func_isfinite_f32 = llvm_get_func( "__nv_finitef" );
-
-
-    func_pow_f32 = llvm_get_func( "__nv_powf" );
-    func_atan2_f32 = llvm_get_func( "__nv_atan2f" );
-
-
-    func_sin_f64 = llvm_get_func( "__nv_sin" );
-    func_acos_f64 = llvm_get_func( "__nv_acos" );
-    func_asin_f64 = llvm_get_func( "__nv_asin" );
-    func_atan_f64 = llvm_get_func( "__nv_atan" );
-    func_ceil_f64 = llvm_get_func( "__nv_ceil" );
-    func_floor_f64 = llvm_get_func( "__nv_floor" );
-    func_cos_f64 = llvm_get_func( "__nv_cos" );
-    func_cosh_f64 = llvm_get_func( "__nv_cosh" );
-    func_exp_f64 = llvm_get_func( "__nv_exp" );
-    func_log_f64 = llvm_get_func( "__nv_log" );
-    func_log10_f64 = llvm_get_func( "__nv_log10" );
-    func_sinh_f64 = llvm_get_func( "__nv_sinh" );
-    func_tan_f64 = llvm_get_func( "__nv_tan" );
-    func_tanh_f64 = llvm_get_func( "__nv_tanh" );
-    func_fabs_f64 = llvm_get_func( "__nv_fabs" );
-    func_sqrt_f64 = llvm_get_func( "__nv_dsqrt_rn" );
-    func_isfinite_f64 = llvm_get_func( "__nv_isfinited" );
-    
-    func_pow_f64 = llvm_get_func( "__nv_pow" );
-    func_atan2_f64 = llvm_get_func( "__nv_atan2" );
   }
 
 
   void llvm_wrapper_init() {
-    function_created = false;
-
     llvm::InitializeAllTargets();
     llvm::InitializeAllTargetMCs();
     llvm::InitializeAllAsmPrinters();
@@ -430,70 +819,33 @@ namespace QDP {
     llvm::initializeUnreachableBlockElimLegacyPassPass(*Registry);
     llvm::initializeConstantHoistingLegacyPassPass(*Registry);
 
-    llvm_type<float>::value  = llvm::Type::getFloatTy(TheContext);
-    llvm_type<double>::value = llvm::Type::getDoubleTy(TheContext);
-    llvm_type<int>::value    = llvm::Type::getIntNTy(TheContext,32);
-    llvm_type<bool>::value   = llvm::Type::getIntNTy(TheContext,1);
-    llvm_type<float*>::value  = llvm::Type::getFloatPtrTy(TheContext);
-    llvm_type<double*>::value = llvm::Type::getDoublePtrTy(TheContext);
-    llvm_type<int*>::value    = llvm::Type::getIntNPtrTy(TheContext,32);
-    llvm_type<bool*>::value   = llvm::Type::getIntNPtrTy(TheContext,1);
+    if (jit_pool::nthreads < 0)
+      jit_pool::nthreads = std::max( 1u , std::min( 4u , std::thread::hardware_concurrency() ) );
+
+    jit_pool::workers.start( jit_pool::nthreads );
 
     QDPIO::cout << "LLVM optimization level : " << llvm_opt::opt_level << "\n";
     QDPIO::cout << "NVPTX Flush to zero     : " << llvm_opt::nvptx_FTZ << "\n";
+    QDPIO::cout << "LLVM codegen threads    : " << jit_pool::nthreads << "\n";
 
-    if (ptx_db::db_enabled) {
-      // Load DB
-      QDPIO::cout << "Checking for PTX DB " << ptx_db::dbname << "\n";
-      std::ifstream f(ptx_db::dbname);
-      if (f.good()) 
-	{
-	  QDPIO::cout << "Reading in PTX DB " << ptx_db::dbname << "\n";
-	  BinaryFileReader db( ptx_db::dbname );
-
-	  while ( ! db.fail() )
-	    {
-	      int size1;
-	      db.read( size1 );
-	      if (db.fail())
-		break;
-	      char* buf1 = new char[size1];
-	      db.readArray( buf1 , 1 , size1 );
-	      if (db.fail())
-		break;
-
-	      int size2;
-	      db.read( size2 );
-	      if (db.fail())
-		break;
-	      char* buf2 = new char[size2];
-	      db.readArray( buf2 , 1 , size2 );
-	      if (db.fail())
-		break;
-
-	      QDPIO::cout << "ptx_db: read key_size=" << size1 << " ptx_size=" << size2 << "\n";
-
-	      std::string key(buf1,size1);
-	      std::string val(buf2,size2);
-	      ptx_db::db.insert( std::make_pair( key , val ) );
-
-	      delete[] buf1;
-	      delete[] buf2;
-	    }
-	  db.close();
-	}
+    // Host kernels don't use PTX
+    if (jit_host_mode())
+      return;
 
+    if (ptx_db::db_enabled) {
+      // Open DB, only the index is read in
+      if (Layout::primaryNode()) {
+	ptx_db::db.open( ptx_db::dbname );
+	QDPIO::cout << "Opened PTX DB " << ptx_db::dbname << " with " << ptx_db::db.size() << " kernels\n";
+      }
     } // ptx db
 
-    //
-    // I initialize libdevice in math_setup
-    //
-    // llvm_init_libdevice();
+    jit_manifest_warmup();
   }  
 
 
   llvm::BasicBlock * llvm_get_insert_block() {
-    return builder->GetInsertBlock();
+    return jit_current().builder->GetInsertBlock();
   }
 
 
@@ -504,61 +856,86 @@ namespace QDP {
     
     //QDPIO::cout << "Starting new LLVM function..\n";
 
+    // A kernel that was started but never finished
+    if (jit_pool::current)
+      jit_compilation_release( jit_pool::current );
+
+    jit_pool::current = jit_compilation_acquire();
+
+    JitCompilation& c = *jit_pool::current;
+
+    c.host = jit_host_mode();
+
+    c.stats = std::make_shared< JitKernelStats >();
+    c.stats->start = std::chrono::steady_clock::now();
+    jit_kernel_stats::all.push_back( c.stats );
+
 #if 0
     // C++14 version
-    Mod = std::make_unique< llvm::Module >( "module", TheContext);
-    builder = std::make_unique< llvm::IRBuilder<> >( TheContext );
+    c.Mod = std::make_unique< llvm::Module >( "module", c.context);
+    c.builder = std::make_unique< llvm::IRBuilder<> >( c.context );
 #else
-    Mod.reset( new llvm::Module( "module", TheContext) );
-    builder.reset( new llvm::IRBuilder<>( TheContext ) );
+    c.Mod.reset( new llvm::Module( "module", c.context) );
+    c.builder.reset( new llvm::IRBuilder<>( c.context ) );
 #endif
 
+    llvm_type<float>::value  = llvm::Type::getFloatTy(c.context);
+    llvm_type<double>::value = llvm::Type::getDoubleTy(c.context);
+    llvm_type<int>::value    = llvm::Type::getIntNTy(c.context,32);
+    llvm_type<bool>::value   = llvm::Type::getIntNTy(c.context,1);
+    llvm_type<float*>::value  = llvm::Type::getFloatPtrTy(c.context);
+    llvm_type<double*>::value = llvm::Type::getDoublePtrTy(c.context);
+    llvm_type<int*>::value    = llvm::Type::getIntNPtrTy(c.context,32);
+    llvm_type<bool*>::value   = llvm::Type::getIntNPtrTy(c.context,1);
 
     jit_build_seedToFloat();
     jit_build_seedMultiply();
+  }
 
-    vecParamType.clear();
-    vecArgument.clear();
-    function_created = false;
-
-    llvm_setup_math_functions();
 
-    // llvm::outs() << "------------------------- linked module\n";
-    // llvm_print_module(Mod,"ir_linked.ll");
-    //Mod->dump();
+  void llvm_start_new_host_function() {
+    llvm_start_new_function();
+    jit_current().host = true;
   }
 
 
   void llvm_create_function() {
-    assert( !function_created );
-    assert( vecParamType.size() > 0 );
+    JitCompilation& c = jit_current();
+
+    assert( !c.function_created );
+    assert( c.vecParamType.size() > 0 );
+
+    // On the host the site index is passed in by the site loop
+    std::vector< llvm::Type* > types( c.vecParamType );
+    if (c.host)
+      types.push_back( llvm::Type::getInt32Ty(c.context) );
 
     llvm::FunctionType *funcType = 
-      llvm::FunctionType::get( builder->getVoidTy() , 
-			       llvm::ArrayRef<llvm::Type*>( vecParamType.data() , vecParamType.size() ) , 
+      llvm::FunctionType::get( c.builder->getVoidTy() , 
+			       llvm::ArrayRef<llvm::Type*>( types.data() , types.size() ) , 
 			       false); // no vararg
-    mainFunc = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, "main", Mod.get());
+    c.mainFunc = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, "main", c.Mod.get());
 
     unsigned Idx = 0;
-    for (llvm::Function::arg_iterator AI = mainFunc->arg_begin(), AE = mainFunc->arg_end() ; AI != AE ; ++AI, ++Idx) {
+    for (llvm::Function::arg_iterator AI = c.mainFunc->arg_begin(), AE = c.mainFunc->arg_end() ; AI != AE ; ++AI, ++Idx) {
       AI->setName( std::string("arg")+std::to_string(Idx) );
-      vecArgument.push_back( &*AI );
+      c.vecArgument.push_back( &*AI );
     }
 
-    llvm::BasicBlock* entry = llvm::BasicBlock::Create(TheContext, "entrypoint", mainFunc);
-    builder->SetInsertPoint(entry);
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(c.context, "entrypoint", c.mainFunc);
+    c.builder->SetInsertPoint(entry);
 
-    llvm_counters::label_counter = 0;
-    function_created = true;
+    c.label_counter = 0;
+    c.function_created = true;
   }
 
 
 
   llvm::Value * llvm_derefParam( ParamRef r ) {
-    if (!function_created)
+    if (!jit_current().function_created)
       llvm_create_function();
-    assert( vecArgument.size() > (unsigned)r && "derefParam out of range");
-    return vecArgument.at(r);
+    assert( jit_current().vecArgument.size() > (unsigned)r && "derefParam out of range");
+    return jit_current().vecArgument.at(r);
   }
 
 
@@ -579,13 +956,13 @@ namespace QDP {
 
   llvm::SwitchInst * llvm_switch( llvm::Value* val , llvm::BasicBlock* bb_default ) 
   {
-    return builder->CreateSwitch( val , bb_default );
+    return jit_current().builder->CreateSwitch( val , bb_default );
   }
 
 
   llvm::PHINode * llvm_phi( llvm::Type* type, unsigned num )
   {
-    return builder->CreatePHI( type , num );
+    return jit_current().builder->CreatePHI( type , num );
   }
 
 
@@ -594,14 +971,14 @@ namespace QDP {
     if ( t0->isFloatingPointTy() || t1->isFloatingPointTy() ) {
       //llvm::outs() << "promote floating " << t0->isFloatingPointTy() << " " << t1->isFloatingPointTy() << "\n";
       if ( t0->isDoubleTy() || t1->isDoubleTy() ) {
-	return llvm::Type::getDoubleTy(TheContext);
+	return llvm::Type::getDoubleTy(jit_current().context);
       } else {
-	return llvm::Type::getFloatTy(TheContext);
+	return llvm::Type::getFloatTy(jit_current().context);
       }
     } else {
       //llvm::outs() << "promote int " << t0->getScalarSizeInBits() << " " << t1->getScalarSizeInBits() << "\n";
       unsigned upper = std::max( t0->getScalarSizeInBits() , t1->getScalarSizeInBits() );
-      return llvm::Type::getIntNTy(TheContext , upper );
+      return llvm::Type::getIntNTy(jit_current().context , upper );
     }
   }
 
@@ -632,7 +1009,7 @@ namespace QDP {
 
     //llvm::outs() << "cast instruction: dest type = " << dest_type << "   from " << src->getType() << "\n";
     
-    llvm::Value* ret = builder->CreateCast( llvm::CastInst::getCastOpcode( src , true , dest_type , true ) , 
+    llvm::Value* ret = jit_current().builder->CreateCast( llvm::CastInst::getCastOpcode( src , true , dest_type , true ) , 
 				src , dest_type , "" );
     return ret;
   }
@@ -679,9 +1056,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFSub( vals.first , vals.second );
+      return jit_current().builder->CreateFSub( vals.first , vals.second );
     else
-      return builder->CreateSub( vals.first , vals.second );
+      return jit_current().builder->CreateSub( vals.first , vals.second );
   }
 
 
@@ -689,9 +1066,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFRem( vals.first , vals.second );
+      return jit_current().builder->CreateFRem( vals.first , vals.second );
     else
-      return builder->CreateSRem( vals.first , vals.second );
+      return jit_current().builder->CreateSRem( vals.first , vals.second );
   }
 
 
@@ -701,7 +1078,7 @@ namespace QDP {
  //   assert( !args_type->isFloatingPointTy() );
 
     assert( ! ( vals.first->getType()->isFloatingPointTy() ) );
-    return builder->CreateAShr( vals.first , vals.second );
+    return jit_current().builder->CreateAShr( vals.first , vals.second );
   }
 
 
@@ -711,7 +1088,7 @@ namespace QDP {
   //  assert( !args_type->isFloatingPointTy() );
 
     assert( ! ( vals.first->getType()->isFloatingPointTy()  ) );
-    return builder->CreateShl( vals.first , vals.second );
+    return jit_current().builder->CreateShl( vals.first , vals.second );
   }
 
 
@@ -720,7 +1097,7 @@ namespace QDP {
     // llvm::Type* args_type = vals.first->getType();
     // assert( !args_type->isFloatingPointTy() );
     assert( ! ( vals.first->getType()->isFloatingPointTy()  ) );
-    return builder->CreateAnd( vals.first , vals.second );
+    return jit_current().builder->CreateAnd( vals.first , vals.second );
   }
 
 
@@ -730,7 +1107,7 @@ namespace QDP {
    // assert( !args_type->isFloatingPointTy() );
     assert( ! ( vals.first->getType()->isFloatingPointTy()  ) );
 
-    return builder->CreateOr( vals.first , vals.second );
+    return jit_current().builder->CreateOr( vals.first , vals.second );
   }
 
 
@@ -741,16 +1118,16 @@ namespace QDP {
 
     assert( ! ( vals.first->getType()->isFloatingPointTy()  ) );
 
-    return builder->CreateXor( vals.first , vals.second );
+    return jit_current().builder->CreateXor( vals.first , vals.second );
   }
 
 
   llvm::Value* llvm_mul( llvm::Value* lhs , llvm::Value* rhs ) {
     auto vals = llvm_normalize_values(lhs,rhs);
     if ( vals.first->getType()->isFloatingPointTy() )
-      return builder->CreateFMul( vals.first , vals.second );
+      return jit_current().builder->CreateFMul( vals.first , vals.second );
     else
-      return builder->CreateMul( vals.first , vals.second );
+      return jit_current().builder->CreateMul( vals.first , vals.second );
   }
 
 
@@ -758,9 +1135,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFAdd( vals.first , vals.second );
+      return jit_current().builder->CreateFAdd( vals.first , vals.second );
     else
-      return builder->CreateNSWAdd( vals.first , vals.second );
+      return jit_current().builder->CreateNSWAdd( vals.first , vals.second );
   }
 
 
@@ -768,9 +1145,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFSub( vals.first , vals.second );
+      return jit_current().builder->CreateFSub( vals.first , vals.second );
     else
-      return builder->CreateSub( vals.first , vals.second );
+      return jit_current().builder->CreateSub( vals.first , vals.second );
   }
 
 
@@ -778,9 +1155,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFDiv( vals.first , vals.second );
+      return jit_current().builder->CreateFDiv( vals.first , vals.second );
     else 
-      return builder->CreateSDiv( vals.first , vals.second );
+      return jit_current().builder->CreateSDiv( vals.first , vals.second );
   }
 
 
@@ -788,9 +1165,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFCmpOEQ( vals.first , vals.second );
+      return jit_current().builder->CreateFCmpOEQ( vals.first , vals.second );
     else
-      return builder->CreateICmpEQ( vals.first , vals.second );
+      return jit_current().builder->CreateICmpEQ( vals.first , vals.second );
   }
 
 
@@ -798,9 +1175,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFCmpOGE( vals.first , vals.second );
+      return jit_current().builder->CreateFCmpOGE( vals.first , vals.second );
     else
-      return builder->CreateICmpSGE( vals.first , vals.second );
+      return jit_current().builder->CreateICmpSGE( vals.first , vals.second );
   }
 
 
@@ -808,9 +1185,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFCmpOGT( vals.first , vals.second );
+      return jit_current().builder->CreateFCmpOGT( vals.first , vals.second );
     else
-      return builder->CreateICmpSGT( vals.first , vals.second );
+      return jit_current().builder->CreateICmpSGT( vals.first , vals.second );
   }
 
 
@@ -818,9 +1195,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFCmpOLE( vals.first , vals.second );
+      return jit_current().builder->CreateFCmpOLE( vals.first , vals.second );
     else
-      return builder->CreateICmpSLE( vals.first , vals.second );
+      return jit_current().builder->CreateICmpSLE( vals.first , vals.second );
   }
 
 
@@ -828,9 +1205,9 @@ namespace QDP {
     auto vals = llvm_normalize_values(lhs,rhs);
     llvm::Type* args_type = vals.first->getType();
     if ( args_type->isFloatingPointTy() )
-      return builder->CreateFCmpOLT( vals.first , vals.second );
+      return jit_current().builder->CreateFCmpOLT( vals.first , vals.second );
     else 
-      return builder->CreateICmpSLT( vals.first , vals.second );
+      return jit_current().builder->CreateICmpSLT( vals.first , vals.second );
   }
 
 
@@ -858,7 +1235,7 @@ namespace QDP {
 
     //
 
-    llvm::GlobalVariable *gv = new llvm::GlobalVariable ( *Mod , 
+    llvm::GlobalVariable *gv = new llvm::GlobalVariable ( *jit_current().Mod , 
 							  llvm::ArrayType::get(ty,0) ,
 							  false , 
 							  llvm::GlobalVariable::ExternalLinkage, 
@@ -868,7 +1245,7 @@ namespace QDP {
 							  llvm::GlobalVariable::NotThreadLocal, //ThreadLocalMode=NotThreadLocal
 							  3, // unsigned AddressSpace=0, 
 							  false); //bool isExternallyInitialized=false)
-    return builder->CreatePointerCast(gv, llvm::PointerType::get(ty,3) );
+    return jit_current().builder->CreatePointerCast(gv, llvm::PointerType::get(ty,3) );
     //return builder->CreatePointerCast(gv,llvm_type<double*>::value);
     //return gv;
   }
@@ -877,61 +1254,109 @@ namespace QDP {
 
   llvm::Value * llvm_alloca( llvm::Type* type , int elements )
   {
-    return builder->CreateAlloca( type , llvm_create_value(elements) );    // This can be a llvm::Value*
+    return jit_current().builder->CreateAlloca( type , llvm_create_value(elements) );    // This can be a llvm::Value*
+  }
+
+
+  namespace {
+
+    ParamRef llvm_add_param_type( llvm::Type* type )
+    {
+      JitCompilation& c = jit_current();
+
+      // Counts past the end, llvm_param_ids_done tells
+      int id = -1;
+      if (!c.param_ids.empty()) {
+	if (c.param_ids_next < c.param_ids.size())
+	  id = c.param_ids[ c.param_ids_next ];
+	++c.param_ids_next;
+      }
+
+      if (id >= 0) {
+	auto it = c.param_by_id.find( id );
+	if (it != c.param_by_id.end()) {
+	  if (c.vecParamType[ it->second ] != type)
+	    QDP_error_exit("JIT: cache id %d used as parameters of different types", id);
+	  return it->second;
+	}
+      }
+
+      c.vecParamType.push_back( type );
+      ParamRef r = c.vecParamType.size()-1;
+
+      if (id >= 0)
+	c.param_by_id[ id ] = r;
+
+      return r;
+    }
+
+  } // namespace
+
+
+  void llvm_param_ids( const std::vector<int>& ids )
+  {
+    JitCompilation& c = jit_current();
+    c.param_ids = ids;
+    c.param_ids_next = 0;
+  }
+
+
+  bool llvm_param_ids_done()
+  {
+    JitCompilation& c = jit_current();
+    return c.param_ids_next == c.param_ids.size();
+  }
+
+
+  void llvm_set_params_noalias()
+  {
+    JitCompilation& c = jit_current();
+    assert( c.function_created );
+    for ( llvm::Argument& arg : c.mainFunc->args() )
+      if (arg.getType()->isPointerTy())
+	arg.addAttr( llvm::Attribute::NoAlias );
   }
 
 
   template<> ParamRef llvm_add_param<bool>() { 
-    vecParamType.push_back( llvm::Type::getInt1Ty(TheContext) );
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::Type::getInt1Ty(jit_current().context) );
     // llvm::Argument * u8 = new llvm::Argument( llvm::Type::getInt8Ty(TheContext) , param_next() , mainFunc );
     // return llvm_cast( llvm_type<bool>::value , u8 );
   }
   template<> ParamRef llvm_add_param<bool*>() { 
-    vecParamType.push_back( llvm::Type::getInt1PtrTy(TheContext) );
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::Type::getInt1PtrTy(jit_current().context) );
   }
   template<> ParamRef llvm_add_param<int64_t>() { 
-    vecParamType.push_back( llvm::Type::getInt64Ty(TheContext) );
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::Type::getInt64Ty(jit_current().context) );
   }
   template<> ParamRef llvm_add_param<int>() { 
-    vecParamType.push_back( llvm::Type::getInt32Ty(TheContext) );
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::Type::getInt32Ty(jit_current().context) );
   }
   template<> ParamRef llvm_add_param<int*>() { 
-    vecParamType.push_back( llvm::Type::getInt32PtrTy(TheContext) );
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::Type::getInt32PtrTy(jit_current().context) );
   }
   template<> ParamRef llvm_add_param<float>() { 
-    vecParamType.push_back( llvm::Type::getFloatTy(TheContext) );
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::Type::getFloatTy(jit_current().context) );
   }
   template<> ParamRef llvm_add_param<float*>() { 
-    vecParamType.push_back( llvm::Type::getFloatPtrTy(TheContext) );
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::Type::getFloatPtrTy(jit_current().context) );
   }
   template<> ParamRef llvm_add_param<double>() { 
-    vecParamType.push_back( llvm::Type::getDoubleTy(TheContext) );
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::Type::getDoubleTy(jit_current().context) );
   }
   template<> ParamRef llvm_add_param<double*>() { 
-    vecParamType.push_back( llvm::Type::getDoublePtrTy(TheContext) );
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::Type::getDoublePtrTy(jit_current().context) );
   }
 
 
   template<> ParamRef llvm_add_param<int**>() {
-    vecParamType.push_back( llvm::PointerType::get( llvm::Type::getInt32PtrTy(TheContext) , 0 ) );  // AddressSpace = 0 ??
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::PointerType::get( llvm::Type::getInt32PtrTy(jit_current().context) , 0 ) );
   }
   template<> ParamRef llvm_add_param<float**>() {
-    vecParamType.push_back( llvm::PointerType::get( llvm::Type::getFloatPtrTy(TheContext) , 0 ) );  // AddressSpace = 0 ??
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::PointerType::get( llvm::Type::getFloatPtrTy(jit_current().context) , 0 ) );
   }
   template<> ParamRef llvm_add_param<double**>() {
-    vecParamType.push_back( llvm::PointerType::get( llvm::Type::getDoublePtrTy(TheContext) , 0 ) );  // AddressSpace = 0 ??
-    return vecParamType.size()-1;
+    return llvm_add_param_type( llvm::PointerType::get( llvm::Type::getDoublePtrTy(jit_current().context) , 0 ) );
   }
 
 
@@ -939,9 +1364,9 @@ namespace QDP {
   llvm::BasicBlock * llvm_new_basic_block()
   {
     std::ostringstream oss;
-    oss << "L" << llvm_counters::label_counter++;
-    llvm::BasicBlock *BB = llvm::BasicBlock::Create(TheContext, oss.str() );
-    mainFunc->getBasicBlockList().push_back(BB);
+    oss << "L" << jit_current().label_counter++;
+    llvm::BasicBlock *BB = llvm::BasicBlock::Create(jit_current().context, oss.str() );
+    jit_current().mainFunc->getBasicBlockList().push_back(BB);
     return BB;
   }
 
@@ -949,30 +1374,30 @@ namespace QDP {
   void llvm_cond_branch(llvm::Value * cond, llvm::BasicBlock * thenBB, llvm::BasicBlock * elseBB)
   {
     cond = llvm_cast( llvm_type<bool>::value , cond );
-    builder->CreateCondBr( cond , thenBB, elseBB);
+    jit_current().builder->CreateCondBr( cond , thenBB, elseBB);
   }
 
 
   void llvm_branch(llvm::BasicBlock * BB)
   {
-    builder->CreateBr( BB );
+    jit_current().builder->CreateBr( BB );
   }
 
 
   void llvm_set_insert_point( llvm::BasicBlock * BB )
   {
-    builder->SetInsertPoint(BB);
+    jit_current().builder->SetInsertPoint(BB);
   }
 
   llvm::BasicBlock * llvm_get_insert_point()
   {
-    return builder->GetInsertBlock();
+    return jit_current().builder->GetInsertBlock();
   }
 
 
   void llvm_exit()
   {
-    builder->CreateRetVoid();
+    jit_current().builder->CreateRetVoid();
   }
 
 
@@ -989,32 +1414,32 @@ namespace QDP {
 
 
   llvm::ConstantInt * llvm_create_const_int(int i) {
-    return llvm::ConstantInt::getSigned( llvm::Type::getIntNTy(TheContext,32) , i );
+    return llvm::ConstantInt::getSigned( llvm::Type::getIntNTy(jit_current().context,32) , i );
   }
 
   llvm::Value * llvm_create_value( double v )
   {
     if (sizeof(REAL) == 4)
-      return llvm::ConstantFP::get( llvm::Type::getFloatTy(TheContext) , v );
+      return llvm::ConstantFP::get( llvm::Type::getFloatTy(jit_current().context) , v );
     else
-      return llvm::ConstantFP::get( llvm::Type::getDoubleTy(TheContext) , v );
+      return llvm::ConstantFP::get( llvm::Type::getDoubleTy(jit_current().context) , v );
   }
 
-  llvm::Value * llvm_create_value(int64_t v )  {return llvm::ConstantInt::get( llvm::Type::getInt64Ty(TheContext) , v );}
-  llvm::Value * llvm_create_value(int v )  {return llvm::ConstantInt::get( llvm::Type::getInt32Ty(TheContext) , v );}
-  llvm::Value * llvm_create_value(size_t v){return llvm::ConstantInt::get( llvm::Type::getInt32Ty(TheContext) , v );}
-  llvm::Value * llvm_create_value(bool v ) {return llvm::ConstantInt::get( llvm::Type::getInt1Ty(TheContext) , v );}
+  llvm::Value * llvm_create_value(int64_t v )  {return llvm::ConstantInt::get( llvm::Type::getInt64Ty(jit_current().context) , v );}
+  llvm::Value * llvm_create_value(int v )  {return llvm::ConstantInt::get( llvm::Type::getInt32Ty(jit_current().context) , v );}
+  llvm::Value * llvm_create_value(size_t v){return llvm::ConstantInt::get( llvm::Type::getInt32Ty(jit_current().context) , v );}
+  llvm::Value * llvm_create_value(bool v ) {return llvm::ConstantInt::get( llvm::Type::getInt1Ty(jit_current().context) , v );}
 
 
   llvm::Value * llvm_createGEP( llvm::Value * ptr , llvm::Value * idx )
   {
-    return builder->CreateGEP( ptr , idx );
+    return jit_current().builder->CreateGEP( ptr , idx );
   }
 
 
   llvm::Value * llvm_load( llvm::Value * ptr )
   {
-    return builder->CreateLoad( ptr );
+    return jit_current().builder->CreateLoad( ptr );
   }
 
   void llvm_store( llvm::Value * val , llvm::Value * ptr )
@@ -1023,7 +1448,7 @@ namespace QDP {
     llvm::Value * val_cast = llvm_cast( ptr->getType()->getPointerElementType() , val );
     // llvm::outs() << "\nstore: val_cast  = "; val_cast->dump();
     // llvm::outs() << "\nstore: ptr  = "; ptr->dump();
-    builder->CreateStore( val_cast , ptr );
+    jit_current().builder->CreateStore( val_cast , ptr );
   }
 
 
@@ -1046,19 +1471,19 @@ namespace QDP {
 
   void llvm_bar_sync()
   {
-    llvm::FunctionType *IntrinFnTy = llvm::FunctionType::get(llvm::Type::getVoidTy(TheContext), false);
+    llvm::FunctionType *IntrinFnTy = llvm::FunctionType::get(llvm::Type::getVoidTy(jit_current().context), false);
 
     llvm::AttrBuilder ABuilder;
     ABuilder.addAttribute(llvm::Attribute::ReadNone);
 
-    llvm::Constant *Bar = Mod->getOrInsertFunction( "llvm.nvvm.barrier0" , 
+    llvm::Constant *Bar = jit_current().Mod->getOrInsertFunction( "llvm.nvvm.barrier0" , 
 						    IntrinFnTy , 
-						    llvm::AttributeList::get(TheContext, 
+						    llvm::AttributeList::get(jit_current().context, 
 									    llvm::AttributeList::FunctionIndex, 
 									    ABuilder)
 						    );
 
-    builder->CreateCall(Bar);
+    jit_current().builder->CreateCall(Bar);
   }
 
 
@@ -1067,19 +1492,19 @@ namespace QDP {
 
   llvm::Value * llvm_special( const char * name )
   {
-    llvm::FunctionType *IntrinFnTy = llvm::FunctionType::get(llvm::Type::getInt32Ty(TheContext), false);
+    llvm::FunctionType *IntrinFnTy = llvm::FunctionType::get(llvm::Type::getInt32Ty(jit_current().context), false);
 
     llvm::AttrBuilder ABuilder;
     ABuilder.addAttribute(llvm::Attribute::ReadNone);
 
-    llvm::Constant *ReadTidX = Mod->getOrInsertFunction( name , 
+    llvm::Constant *ReadTidX = jit_current().Mod->getOrInsertFunction( name , 
 							 IntrinFnTy , 
-							 llvm::AttributeList::get(TheContext, 
+							 llvm::AttributeList::get(jit_current().context, 
 										 llvm::AttributeList::FunctionIndex, 
 										 ABuilder)
 							 );
 
-    return builder->CreateCall(ReadTidX);
+    return jit_current().builder->CreateCall(ReadTidX);
   }
 
 
@@ -1092,6 +1517,11 @@ namespace QDP {
 
 
   llvm::Value * llvm_thread_idx() { 
+    if (jit_current().host) {
+      if (!jit_current().function_created)
+	llvm_create_function();
+      return jit_current().vecArgument.back();
+    }
     llvm::Value * tidx = llvm_call_special_tidx();
     llvm::Value * ntidx = llvm_call_special_ntidx();
     llvm::Value * ctaidx = llvm_call_special_ctaidx();
@@ -1219,11 +1649,13 @@ namespace QDP {
 
   void optimize_module( std::unique_ptr< llvm::TargetMachine >& TM )
   {
+    JitCompilation& c = jit_current();
+
     //QDPIO::cout << "optimize module...\n";
     
     llvm::legacy::PassManager Passes;
 
-    llvm::Triple ModuleTriple(Mod->getTargetTriple());
+    llvm::Triple ModuleTriple(c.Mod->getTargetTriple());
 
     llvm::TargetLibraryInfoImpl TLII(ModuleTriple);
 
@@ -1233,7 +1665,7 @@ namespace QDP {
 
     std::unique_ptr<llvm::legacy::FunctionPassManager> FPasses;
 
-    FPasses.reset(new llvm::legacy::FunctionPassManager(Mod.get()));
+    FPasses.reset(new llvm::legacy::FunctionPassManager(c.Mod.get()));
     FPasses->add(createTargetTransformInfoWrapperPass( TM->getTargetIRAnalysis() ) );
 
     //QDPIO::cout << "no optimization passes!!\n";
@@ -1241,19 +1673,21 @@ namespace QDP {
 
     if (FPasses) {
       FPasses->doInitialization();
-      for (llvm::Function &F : *Mod)
+      for (llvm::Function &F : *c.Mod)
 	FPasses->run(F);
       FPasses->doFinalization();
     }
 
     Passes.add(llvm::createVerifierPass());
 
-    Passes.run(*Mod);
+    Passes.run(*c.Mod);
   }
   
 
   std::string get_PTX_from_Module_using_llvm()
   {
+    JitCompilation& c = jit_current();
+
     //QDPIO::cout << "get PTX using NVPTC..\n";
 
     llvm::Triple triple("nvptx64-nvidia-cuda");
@@ -1337,13 +1771,13 @@ namespace QDP {
 
     llvm::legacy::PassManager PM;
     //FOS <<  "target datalayout = \"e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v16:16:16-v32:32:32-v64:64:64-v128:128:128-n16:32:64\";\n";
-    Mod->setTargetTriple( "nvptx64-nvidia-cuda" );
+    c.Mod->setTargetTriple( "nvptx64-nvidia-cuda" );
 
-    llvm::TargetLibraryInfoImpl TLII(Triple(Mod->getTargetTriple()));
+    llvm::TargetLibraryInfoImpl TLII(Triple(c.Mod->getTargetTriple()));
     PM.add(new TargetLibraryInfoWrapperPass(TLII));
     //PM.add(new llvm::TargetLibraryInfoWrapperPass(llvm::Triple(Mod->getTargetTriple())));
 
-    Mod->setDataLayout(target_machine->createDataLayout());
+    c.Mod->setDataLayout(target_machine->createDataLayout());
     //Mod->setDataLayout("e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v16:16:16-v32:32:32-v64:64:64-v128:128:128-n16:32:64");
 
     //setFunctionAttributes("sm_30", "", *Mod);  // !!!!!
@@ -1351,7 +1785,13 @@ namespace QDP {
     //QDPIO::cout << "BEFORE OPT ---------------\n";
     //Mod->dump();
     
+    c.stats->inst_before = llvm_count_instructions( *c.Mod );
+
+    auto start = std::chrono::steady_clock::now();
     optimize_module( target_machine );
+    c.stats->optimize = jit_us_since( start );
+
+    c.stats->inst_after = llvm_count_instructions( *c.Mod );
 
     //QDPIO::cout << "AFTER OPT ---------------\n";
     //Mod->dump();
@@ -1365,7 +1805,7 @@ namespace QDP {
     }
     else {
       QDP_info_primary( "Using module's data layout" );
-      PMTM.add(new DataLayout(Mod));
+      PMTM.add(new DataLayout(c.Mod));
     }
 #else
     //QDP_info_primary( "Using module's data layout" );
@@ -1391,11 +1831,15 @@ namespace QDP {
     //QDPIO::cout << "(module right before PTX codegen)------\n";
 	
     //QDPIO::cout << "PTX code generation\n";
-    PM.run(*Mod);
+    start = std::chrono::steady_clock::now();
+    PM.run(*c.Mod);
+    c.stats->codegen = jit_us_since( start );
     //bos.flush();
 
     //QDPIO::cout << "PTX generated2: " << bos.str().str() << " (end)\n";
 
+    c.stats->ptx_size = bos.str().size();
+
     return bos.str().str();
   }
 
@@ -1448,11 +1892,13 @@ namespace QDP {
   void llvm_module_dump()
   {
     QDPIO::cout << "Module dump...\n";
-    Mod->dump();
+    jit_current().Mod->dump();
   }
 
   std::string llvm_get_ptx_kernel(const char* fname)
   {
+    JitCompilation& c = jit_current();
+
     //QDPIO::cout << "get PTX..\n";
     //QDPIO::cout << "enter get_ptx_kernel------\n";
     //Mod->dump();
@@ -1463,17 +1909,21 @@ namespace QDP {
     llvm::StringMap<int> Mapping;
     Mapping["__CUDA_FTZ"] = llvm_opt::nvptx_FTZ;
 
+    auto start = std::chrono::steady_clock::now();
+    llvm_link_libdevice();
+    c.stats->libdevice = jit_us_since( start );
+
     llvm::legacy::PassManager OurPM;
     OurPM.add( llvm::createInternalizePass( all_but_main ) );
     OurPM.add( llvm::createNVVMReflectPass());
-    OurPM.run( *Mod );
+    OurPM.run( *c.Mod );
 
 
     //QDP_info_primary("Running optimization passes on module");
 
     llvm::legacy::PassManager PM;
     PM.add( llvm::createGlobalDCEPass() );
-    PM.run( *Mod );
+    PM.run( *c.Mod );
 
 
     //QDPIO::cout << "------------------------------------------------ new module\n";
@@ -1513,53 +1963,196 @@ namespace QDP {
 
 
 
+  // Hands the current compilation over to a worker thread for libdevice
+  // import, optimization and PTX codegen. None of it needs the CUDA context.
+  std::future< std::string > llvm_get_ptx_kernel_async( const char* fname )
+  {
+    JitCompilation* c = jit_pool::current;
+    jit_pool::current = NULL;
+
+    std::string name( fname );
+
+    return jit_pool::workers.submit( [c,name]() {
+	jit_pool::current = c;
+	std::string ptx = llvm_get_ptx_kernel( name.c_str() );
+	jit_compilation_release( c );
+	return ptx;
+      } );
+  }
+
+
+
+  // Hash of the module as built, i.e. before libdevice import and
+  // optimization. The settings that change the PTX of the same IR are
+  // hashed with it, so a DB shared between devices or settings returns
+  // only PTX built for the current ones.
+  PtxIrHash llvm_get_ir_hash()
+  {
+    std::string str;
+    llvm::raw_string_ostream rss(str);
+    rss << "sm_" << DeviceParams::Instance().getMajor() << DeviceParams::Instance().getMinor()
+	<< " O" << llvm_opt::opt_level
+	<< " FTZ" << llvm_opt::nvptx_FTZ
+	<< " " << llvm_opt::DisableInline << llvm_opt::UnitAtATime << llvm_opt::DisableLoopUnrolling
+	<< llvm_opt::DisableLoopVectorization << llvm_opt::DisableSLPVectorization << "\n";
+    jit_current().Mod->print( rss , nullptr );
+    rss.flush();
+
+    PtxIrHash h;
+    h.hash  = PtxDB::hash( str.data() , str.size() );
+    h.check = QDPUtil::crc32( 0 , str.data() , str.size() );
+    return h;
+  }
+
+
+
+  CUfunction llvm_finish_cufunction( const char* fname , const std::string& db_id , const PtxIrHash& ir_hash , const std::string& ptx_kernel , JitKernelStats& stats )
+  {
+    auto start = std::chrono::steady_clock::now();
+    CUfunction func = get_fptr_from_ptx( fname , ptx_kernel );
+    stats.load = jit_us_since( start );
+
+    mapCUFuncId[ func ] = db_id;
+
+    if ( ptx_db::db_enabled && Layout::primaryNode() ) {
+      // Appends a single record
+      ptx_db::db.insert( db_id , ir_hash , ptx_kernel );
+    }
+
+    return func;
+  }
+
+
+
+  CUfunction llvm_resolve_cufunction( CUfunction f )
+  {
+    if (jit_async::pending.empty())
+      return f;
+
+    auto it = jit_async::pending.find( f );
+    if (it == jit_async::pending.end())
+      return f;
+
+    jit_async::Pending& p = *it->second;
+
+    if (!p.func) {
+      if (p.ptx.wait_for( std::chrono::seconds(0) ) != std::future_status::ready)
+	jit_stats_async_waited();
+
+      p.func = llvm_finish_cufunction( p.fname.c_str() , p.db_id , p.ir_hash , p.ptx.get() , *p.stats );
+      p.fname.clear();
+      p.db_id.clear();
+    }
+
+    return p.func;
+  }
+
+
+
+  void llvm_resolve_all()
+  {
+    for ( auto& it : jit_async::pending )
+      llvm_resolve_cufunction( it.first );
+
+    // Warm-up loads of kernels that weren't used
+    for ( auto& it : jit_manifest::warm )
+      it.second.wait();
+  }
+
 
 
   CUfunction llvm_get_cufunction(const char* fname, const char* pretty_cstr)
   {
-    addKernelMetadata( mainFunc );
+    // In host mode jit_launch runs it on the host
+    if (jit_current().host)
+      return reinterpret_cast< CUfunction >( llvm_get_hostfunction( pretty_cstr ) );
+
+    addKernelMetadata( jit_current().mainFunc );
 
     std::string pretty( pretty_cstr );
 
+    // The compilation may be released below, the stats stay
+    std::shared_ptr< JitKernelStats > stats = jit_current().stats;
+    stats->pretty = pretty;
+    stats->build  = jit_us_since( stats->start );
+
     // llvm::FunctionType *funcType = mainFunc->getFunctionType();
     // funcType->dump();
 
-    std::string ptx_kernel = llvm_get_ptx_kernel(fname);
+    std::string ptx_kernel;
+    PtxIrHash ir_hash;
+    bool found = false;
+    bool primary_found = false;
 
-    CUfunction func = get_fptr_from_ptx( fname , ptx_kernel );
+    // The primary node didn't come here, no communication
+    bool local = jit_bcast::local_only;
+    jit_bcast::local_only = false;
 
-    if ( ptx_db::db_enabled ) {
+    bool same = !local && jit_same_as_primary();
 
-      std::string id = get_ptx_db_id( pretty );
+    if ( ptx_db::db_enabled && !local ) {
+      // Different signatures often generate identical code. Look
+      // for the unoptimized IR before spending time in codegen.
+      if (Layout::primaryNode()) {
+	ir_hash = llvm_get_ir_hash();
+	found = ptx_db::db.find_ir( ir_hash , ptx_kernel );
+      }
+      QDPInternal::broadcast( found );
+      if (found)
+	QDPInternal::broadcast_str( ptx_kernel );
+      primary_found = found;
+      found = found && same;
+    }
 
-      // Add kernel
-      //QDPIO::cout << "add kernel for id = " << id << "\n";
+    std::string db_id = get_ptx_db_id( pretty );
 
-      if ( ptx_db::db.find( id ) != ptx_db::db.end() ) {
-	QDPIO::cout << "internal error: key already exists in DB but wasn't found before\n" << id << "\n";
-	QDP_abort(1);
-      }
+    jit_manifest_record( db_id );
 
-      ptx_db::db[ id ] = ptx_kernel;
+    if ( jit_bcast::enabled && !local && !primary_found ) {
+      // Compiled on the primary node only. The others release their
+      // module, differing nodes compile locally meanwhile.
+      std::future< std::string > own;
+      if (Layout::primaryNode() || !same)
+	own = llvm_get_ptx_kernel_async( fname );
+      else
+	jit_compilation_release( jit_pool::current );
 
-      // Store DB
-      //QDPIO::cout << "storing PTX DB " << ptx_db::dbname << "\n";
-      BinaryFileWriter db( ptx_db::dbname );
-      for ( ptx_db::DBType::iterator it = ptx_db::db.begin() ; it != ptx_db::db.end() ; ++it ) 
-	{
-	  int size1 = it->first.size();
-	  db.write(size1);
-	  db.writeArrayPrimaryNode( it->first.c_str() , 1 , size1 );
+      std::string ptx;
+      if (Layout::primaryNode())
+	ptx = own.get();
+      QDPInternal::broadcast_str( ptx );
 
-	  int size2 = it->second.size();
-	  db.write(size2);
-	  db.writeArrayPrimaryNode( it->second.c_str() , 1 , size2 );
-	}
-      db.close();
+      if (!same)
+	ptx = own.get();
 
-    } // ptx db
+      return llvm_finish_cufunction( fname , db_id , ir_hash , ptx , *stats );
+    }
 
-    return func;
+    if (found) {
+      jit_compilation_release( jit_pool::current );
+      stats->from_db  = true;
+      stats->ptx_size = ptx_kernel.size();
+      return llvm_finish_cufunction( fname , db_id , ir_hash , ptx_kernel , *stats );
+    }
+
+    if (jit_pool::workers.size() == 0)
+      return llvm_finish_cufunction( fname , db_id , ir_hash , llvm_get_ptx_kernel_async( fname ).get() , *stats );
+
+    // Codegen runs in the background, the kernel gets loaded at first launch
+    std::unique_ptr< jit_async::Pending > p( new jit_async::Pending );
+    p->ptx     = llvm_get_ptx_kernel_async( fname );
+    p->fname   = fname;
+    p->db_id   = db_id;
+    p->ir_hash = ir_hash;
+    p->func    = NULL;
+    p->stats   = stats;
+
+    CUfunction handle = reinterpret_cast< CUfunction >( p.get() );
+    jit_async::pending[ handle ] = std::move( p );
+
+    jit_stats_async();
+
+    return handle;
   }
 
 
@@ -1568,70 +2161,70 @@ namespace QDP {
   llvm::Value* llvm_call_f32( llvm::Function* func , llvm::Value* lhs )
   {
     llvm::Value* lhs_f32 = llvm_cast( llvm_type<float>::value , lhs );
-    return builder->CreateCall(func,lhs_f32);
+    return jit_current().builder->CreateCall(func,lhs_f32);
   }
 
   llvm::Value* llvm_call_f32( llvm::Function* func , llvm::Value* lhs , llvm::Value* rhs )
   {
     llvm::Value* lhs_f32 = llvm_cast( llvm_type<float>::value , lhs );
     llvm::Value* rhs_f32 = llvm_cast( llvm_type<float>::value , rhs );
-    return builder->CreateCall(func,{lhs_f32,rhs_f32});
+    return jit_current().builder->CreateCall(func,{lhs_f32,rhs_f32});
   }
 
   llvm::Value* llvm_call_f64( llvm::Function* func , llvm::Value* lhs )
   {
     llvm::Value* lhs_f64 = llvm_cast( llvm_type<double>::value , lhs );
-    return builder->CreateCall(func,lhs_f64);
+    return jit_current().builder->CreateCall(func,lhs_f64);
   }
 
   llvm::Value* llvm_call_f64( llvm::Function* func , llvm::Value* lhs , llvm::Value* rhs )
   {
     llvm::Value* lhs_f64 = llvm_cast( llvm_type<double>::value , lhs );
     llvm::Value* rhs_f64 = llvm_cast( llvm_type<double>::value , rhs );
-    return builder->CreateCall(func,{lhs_f64,rhs_f64});
-  }
-
-  llvm::Value* llvm_sin_f32( llvm::Value* lhs ) { return llvm_call_f32( func_sin_f32 , lhs ); }
-  llvm::Value* llvm_acos_f32( llvm::Value* lhs ) { return llvm_call_f32( func_acos_f32 , lhs ); }
-  llvm::Value* llvm_asin_f32( llvm::Value* lhs ) { return llvm_call_f32( func_asin_f32 , lhs ); }
-  llvm::Value* llvm_atan_f32( llvm::Value* lhs ) { return llvm_call_f32( func_atan_f32 , lhs ); }
-  llvm::Value* llvm_ceil_f32( llvm::Value* lhs ) { return llvm_call_f32( func_ceil_f32 , lhs ); }
-  llvm::Value* llvm_floor_f32( llvm::Value* lhs ) { return llvm_call_f32( func_floor_f32 , lhs ); }
-  llvm::Value* llvm_cos_f32( llvm::Value* lhs ) { return llvm_call_f32( func_cos_f32 , lhs ); }
-  llvm::Value* llvm_cosh_f32( llvm::Value* lhs ) { return llvm_call_f32( func_cosh_f32 , lhs ); }
-  llvm::Value* llvm_exp_f32( llvm::Value* lhs ) { return llvm_call_f32( func_exp_f32 , lhs ); }
-  llvm::Value* llvm_log_f32( llvm::Value* lhs ) { return llvm_call_f32( func_log_f32 , lhs ); }
-  llvm::Value* llvm_log10_f32( llvm::Value* lhs ) { return llvm_call_f32( func_log10_f32 , lhs ); }
-  llvm::Value* llvm_sinh_f32( llvm::Value* lhs ) { return llvm_call_f32( func_sinh_f32 , lhs ); }
-  llvm::Value* llvm_tan_f32( llvm::Value* lhs ) { return llvm_call_f32( func_tan_f32 , lhs ); }
-  llvm::Value* llvm_tanh_f32( llvm::Value* lhs ) { return llvm_call_f32( func_tanh_f32 , lhs ); }
-  llvm::Value* llvm_fabs_f32( llvm::Value* lhs ) { return llvm_call_f32( func_fabs_f32 , lhs ); }
-  llvm::Value* llvm_sqrt_f32( llvm::Value* lhs ) { return llvm_call_f32( func_sqrt_f32 , lhs ); }
-  llvm::Value* llvm_isfinite_f32( llvm::Value* lhs ) { return llvm_call_f32( func_isfinite_f32 , lhs ); }
-
-  llvm::Value* llvm_pow_f32( llvm::Value* lhs, llvm::Value* rhs ) { return llvm_call_f32( func_pow_f32 , lhs , rhs ); }
-  llvm::Value* llvm_atan2_f32( llvm::Value* lhs, llvm::Value* rhs ) { return llvm_call_f32( func_atan2_f32 , lhs , rhs ); }
-
-  llvm::Value* llvm_sin_f64( llvm::Value* lhs ) { return llvm_call_f64( func_sin_f64 , lhs ); }
-  llvm::Value* llvm_acos_f64( llvm::Value* lhs ) { return llvm_call_f64( func_acos_f64 , lhs ); }
-  llvm::Value* llvm_asin_f64( llvm::Value* lhs ) { return llvm_call_f64( func_asin_f64 , lhs ); }
-  llvm::Value* llvm_atan_f64( llvm::Value* lhs ) { return llvm_call_f64( func_atan_f64 , lhs ); }
-  llvm::Value* llvm_ceil_f64( llvm::Value* lhs ) { return llvm_call_f64( func_ceil_f64 , lhs ); }
-  llvm::Value* llvm_floor_f64( llvm::Value* lhs ) { return llvm_call_f64( func_floor_f64 , lhs ); }
-  llvm::Value* llvm_cos_f64( llvm::Value* lhs ) { return llvm_call_f64( func_cos_f64 , lhs ); }
-  llvm::Value* llvm_cosh_f64( llvm::Value* lhs ) { return llvm_call_f64( func_cosh_f64 , lhs ); }
-  llvm::Value* llvm_exp_f64( llvm::Value* lhs ) { return llvm_call_f64( func_exp_f64 , lhs ); }
-  llvm::Value* llvm_log_f64( llvm::Value* lhs ) { return llvm_call_f64( func_log_f64 , lhs ); }
-  llvm::Value* llvm_log10_f64( llvm::Value* lhs ) { return llvm_call_f64( func_log10_f64 , lhs ); }
-  llvm::Value* llvm_sinh_f64( llvm::Value* lhs ) { return llvm_call_f64( func_sinh_f64 , lhs ); }
-  llvm::Value* llvm_tan_f64( llvm::Value* lhs ) { return llvm_call_f64( func_tan_f64 , lhs ); }
-  llvm::Value* llvm_tanh_f64( llvm::Value* lhs ) { return llvm_call_f64( func_tanh_f64 , lhs ); }
-  llvm::Value* llvm_fabs_f64( llvm::Value* lhs ) { return llvm_call_f64( func_fabs_f64 , lhs ); }
-  llvm::Value* llvm_sqrt_f64( llvm::Value* lhs ) { return llvm_call_f64( func_sqrt_f64 , lhs ); }
-  llvm::Value* llvm_isfinite_f64( llvm::Value* lhs ) { return llvm_call_f64( func_isfinite_f64 , lhs ); }
-
-  llvm::Value* llvm_pow_f64( llvm::Value* lhs, llvm::Value* rhs ) { return llvm_call_f64( func_pow_f64 , lhs , rhs ); }
-  llvm::Value* llvm_atan2_f64( llvm::Value* lhs, llvm::Value* rhs ) { return llvm_call_f64( func_atan2_f64 , lhs , rhs ); }
+    return jit_current().builder->CreateCall(func,{lhs_f64,rhs_f64});
+  }
+
+  llvm::Value* llvm_sin_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_sinf" ) , lhs ); }
+  llvm::Value* llvm_acos_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_acosf" ) , lhs ); }
+  llvm::Value* llvm_asin_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_asinf" ) , lhs ); }
+  llvm::Value* llvm_atan_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_atanf" ) , lhs ); }
+  llvm::Value* llvm_ceil_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_ceilf" ) , lhs ); }
+  llvm::Value* llvm_floor_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_floorf" ) , lhs ); }
+  llvm::Value* llvm_cos_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_cosf" ) , lhs ); }
+  llvm::Value* llvm_cosh_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_coshf" ) , lhs ); }
+  llvm::Value* llvm_exp_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_expf" ) , lhs ); }
+  llvm::Value* llvm_log_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_logf" ) , lhs ); }
+  llvm::Value* llvm_log10_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_log10f" ) , lhs ); }
+  llvm::Value* llvm_sinh_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_sinhf" ) , lhs ); }
+  llvm::Value* llvm_tan_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_tanf" ) , lhs ); }
+  llvm::Value* llvm_tanh_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_tanhf" ) , lhs ); }
+  llvm::Value* llvm_fabs_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_fabsf" ) , lhs ); }
+  llvm::Value* llvm_sqrt_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_fsqrt_rn" ) , lhs ); }
+  llvm::Value* llvm_isfinite_f32( llvm::Value* lhs ) { return llvm_call_f32( llvm_get_func( "__nv_finitef" ) , lhs ); }
+
+  llvm::Value* llvm_pow_f32( llvm::Value* lhs, llvm::Value* rhs ) { return llvm_call_f32( llvm_get_func( "__nv_powf" ) , lhs , rhs ); }
+  llvm::Value* llvm_atan2_f32( llvm::Value* lhs, llvm::Value* rhs ) { return llvm_call_f32( llvm_get_func( "__nv_atan2f" ) , lhs , rhs ); }
+
+  llvm::Value* llvm_sin_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_sin" ) , lhs ); }
+  llvm::Value* llvm_acos_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_acos" ) , lhs ); }
+  llvm::Value* llvm_asin_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_asin" ) , lhs ); }
+  llvm::Value* llvm_atan_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_atan" ) , lhs ); }
+  llvm::Value* llvm_ceil_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_ceil" ) , lhs ); }
+  llvm::Value* llvm_floor_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_floor" ) , lhs ); }
+  llvm::Value* llvm_cos_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_cos" ) , lhs ); }
+  llvm::Value* llvm_cosh_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_cosh" ) , lhs ); }
+  llvm::Value* llvm_exp_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_exp" ) , lhs ); }
+  llvm::Value* llvm_log_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_log" ) , lhs ); }
+  llvm::Value* llvm_log10_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_log10" ) , lhs ); }
+  llvm::Value* llvm_sinh_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_sinh" ) , lhs ); }
+  llvm::Value* llvm_tan_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_tan" ) , lhs ); }
+  llvm::Value* llvm_tanh_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_tanh" ) , lhs ); }
+  llvm::Value* llvm_fabs_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_fabs" ) , lhs ); }
+  llvm::Value* llvm_sqrt_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_dsqrt_rn" ) , lhs ); }
+  llvm::Value* llvm_isfinite_f64( llvm::Value* lhs ) { return llvm_call_f64( llvm_get_func( "__nv_isfinited" ) , lhs ); }
+
+  llvm::Value* llvm_pow_f64( llvm::Value* lhs, llvm::Value* rhs ) { return llvm_call_f64( llvm_get_func( "__nv_pow" ) , lhs , rhs ); }
+  llvm::Value* llvm_atan2_f64( llvm::Value* lhs, llvm::Value* rhs ) { return llvm_call_f64( llvm_get_func( "__nv_atan2" ) , lhs , rhs ); }
 
 
 
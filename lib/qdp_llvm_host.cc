@@ -0,0 +1,306 @@
+#include "qdp.h"
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/Host.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <cmath>
+#include <algorithm>
+
+
+// libdevice returns an int for these
+extern "C" {
+  static int qdp_jit_host_finitef( float x )    { return std::isfinite( x ); }
+  static int qdp_jit_host_isfinited( double x ) { return std::isfinite( x ); }
+}
+
+
+namespace QDP {
+
+  typedef void (*JitHostRange)( void** args , int lo , int hi );
+
+  struct JitHostFunction {
+    std::string  pretty;
+    JitHostRange range;
+  };
+
+
+  namespace jit_host {
+    bool mode = false;
+    bool initialized = false;
+    int nthreads = -1;
+    ThreadPool workers;
+
+    // The generated code is owned by the engine, both live until exit
+    std::vector< llvm::ExecutionEngine* > engines;
+    std::vector< JitHostFunction* >       functions;
+  }
+
+
+  bool jit_host_mode() {
+    return jit_host::mode;
+  }
+
+
+  void jit_host_set_mode( bool host ) {
+    jit_host::mode = host;
+  }
+
+
+  void llvm_set_host_threads( int n ) {
+    jit_host::nthreads = n;
+  }
+
+
+  int jit_host_threads() {
+    return jit_host::workers.size() + 1;
+  }
+
+
+  void llvm_host_init( int nthreads )
+  {
+    if (jit_host::initialized)
+      return;
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    // Resolve the math library from the process
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently( nullptr );
+    llvm::sys::DynamicLibrary::AddSymbol( "qdp_jit_host_finitef"   , (void*)&qdp_jit_host_finitef );
+    llvm::sys::DynamicLibrary::AddSymbol( "qdp_jit_host_isfinited" , (void*)&qdp_jit_host_isfinited );
+
+    if (nthreads < 1)
+      nthreads = std::max( 1u , std::thread::hardware_concurrency() );
+
+    jit_host::nthreads = nthreads;
+
+    // The launching thread takes a share of the sites
+    jit_host::workers.start( nthreads - 1 );
+
+    jit_host::initialized = true;
+
+    QDPIO::cout << "LLVM host target        : " << llvm::sys::getProcessTriple() << " " << llvm::sys::getHostCPUName().str() << "\n";
+    QDPIO::cout << "LLVM host threads       : " << nthreads << "\n";
+  }
+
+
+  namespace {
+
+    // libdevice function -> host math library
+    std::string host_math_name( const std::string& nv )
+    {
+      if (nv == "__nv_fsqrt_rn")  return "sqrtf";
+      if (nv == "__nv_dsqrt_rn")  return "sqrt";
+      if (nv == "__nv_finitef")   return "qdp_jit_host_finitef";
+      if (nv == "__nv_isfinited") return "qdp_jit_host_isfinited";
+      return nv.substr( 5 );
+    }
+
+
+    void host_check_and_map( llvm::Module& M , const char* pretty )
+    {
+      for ( llvm::GlobalVariable& G : M.globals() )
+	if (G.getType()->getAddressSpace() != 0)
+	  QDP_error_exit("JIT host: kernel uses shared memory, not available on the host: %s", pretty );
+
+      std::vector< llvm::Function* > nv;
+
+      for ( llvm::Function& F : M ) {
+	if (F.getName().startswith("llvm.nvvm."))
+	  QDP_error_exit("JIT host: kernel uses %s, not available on the host: %s", F.getName().str().c_str() , pretty );
+	if (F.isDeclaration() && F.getName().startswith("__nv_"))
+	  nv.push_back( &F );
+      }
+
+      for ( llvm::Function* F : nv ) {
+	std::string name = host_math_name( F->getName().str() );
+	if (llvm::Function* G = M.getFunction( name )) {
+	  F->replaceAllUsesWith( G );
+	  F->eraseFromParent();
+	} else {
+	  F->setName( name );
+	}
+      }
+    }
+
+
+    // void main_range( void** args , int lo , int hi )
+    // {
+    //   for ( int idx = lo ; idx < hi ; ++idx )
+    //     main( *args[0] , ... , idx );
+    // }
+    void host_build_site_loop( JitCompilation& c )
+    {
+      llvm::Type* i32  = llvm::Type::getInt32Ty( c.context );
+      llvm::Type* i8   = llvm::Type::getInt8Ty( c.context );
+      llvm::Type* i8pp = llvm::Type::getInt8PtrTy( c.context )->getPointerTo();
+
+      llvm::Type* params[] = { i8pp , i32 , i32 };
+      llvm::FunctionType* type = llvm::FunctionType::get( llvm::Type::getVoidTy( c.context ) , params , false );
+
+      llvm::Function* range = llvm::Function::Create( type , llvm::Function::ExternalLinkage , "main_range" , c.Mod.get() );
+
+      llvm::Function::arg_iterator AI = range->arg_begin();
+      llvm::Value* args = &*AI++;
+      llvm::Value* lo   = &*AI++;
+      llvm::Value* hi   = &*AI;
+
+      llvm::BasicBlock* entry = llvm::BasicBlock::Create( c.context , "entry" , range );
+      llvm::BasicBlock* sites = llvm::BasicBlock::Create( c.context , "sites" , range );
+      llvm::BasicBlock* done  = llvm::BasicBlock::Create( c.context , "done"  , range );
+
+      llvm::IRBuilder<> b( entry );
+
+      // Parameters are loop invariant, load them once
+      std::vector< llvm::Value* > vals;
+      for ( unsigned i = 0 ; i < c.vecParamType.size() ; ++i ) {
+	llvm::Type*  t = c.vecParamType[i];
+	llvm::Value* p = b.CreateLoad( b.CreateConstGEP1_32( args , i ) );
+	if (t->isIntegerTy(1))
+	  vals.push_back( b.CreateTrunc( b.CreateLoad( b.CreateBitCast( p , i8->getPointerTo() ) ) , t ) );
+	else
+	  vals.push_back( b.CreateLoad( b.CreateBitCast( p , t->getPointerTo() ) ) );
+      }
+      b.CreateCondBr( b.CreateICmpSLT( lo , hi ) , sites , done );
+
+      b.SetInsertPoint( sites );
+      llvm::PHINode* idx = b.CreatePHI( i32 , 2 );
+      idx->addIncoming( lo , entry );
+      vals.push_back( idx );
+      b.CreateCall( c.mainFunc , vals );
+      llvm::Value* next = b.CreateAdd( idx , llvm::ConstantInt::get( i32 , 1 ) );
+      idx->addIncoming( next , sites );
+      b.CreateCondBr( b.CreateICmpSLT( next , hi ) , sites , done );
+
+      b.SetInsertPoint( done );
+      b.CreateRetVoid();
+
+      // Only the loop is called from outside
+      c.mainFunc->setLinkage( llvm::GlobalValue::InternalLinkage );
+      c.mainFunc->addFnAttr( llvm::Attribute::AlwaysInline );
+    }
+
+
+    std::unique_ptr< llvm::TargetMachine > host_target_machine()
+    {
+      std::string triple = llvm::sys::getProcessTriple();
+
+      std::string error;
+      const llvm::Target* target = llvm::TargetRegistry::lookupTarget( triple , error );
+      if (!target)
+	QDP_error_exit("JIT host: no LLVM target for %s: %s", triple.c_str() , error.c_str() );
+
+      std::string features;
+      llvm::StringMap<bool> host_features;
+      if (llvm::sys::getHostCPUFeatures( host_features ))
+	for ( auto& f : host_features )
+	  features += ( f.second ? "+" : "-" ) + f.first().str() + ",";
+
+      std::unique_ptr< llvm::TargetMachine > TM( target->createTargetMachine( triple ,
+									     llvm::sys::getHostCPUName() ,
+									     features ,
+									     llvm::TargetOptions() ,
+									     llvm::None ,
+									     llvm::None ,
+									     llvm::CodeGenOpt::Aggressive , true ) );
+      if (!TM)
+	QDP_error_exit("JIT host: could not create target machine for %s", triple.c_str() );
+
+      return TM;
+    }
+
+  } // namespace
+
+
+  JitHostFunction* llvm_get_hostfunction( const char* pretty )
+  {
+    JitCompilation& c = jit_current();
+
+    assert( c.host && "kernel not started with llvm_start_new_host_function" );
+
+    llvm_host_init( jit_host::nthreads );
+
+    JitKernelStats& stats = *c.stats;
+    stats.pretty = pretty;
+    stats.host   = true;
+    stats.build  = jit_us_since( stats.start );
+
+    host_check_and_map( *c.Mod , pretty );
+    host_build_site_loop( c );
+
+    std::unique_ptr< llvm::TargetMachine > TM = host_target_machine();
+
+    c.Mod->setTargetTriple( TM->getTargetTriple().str() );
+    c.Mod->setDataLayout( TM->createDataLayout() );
+
+    stats.inst_before = llvm_count_instructions( *c.Mod );
+
+    auto start = std::chrono::steady_clock::now();
+    optimize_module( TM );
+    stats.optimize = jit_us_since( start );
+
+    stats.inst_after = llvm_count_instructions( *c.Mod );
+
+    start = std::chrono::steady_clock::now();
+
+    std::string error;
+    llvm::ExecutionEngine* engine = llvm::EngineBuilder( std::move( c.Mod ) )
+      .setEngineKind( llvm::EngineKind::JIT )
+      .setErrorStr( &error )
+      .setMCJITMemoryManager( std::unique_ptr< llvm::SectionMemoryManager >( new llvm::SectionMemoryManager ) )
+      .create( TM.release() );
+
+    if (!engine)
+      QDP_error_exit("JIT host: creating execution engine failed: %s", error.c_str() );
+
+    engine->finalizeObject();
+
+    JitHostFunction* func = new JitHostFunction;
+    func->pretty = pretty;
+    func->range  = (JitHostRange)engine->getFunctionAddress( "main_range" );
+
+    if (!func->range)
+      QDP_error_exit("JIT host: code generation failed: %s", pretty );
+
+    stats.codegen = jit_us_since( start );
+
+    jit_host::engines.push_back( engine );
+    jit_host::functions.push_back( func );
+
+    jit_release_current();
+
+    return func;
+  }
+
+
+  void jit_host_launch( JitHostFunction* func , int th_count , std::vector<void*>& args )
+  {
+    if ( th_count == 0 )
+      return;
+
+    int nparts = jit_host::workers.size() + 1;
+
+    // Keep chunks a multiple of the vector width
+    int chunk = ( th_count + nparts - 1 ) / nparts;
+    chunk = ( ( chunk + 15 ) / 16 ) * 16;
+
+    JitHostRange range = func->range;
+    void** a = args.data();
+
+    std::vector< std::future<void> > parts;
+    for ( int lo = chunk ; lo < th_count ; lo += chunk ) {
+      int hi = std::min( lo + chunk , th_count );
+      parts.push_back( jit_host::workers.submit( [range,a,lo,hi]() { range( a , lo , hi ); } ) );
+    }
+
+    range( a , 0 , std::min( chunk , th_count ) );
+
+    for ( auto& p : parts )
+      p.get();
+  }
+
+}
@@ -15,6 +15,27 @@ namespace QDP {
   FnMap::FnMap(const FnMap& f) : map(f.map) , pRsrc(f.pRsrc) {}
 
 
+  JitGatherBundle::~JitGatherBundle()
+  {
+    if (rsrc)
+      FnMapRsrcPool::Instance().release(rsrc);
+  }
+
+
+  void JitGatherBundle::acquire()
+  {
+    if (keys.empty())
+      return;
+
+    rsrc = FnMapRsrcPool::Instance().acquire( keys );
+
+    for ( int m = 0 ; m < maps.size() ; ++m ) {
+      maps[m]->setBundled( rsrc , m );
+      addr.ids[ send_pos[m] ] = rsrc->getSendBufId( m );
+    }
+  }
+
+
 
 //! Definition of shift function object
 ArrayBiDirectionalMap  shift;
@@ -1,17 +1,72 @@
 #include "qdp.h"
 
+#include <algorithm>
+
 namespace QDP {
 
 
-  void FnMapRsrc::setup(int _destNode,int _srcNode,int _sendMsgSize,int _rcvMsgSize) {
+  namespace {
+
+    // The peers' buffer blocks, in the order the peers first appear
+    void add_block( std::vector<int>& peers , std::vector< std::vector<FnMapRsrc::Block> >& blocks ,
+		    int node , int offset , int size )
+    {
+      int p = std::find( peers.begin() , peers.end() , node ) - peers.begin();
+      if (p == peers.size()) {
+	peers.push_back( node );
+	blocks.push_back( std::vector<FnMapRsrc::Block>() );
+      }
+      blocks[p].push_back( FnMapRsrc::Block{ offset , size } );
+    }
+
+
+    // One message memory for the blocks of a peer
+    QMP_msgmem_t declare_msgmem( char* base , const std::vector<FnMapRsrc::Block>& blocks )
+    {
+      if (blocks.size() == 1)
+	return QMP_declare_msgmem( base + blocks[0].offset , blocks[0].size );
+
+      std::vector<void*>     addr( blocks.size() );
+      std::vector<size_t>    size( blocks.size() );
+      std::vector<int>       count( blocks.size() , 1 );
+      std::vector<ptrdiff_t> stride( blocks.size() , 0 );
+      for (int i = 0 ; i < blocks.size() ; ++i ) {
+	addr[i] = base + blocks[i].offset;
+	size[i] = blocks[i].size;
+      }
+      return QMP_declare_strided_array_msgmem( addr.data() , size.data() , count.data() , stride.data() , blocks.size() );
+    }
+
+
+    // A cache id for a part of the buffer at id
+    int add_part( int id , void* dev_ptr , int offset , int size , int nparts )
+    {
+      if (nparts == 1)
+	return id;
+      return QDP_get_global_cache().add( size , QDPCache::Flags::OwnHostMemory | QDPCache::Flags::OwnDeviceMemory ,
+					 QDPCache::Status::device , NULL , (char*)dev_ptr + offset , NULL );
+    }
+
+  }
 
-    bSet=true;
 
-    srcnum=_rcvMsgSize;
-    dstnum=_sendMsgSize;
+  void FnMapRsrc::setup(const std::vector<FnMapRsrcKey>& maps) {
 
-    int srcnode = _srcNode;
-    int dstnode = _destNode;
+    bSet=true;
+
+    // The maps' parts of the buffers
+    std::vector<int> send_part( maps.size() ), recv_part( maps.size() );
+
+    srcnum=0;
+    dstnum=0;
+    for (int m = 0 ; m < maps.size() ; ++m ) {
+      send_part[m] = dstnum;
+      recv_part[m] = srcnum;
+      for (int n : maps[m].rcvMsgSizes)
+	srcnum += n;
+      for (int n : maps[m].sendMsgSizes)
+	dstnum += n;
+    }
 
     if (!DeviceParams::Instance().getGPUDirect()) {
       CudaHostAlloc(&send_buf,dstnum,0);
@@ -24,38 +79,81 @@ namespace QDP {
     //QDPIO::cout << "Allocating send buffer on device: " << dstnum << " bytes\n";
     send_buf_id = QDP_get_global_cache().addDeviceStatic( &send_buf_dev , dstnum);
 
-    if (!DeviceParams::Instance().getGPUDirect()) {
-      msg[0] = QMP_declare_msgmem( recv_buf , srcnum );
-    } else {
-      msg[0] = QMP_declare_msgmem( recv_buf_dev , srcnum );
+    for (int m = 0 ; m < maps.size() ; ++m ) {
+      int send_end = m+1 < maps.size() ? send_part[m+1] : dstnum;
+      int recv_end = m+1 < maps.size() ? recv_part[m+1] : srcnum;
+      send_part_id.push_back( add_part( send_buf_id , send_buf_dev , send_part[m] , send_end - send_part[m] , maps.size() ) );
+      recv_part_id.push_back( add_part( recv_buf_id , recv_buf_dev , recv_part[m] , recv_end - recv_part[m] , maps.size() ) );
     }
 
-    if( msg[0] == (QMP_msgmem_t)NULL ) { 
-      QDP_error_exit("QMP_declare_msgmem for msg[0] failed in Map::operator()\n");
-    }
+    // The segments of all maps per peer
+    std::vector<int> src_peers, dest_peers;
+    std::vector< std::vector<Block> > src_blocks, dest_blocks;
 
-    if (!DeviceParams::Instance().getGPUDirect()) {
-      msg[1] = QMP_declare_msgmem( send_buf , dstnum );
-    } else {
-      msg[1] = QMP_declare_msgmem( send_buf_dev , dstnum );
-    }
+    for (int m = 0 ; m < maps.size() ; ++m ) {
+      const FnMapRsrcKey& k = maps[m];
 
+      for (int i = 0, offset = recv_part[m] ; i < k.srcNodes.size() ; offset += k.rcvMsgSizes[i++] )
+	if (k.rcvMsgSizes[i] > 0)
+	  add_block( src_peers , src_blocks , k.srcNodes[i] , offset , k.rcvMsgSizes[i] );
 
-    if( msg[1] == (QMP_msgmem_t)NULL ) {
-      QDP_error_exit("QMP_declare_msgmem for msg[1] failed in Map::operator()\n");
+      for (int i = 0, offset = send_part[m] ; i < k.destNodes.size() ; offset += k.sendMsgSizes[i++] )
+	if (k.sendMsgSizes[i] > 0)
+	  add_block( dest_peers , dest_blocks , k.destNodes[i] , offset , k.sendMsgSizes[i] );
     }
 
-    mh_a[0] = QMP_declare_receive_from(msg[0], srcnode, 0);
-    if( mh_a[0] == (QMP_msghandle_t)NULL ) { 
-      QDP_error_exit("QMP_declare_receive_from for mh_a[0] failed in Map::operator()\n");
+    char* recv_base = (char*)( DeviceParams::Instance().getGPUDirect() ? recv_buf_dev : recv_buf );
+    char* send_base = (char*)( DeviceParams::Instance().getGPUDirect() ? send_buf_dev : send_buf );
+
+    // One receive per source node, then one send per destination node
+    for (int i = 0 ; i < src_peers.size() ; ++i ) {
+      QMP_msgmem_t m = declare_msgmem( recv_base , src_blocks[i] );
+      if( m == (QMP_msgmem_t)NULL ) {
+	QDP_error_exit("QMP_declare_msgmem for receive from node %d failed in Map::operator()\n",src_peers[i]);
+      }
+      msg.push_back(m);
+
+      QMP_msghandle_t h = QMP_declare_receive_from(m, src_peers[i], 0);
+      if( h == (QMP_msghandle_t)NULL ) {
+	QDP_error_exit("QMP_declare_receive_from node %d failed in Map::operator()\n",src_peers[i]);
+      }
+      mh_a.push_back(h);
+      mh_blocks.push_back(src_blocks[i]);
+    }
+    nrecv = mh_a.size();
+
+    for (int i = 0 ; i < dest_peers.size() ; ++i ) {
+      QMP_msgmem_t m = declare_msgmem( send_base , dest_blocks[i] );
+      if( m == (QMP_msgmem_t)NULL ) {
+	QDP_error_exit("QMP_declare_msgmem for send to node %d failed in Map::operator()\n",dest_peers[i]);
+      }
+      msg.push_back(m);
+
+      QMP_msghandle_t h = QMP_declare_send_to(m, dest_peers[i], 0);
+      if( h == (QMP_msghandle_t)NULL ) {
+	QDP_error_exit("QMP_declare_send_to node %d failed in Map::operator()\n",dest_peers[i]);
+      }
+      mh_a.push_back(h);
+      mh_blocks.push_back(dest_blocks[i]);
     }
 
-    mh_a[1] = QMP_declare_send_to(msg[1], dstnode , 0);
-    if( mh_a[1] == (QMP_msghandle_t)NULL ) {
-      QDP_error_exit("QMP_declare_send_to for mh_a[1] failed in Map::operator()\n");
+    // Nothing to exchange for this subset
+    mh = (QMP_msghandle_t)NULL;
+    if (mh_a.empty())
+      return;
+
+    if (comm_thread_running()) {
+      CUresult ret = cuEventCreate( &ev_gathered , CU_EVENT_DISABLE_TIMING );
+      if (ret == CUDA_SUCCESS)
+	ret = cuEventCreate( &ev_landed , CU_EVENT_DISABLE_TIMING );
+      if (ret != CUDA_SUCCESS) {
+	CudaCheckResult(ret);
+	QDP_error_exit("cuEventCreate failed in Map::operator()\n");
+      }
+      return;
     }
 
-    mh = QMP_declare_multiple(mh_a, 2);
+    mh = QMP_declare_multiple(mh_a.data(), mh_a.size());
     if( mh == (QMP_msghandle_t)NULL ) { 
       QDP_error_exit("QMP_declare_multiple for mh failed in Map::operator()\n");
     }
@@ -64,11 +162,23 @@ namespace QDP {
 
   void FnMapRsrc::cleanup() {
     if (bSet) {
-      QMP_free_msghandle(mh);
-      // QMP_free_msghandle(mh_a[1]);
-      // QMP_free_msghandle(mh_a[0]);
-      QMP_free_msgmem(msg[1]);
-      QMP_free_msgmem(msg[0]);
+      // Frees the handles it's made of
+      if (mh) {
+	QMP_free_msghandle(mh);
+      } else if (!mh_a.empty()) {
+	for (auto h : mh_a)
+	  QMP_free_msghandle(h);
+	cuEventDestroy(ev_gathered);
+	cuEventDestroy(ev_landed);
+      }
+      for (auto m : msg)
+	QMP_free_msgmem(m);
+      if (send_part_id.size() > 1) {
+	for (int id : send_part_id)
+	  QDP_get_global_cache().signoff( id );
+	for (int id : recv_part_id)
+	  QDP_get_global_cache().signoff( id );
+      }
 #if 0
       QMP_free_memory(recv_buf_mem);
       QMP_free_memory(send_buf_mem);
@@ -82,6 +192,14 @@ namespace QDP {
 
 
   void FnMapRsrc::qmp_wait() const {
+    if (mh_a.empty())
+      return;
+
+    if (comm_thread_running()) {
+      comm_thread_wait(*this);
+      return;
+    }
+
     QMP_status_t err;
     if ((err = QMP_wait(mh)) != QMP_SUCCESS)
       QDP_error_exit(QMP_error_string(err));
@@ -97,24 +215,18 @@ namespace QDP {
 
 
   void FnMapRsrc::send_receive() const {
+    if (mh_a.empty())
+      return;
 
-    QMP_status_t err;
-#if QDP_DEBUG >= 3
-    QDP_info("Map: send = 0x%x  recv = 0x%x",send_buf,recv_buf);
-    QDP_info("Map: establish send=%d recv=%d",destnodes[0],srcenodes[0]);
-    {
-      const multi1d<int>& me = Layout::nodeCoord();
-      multi1d<int> scrd = Layout::getLogicalCoordFrom(destnodes[0]);
-      multi1d<int> rcrd = Layout::getLogicalCoordFrom(srcenodes[0]);
-
-      QDP_info("Map: establish-info   my_crds=[%d,%d,%d,%d]",me[0],me[1],me[2],me[3]);
-      QDP_info("Map: establish-info send_crds=[%d,%d,%d,%d]",scrd[0],scrd[1],scrd[2],scrd[3]);
-      QDP_info("Map: establish-info recv_crds=[%d,%d,%d,%d]",rcrd[0],rcrd[1],rcrd[2],rcrd[3]);
+    if (comm_thread_running()) {
+      comm_thread_post(*this);
+      return;
     }
-#endif
 
+    QMP_status_t err;
 #if QDP_DEBUG >= 3
-    QDP_info("Map: calling start send=%d recv=%d",destnodes[0],srcenodes[0]);
+    QDP_info("Map: send = 0x%x  recv = 0x%x",send_buf,recv_buf);
+    QDP_info("Map: calling start, %d messages, send %d bytes, receive %d bytes",(int)mh_a.size(),dstnum,srcnum);
 #endif
 
 #ifdef GPU_DEBUG_DEEP
@@ -123,6 +235,9 @@ namespace QDP {
 
     if (!DeviceParams::Instance().getGPUDirect()) {
       CudaMemcpyD2H( send_buf , send_buf_dev , dstnum );
+    } else {
+      // The send buffer may still be written by a kernel
+      CudaLaunchSync("send");
     }
 
     // Launch the faces
@@ -132,4 +247,134 @@ namespace QDP {
 
 
 
+  size_t FnMapRsrcKeyHash::operator()(const FnMapRsrcKey& k) const {
+    size_t h = 0;
+    for (const std::vector<int>* v : { &k.destNodes , &k.srcNodes , &k.sendMsgSizes , &k.rcvMsgSizes }) {
+      h = h * 31 + v->size();
+      for (int n : *v)
+	h ^= std::hash<int>()(n) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    }
+    return h;
+  }
+
+
+  size_t FnMapRsrcKeyHash::operator()(const std::vector<FnMapRsrcKey>& k) const {
+    size_t h = k.size();
+    for (const FnMapRsrcKey& m : k)
+      h ^= (*this)(m) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+  }
+
+
+  FnMapRsrc* FnMapRsrcPool::acquire(const std::vector<FnMapRsrcKey>& key) {
+    ++n_acquire;
+
+    auto range = mapKey.equal_range(key);
+    for (auto k = range.first ; k != range.second ; ++k) {
+      listEntry_t::iterator e = k->second;
+      if (e->refs == 0) {
+	e->refs = 1;
+	listInUse.splice( listInUse.end() , listIdle , e );
+	++n_reuse;
+	return e->rsrc;
+      }
+    }
+
+    FnMapRsrc* r = new FnMapRsrc();
+    r->setup( key );
+    ++n_setup;
+
+    listEntry_t::iterator e = listInUse.insert( listInUse.end() , Entry{ key , r , 1 , (size_t)(r->srcnum + r->dstnum) } );
+    mapKey.insert( std::make_pair( key , e ) );
+    mapRsrc[r] = e;
+
+    bytes += e->bytes;
+    bytes_peak = std::max( bytes_peak , bytes );
+
+    trim();
+    return r;
+  }
+
+
+  void FnMapRsrcPool::release(const FnMapRsrc* r) {
+    auto i = mapRsrc.find(r);
+    if (i == mapRsrc.end())
+      QDP_error_exit("FnMapRsrcPool: release of an unknown resource");
+
+    listEntry_t::iterator e = i->second;
+    if (e->refs <= 0)
+      QDP_error_exit("FnMapRsrcPool: resource released twice");
+
+    if (--e->refs == 0) {
+      listIdle.splice( listIdle.end() , listInUse , e );
+      trim();
+    }
+  }
+
+
+  void FnMapRsrcPool::free_entry(listEntry_t::iterator e) {
+    auto range = mapKey.equal_range(e->key);
+    for (auto k = range.first ; k != range.second ; ++k)
+      if (k->second == e) {
+	mapKey.erase(k);
+	break;
+      }
+    mapRsrc.erase(e->rsrc);
+
+    bytes -= e->bytes;
+
+    e->rsrc->cleanup();
+    delete e->rsrc;
+  }
+
+
+  // Resources in use stay even if they are over the limit
+  void FnMapRsrcPool::trim() {
+    if (limit == 0 || bytes <= limit || listIdle.empty())
+      return;
+
+    // Kernels still queued may read the buffers
+    CudaLaunchSync("map buffer release");
+
+    while (bytes > limit && !listIdle.empty()) {
+      free_entry( listIdle.begin() );
+      listIdle.pop_front();
+      ++n_freed;
+    }
+  }
+
+
+  void FnMapRsrcPool::printStats() const {
+    const size_t host = DeviceParams::Instance().getGPUDirect() ? 0 : 1;
+
+    QDPIO::cout << "Map communication resources:           " << mapRsrc.size() << " (" << listInUse.size() << " in use)\n";
+    QDPIO::cout << "  requests:                            " << n_acquire << "\n";
+    QDPIO::cout << "  reused:                              " << n_reuse << "\n";
+    QDPIO::cout << "  set up:                              " << n_setup << "\n";
+    QDPIO::cout << "  freed (least recently used):         " << n_freed << "\n";
+    QDPIO::cout << "  pinned host bytes (peak):            " << host * bytes << " (" << host * bytes_peak << ")\n";
+    QDPIO::cout << "  device bytes (peak):                 " << bytes << " (" << bytes_peak << ")\n";
+    QDPIO::cout << "  limit:                               ";
+    if (limit)
+      QDPIO::cout << limit << "\n";
+    else
+      QDPIO::cout << "none\n";
+  }
+
+
+  void FnMapRsrcPool::cleanup() {
+    for (listEntry_t* l : { &listInUse , &listIdle })
+      for (auto e = l->begin() ; e != l->end() ; ++e) {
+	e->rsrc->cleanup();
+	delete e->rsrc;
+      }
+    listInUse.clear();
+    listIdle.clear();
+    mapKey.clear();
+    mapRsrc.clear();
+    bytes = 0;
+  }
+
+
+
 } // namespace QDP
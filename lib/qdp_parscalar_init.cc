@@ -100,12 +100,21 @@ namespace COUNT {
 
     // Initialize the LLVM wrapper
     llvm_wrapper_init();
+
+    jit_tune_init();
+
+    // The thread stages through CUDA streams and events
+    if (DeviceParams::Instance().getCommThread() && !jit_host_mode())
+      comm_thread_start();
   }
 
 
   //! Set the GPU device
   int QDP_setGPU()
   {
+    if (jit_host_mode())
+      return 0;
+
     int deviceCount;
     //int ret = 0;
     CudaGetDeviceCount(&deviceCount);
@@ -145,6 +154,9 @@ namespace COUNT {
 #ifdef QDP_USE_COMM_SPLIT_INIT
   int QDP_setGPUCommSplit()
   {
+    if (jit_host_mode())
+      return 0;
+
     char hostname[256];
 
     int np_global=0;
@@ -337,6 +349,14 @@ namespace COUNT {
 	  {
 	    DeviceParams::Instance().setGPUDirect(true);
 	  }
+	else if (strcmp((*argv)[i], "-launch-async")==0) 
+	  {
+	    DeviceParams::Instance().setAsyncLaunch(true);
+	  }
+	else if (strcmp((*argv)[i], "-comm-thread")==0) 
+	  {
+	    DeviceParams::Instance().setCommThread(true);
+	  }
 	else if (strcmp((*argv)[i], "-envvar")==0) 
 	  {
 	    char buffer[1024];
@@ -374,6 +394,52 @@ namespace COUNT {
 	    
 	    setPoolSize = true;
 	  }
+	else if (strcmp((*argv)[i], "-pool-arena")==0) 
+	  {
+	    float f;
+	    char c = '\0';
+	    sscanf((*argv)[++i],"%f%c",&f,&c);
+	    double mul = 1.;
+	    switch (tolower(c)) {
+	    case 'k': 
+	      mul=1024.; 
+	      break;
+	    case 'm': 
+	      mul=1024.*1024; 
+	      break;
+	    case 'g': 
+	      mul=1024.*1024*1024; 
+	      break;
+	    case '\0':
+	      break;
+	    default:
+	      QDP_error_exit("unknown multiplication factor");
+	    }
+	    QDP_get_global_cache().get_allocator().setArenaSize( (size_t)((double)(f) * mul) );
+	  }
+	else if (strcmp((*argv)[i], "-mapbuf-limit")==0) 
+	  {
+	    float f;
+	    char c = '\0';
+	    sscanf((*argv)[++i],"%f%c",&f,&c);
+	    double mul = 1.;
+	    switch (tolower(c)) {
+	    case 'k': 
+	      mul=1024.; 
+	      break;
+	    case 'm': 
+	      mul=1024.*1024; 
+	      break;
+	    case 'g': 
+	      mul=1024.*1024*1024; 
+	      break;
+	    case '\0':
+	      break;
+	    default:
+	      QDP_error_exit("unknown multiplication factor");
+	    }
+	    FnMapRsrcPool::Instance().setLimit( (size_t)((double)(f) * mul) );
+	  }
 	else if (strcmp((*argv)[i], "-llvm-opt")==0) 
 	  {
 	    char tmp[1024];
@@ -386,6 +452,97 @@ namespace COUNT {
 	    sscanf((*argv)[++i], "%s", &tmp[0]);
 	    llvm_set_ptxdb(tmp);
 	  }
+	else if (strcmp((*argv)[i], "-tunedb")==0) 
+	  {
+	    char tmp[1024];
+	    sscanf((*argv)[++i], "%s", &tmp[0]);
+	    jit_tune_set_db(tmp);
+	  }
+	else if (strcmp((*argv)[i], "-tune-strategy")==0) 
+	  {
+	    char tmp[1024];
+	    sscanf((*argv)[++i], "%s", &tmp[0]);
+	    jit_tune_set_strategy(tmp);
+	  }
+	else if (strcmp((*argv)[i], "-tune-trials")==0) 
+	  {
+	    int n;
+	    sscanf((*argv)[++i], "%d", &n);
+	    jit_tune_set_trials(n);
+	  }
+	else if (strcmp((*argv)[i], "-jit-manifest")==0) 
+	  {
+	    char tmp[1024];
+	    sscanf((*argv)[++i], "%s", &tmp[0]);
+	    llvm_set_manifest(tmp);
+	  }
+	else if (strcmp((*argv)[i], "-llvm-bcast")==0) 
+	  {
+	    llvm_set_bcast(true);
+	  }
+	else if (strcmp((*argv)[i], "-jit-fuse")==0) 
+	  {
+	    int n;
+	    sscanf((*argv)[++i], "%d", &n);
+	    llvm_set_fuse(n);
+	  }
+	else if (strcmp((*argv)[i], "-jit-stats")==0) 
+	  {
+	    llvm_set_kernel_stats(true);
+	  }
+	else if (strcmp((*argv)[i], "-jit-stats-json")==0) 
+	  {
+	    char tmp[1024];
+	    sscanf((*argv)[++i], "%s", &tmp[0]);
+	    llvm_set_kernel_stats_json(tmp);
+	  }
+	else if (strcmp((*argv)[i], "-cache-evict")==0) 
+	  {
+	    char tmp[1024];
+	    sscanf((*argv)[++i], "%s", &tmp[0]);
+	    QDP_get_global_cache().setEvictionPolicy(tmp);
+	  }
+	else if (strcmp((*argv)[i], "-cache-evict-verbose")==0) 
+	  {
+	    QDP_get_global_cache().setEvictionVerbose(true);
+	  }
+	else if (strcmp((*argv)[i], "-pool-no-compact")==0) 
+	  {
+	    QDP_get_global_cache().setCompaction(false);
+	  }
+	else if (strcmp((*argv)[i], "-cache-trace")==0) 
+	  {
+	    char tmp[1024];
+	    sscanf((*argv)[++i], "%s", &tmp[0]);
+	    QDP_get_global_cache().setTrace(tmp);
+	  }
+	else if (strcmp((*argv)[i], "-pool-fit")==0) 
+	  {
+	    char tmp[1024];
+	    sscanf((*argv)[++i], "%s", &tmp[0]);
+	    if (strcmp(tmp, "best")==0)
+	      QDP_get_global_cache().get_allocator().setBestFit(true);
+	    else if (strcmp(tmp, "next")==0)
+	      QDP_get_global_cache().get_allocator().setBestFit(false);
+	    else
+	      QDP_error_exit("-pool-fit: unknown strategy %s (next, best)", tmp);
+	  }
+	else if (strcmp((*argv)[i], "-llvm-host")==0) 
+	  {
+	    jit_host_set_mode(true);
+	  }
+	else if (strcmp((*argv)[i], "-llvm-host-threads")==0) 
+	  {
+	    int n;
+	    sscanf((*argv)[++i], "%d", &n);
+	    llvm_set_host_threads(n);
+	  }
+	else if (strcmp((*argv)[i], "-llvm-threads")==0) 
+	  {
+	    int n;
+	    sscanf((*argv)[++i], "%d", &n);
+	    llvm_set_threads(n);
+	  }
 	else if (strcmp((*argv)[i], "-geom")==0) 
 	  {
 	    setGeomP = true;
@@ -473,12 +630,19 @@ namespace COUNT {
 		
 	  if (QMP_is_initialized() == QMP_FALSE)
 	    {
+	      // The comm thread starts and polls messages while the main thread communicates
+	      QMP_thread_level_t req = DeviceParams::Instance().getCommThread() ? QMP_THREAD_MULTIPLE : QMP_THREAD_SINGLE;
 	      QMP_thread_level_t prv;
-	      if (QMP_init_msg_passing(argc, argv, QMP_THREAD_SINGLE, &prv) != QMP_SUCCESS)
+	      if (QMP_init_msg_passing(argc, argv, req, &prv) != QMP_SUCCESS)
 		{
 		  QDPIO::cerr << __func__ << ": QMP_init_msg_passing failed" << endl;
 		  QDP_abort(1);
 		}
+	      if (req == QMP_THREAD_MULTIPLE && prv != QMP_THREAD_MULTIPLE)
+		{
+		  QDP_info_primary("QMP_THREAD_MULTIPLE not provided, no communication thread");
+		  DeviceParams::Instance().setCommThread(false);
+		}
 	    }
 		
 #if QDP_DEBUG >= 1
@@ -589,12 +753,21 @@ namespace COUNT {
 			QDP_abort(1);
 		}
 		
+		jit_deferred_flush();
+
+		CudaLaunchSync("finalize");
+
+		// Kernels enqueued but never launched still go to the PTX DB
+		llvm_resolve_all();
+
 		QDPIO::cout << "------------------\n";
 		QDPIO::cout << "-- JIT statistics:\n";
 		QDPIO::cout << "------------------\n";
 		QDPIO::cout << "lattices changed to device layout:     " << get_jit_stats_lattice2dev() << "\n";
 		QDPIO::cout << "lattices changed to host layout:       " << get_jit_stats_lattice2host() << "\n";
 		QDPIO::cout << "functions jit-compiled:                " << get_jit_stats_jitted() << "\n";
+		QDPIO::cout << "functions with background codegen:     " << get_jit_stats_async() << "\n";
+		QDPIO::cout << "  of which first launch had to wait:   " << get_jit_stats_async_waited() << "\n";
 		if (get_ptx_db_enabled())
 		  {
 		    QDPIO::cout << "PTX DB, file:                          " << get_ptx_db_fname() << "\n";
@@ -604,8 +777,21 @@ namespace COUNT {
 		  {
 		    QDPIO::cout << "PTX DB: (not used)\n";
 		  }
+
+		jit_tune_db_save();
+
+		QDP_get_global_cache().printEvictionStats();
+		QDP_get_global_cache().get_allocator().printStats();
+
+		llvm_kernel_stats_report();
 		
-		FnMapRsrcMatrix::Instance().cleanup();
+		FnMapRsrcPool::Instance().printStats();
+
+		comm_thread_stop();
+		FnMapRsrcPool::Instance().cleanup();
+
+		// The global cache is never destroyed
+		QDP_get_global_cache().closeTrace();
 
 #if defined(QDP_USE_HDF5)
                 H5close();
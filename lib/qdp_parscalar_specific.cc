@@ -40,6 +40,20 @@ namespace QDP {
   }
 
 
+  namespace {
+    // Position of node in the list of peers
+    int peer_index(const multi1d<int>& nodes, int node)
+    {
+      for(int i=0; i < nodes.size(); ++i)
+	if (nodes[i] == node)
+	  return i;
+
+      QDP_error_exit("Map: node %d is not a peer",node);
+      return -1;
+    }
+  }
+
+
   void Map::make(const MapFunc& func)
   {
 #if QDP_DEBUG >= 3
@@ -48,7 +62,6 @@ namespace QDP {
     const int nodeSites = Layout::sitesOnNode();
     const int my_node   = Layout::nodeNumber();
 
-    multi1d<int> dstnode;
     srcnode.resize(nodeSites);
     dstnode.resize(nodeSites);
 
@@ -156,22 +169,6 @@ namespace QDP {
       QDP_info("destnodes(%d) = %d",i,destnodes(i));
 #endif
 
-    // Implementation limitation in the Map::operator(). Only support
-    // a node sending data all to one node or no sending at all (offNodeP == false).
-    if (srcenodes.size() != 1)
-      QDP_error_exit("Map: for now only allow 1 destination node");
-      
-    if (destnodes.size() != 1)
-      QDP_error_exit("Map: for now only allow receives from 1 node");
-
-    
-    lazy_destnodes0_fcoord.resize( nodeSites );
-    for(int i=0; i < nodeSites; ++i)
-      {
-	multi1d<int> coord = Layout::siteCoords(destnodes[0], i);
-	lazy_destnodes0_fcoord[i] = func(coord,+1);
-      }
-
   } // make (not lazy part)
 
 
@@ -205,11 +202,33 @@ namespace QDP {
 
     goffsets[s_no].resize(nodeSites);
 
+    const Subset& sub = MasterSet::Instance().getSubset( s_no );
+
+    // Run through the lists and find the number of each unique node
+    if (offnodeP)
+      {
+	srcenodes_num[s_no].resize(srcenodes.size());
+	destnodes_num[s_no].resize(destnodes.size());
+
+	srcenodes_num[s_no] = 0;
+	destnodes_num[s_no] = 0;
+
+	for(int linear=0; linear < nodeSites; ++linear)
+	  if ( srcnode[linear] != my_node  &&  sub.isElement( linear ) )
+	    srcenodes_num[s_no][ peer_index( srcenodes , srcnode[linear] ) ]++;
+      }
+
+    // The receive buffer holds one segment per source node, the
+    // sites of a segment in linear order
+    multi1d<int> ri( srcenodes_num[s_no].size() );
+    for(int i=0, offset=0; i < ri.size(); offset += srcenodes_num[s_no][i++])
+      ri[i] = offset;
+
     //--------------------------------------
     // Setup the communication index arrays
 
     // Loop over the sites on this node
-    for(int linear=0, ri=0; linear < nodeSites; ++linear)
+    for(int linear=0; linear < nodeSites; ++linear)
       {
 	if (srcnode[linear] == my_node)
 	  {
@@ -222,10 +241,10 @@ namespace QDP {
 	    // not the best style, but higher performance
 	    // than using another buffer
 	    //QDPIO::cerr << "found off-node source site (" << linear << ") "; 
-	    if ( MasterSet::Instance().getSubset( s_no ).isElement( linear ) ) 
+	    if ( sub.isElement( linear ) ) 
 	      {
-		//QDPIO::cerr << "in subset, assigning receivce buffer index = " << -ri-1 << "\n";
-		goffsets[s_no][linear] = -(ri++)-1;
+		//QDPIO::cerr << "in subset, assigning receivce buffer index\n";
+		goffsets[s_no][linear] = -(ri[ peer_index( srcenodes , srcnode[linear] ) ]++)-1;
 	      }
 	    else 
 	      {
@@ -247,68 +266,45 @@ namespace QDP {
 	return;
       }
 
-    // Run through the lists and find the number of each unique node
-    srcenodes_num[s_no].resize(srcenodes.size());
-    destnodes_num[s_no].resize(destnodes.size());
-
-    srcenodes_num[s_no] = 0;
-    destnodes_num[s_no] = 0;
+    // The sites a destination node gets from me: mine whose inverse map
+    // image is on that node and in the subset there. Further assume
+    // that the subsets have equal sitetables on all nodes. Ordered like
+    // its receive buffer segment, by the linear index on that node.
+    std::vector< std::vector< std::pair<int,int> > > send( destnodes.size() );
 
-    // For now assume that we send as many sites as we receive
-      
     for(int linear=0; linear < nodeSites; ++linear)
+      if (dstnode[linear] != my_node)
+	{
+	  int bline = Layout::linearSiteIndex(lazy_bcoord[linear]);
+	  if ( sub.isElement( bline ) )
+	    send[ peer_index( destnodes , dstnode[linear] ) ].push_back( std::make_pair( bline , linear ) );
+	}
+
+    int num_send = 0;
+    for(int i=0; i < destnodes.size(); ++i)
       {
-	if ( MasterSet::Instance().getSubset(s_no).isElement(linear ) )
-	  {
-	    int this_node = srcnode[linear];
-	    if (this_node != my_node)
-	      {
-		for(int i=0; i < srcenodes_num[s_no].size(); ++i)
-		  {
-		    if (srcenodes[i] == this_node)
-		      {
-			srcenodes_num[s_no][i]++;
-			destnodes_num[s_no][i]++;
-			break;
-		      }
-		  }
-	      }
-	  }
+	std::sort( send[i].begin() , send[i].end() );
+	destnodes_num[s_no][i] = send[i].size();
+	num_send += send[i].size();
       }
 
     // Now make a small scatter array for the dest_buf so that when data
-    // is sent, it is put in an order the gather can pick it up
-    // If we allow multiple dest nodes, then soffsets here needs to be
-    // an array of arrays
-    soffsets[s_no].resize(destnodes_num[s_no][0]);
-    roffsets[s_no].resize(srcenodes_num[s_no][0]);
-
-    // Loop through sites on my *destination* node - here I assume all nodes have
-    // the same number of sites. Mimic the gather pattern needed on that node and
-    // set my scatter array to scatter into the correct site order.
-    // Further assume that the subsets have equal sitetables on all nodes.
-
-    int ri=0;
-    int si=0;
-    for(int i=0; i < nodeSites; ++i) 
-      {
-	multi1d<int> fcoord = lazy_destnodes0_fcoord[i];
-	    
-	int fnode = Layout::nodeNumber(fcoord);
-	int fline = Layout::linearSiteIndex(fcoord);
-
-	if ( MasterSet::Instance().getSubset(s_no).isElement(i)  &&  fnode == my_node )
-	  soffsets[s_no][si++] = fline;
+    // is sent, it is put in an order the gather can pick it up.
+    // One segment per destination node, back to back.
+    soffsets[s_no].resize( num_send );
+    roffsets[s_no].resize( ri.size() > 0 ? ri[ ri.size()-1 ] : 0 );
 
-	if ( MasterSet::Instance().getSubset(s_no).isElement(i)  &&  srcnode[i] != my_node )
-	  roffsets[s_no][ri++] = i;
-      }
+    int si=0;
+    for(int i=0; i < destnodes.size(); ++i)
+      for(auto& p : send[i])
+	soffsets[s_no][si++] = p.second;
 
-    if ( ri != srcenodes_num[s_no][0] )
-      QDP_error_exit("internal error: ri != srcenodes_num[0]");
+    for(int i=0; i < srcenodes.size(); ++i)
+      ri[i] -= srcenodes_num[s_no][i];
 
-    if ( si != destnodes_num[s_no][0] )
-      QDP_error_exit("internal error: si != destnodes_num[0]");
+    for(int linear=0; linear < nodeSites; ++linear)
+      if ( srcnode[linear] != my_node  &&  sub.isElement( linear ) )
+	roffsets[s_no][ ri[ peer_index( srcenodes , srcnode[linear] ) ]++ ] = linear;
 
 #if 0
     if (roffsets[s_no].size()==0)
@@ -323,17 +319,17 @@ namespace QDP {
     soffsetsId[s_no] = QDP_get_global_cache().registrateOwnHostMem( sizeof(int)*soffsets[s_no].size() , soffsets[s_no].slice() , NULL );
 
 #if QDP_DEBUG >= 3
+    for(int i=0; i < srcenodes.size(); ++i)
+      QDP_info("srcenodes(%d) = %d",i,srcenodes(i));
+
     for(int i=0; i < destnodes.size(); ++i)
-      {
-	QDP_info("srcenodes(%d) = %d",i,srcenodes(i));
-	QDP_info("destnodes(%d) = %d",i,destnodes(i));
-      }
+      QDP_info("destnodes(%d) = %d",i,destnodes(i));
 
-    for(int i=0; i < destnodes_num.size(); ++i)
-      {
-	QDP_info("srcenodes_num(%d) = %d",i,srcenodes_num(i));
-	QDP_info("destnodes_num(%d) = %d",i,destnodes_num(i));
-      }
+    for(int i=0; i < srcenodes.size(); ++i)
+      QDP_info("srcenodes_num(%d) = %d",i,srcenodes_num[s_no][i]);
+
+    for(int i=0; i < destnodes.size(); ++i)
+      QDP_info("destnodes_num(%d) = %d",i,destnodes_num[s_no][i]);
 #endif
  
 #if QDP_DEBUG >= 3
@@ -0,0 +1,526 @@
+#include "qdp.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace QDP {
+
+  struct PtxDB::FileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t pad;
+  };
+
+  struct PtxDB::RecordHeader {
+    uint32_t magic;
+    uint32_t key_len;
+    uint32_t ptx_len;
+    uint32_t crc;        // CRC32 over key and ptx
+    uint64_t ir_hash;
+    uint32_t ir_check;
+    uint32_t pad;
+  };
+
+  struct PtxDB::IndexHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t pad;
+    uint64_t nslots;     // per table, power of 2
+    uint64_t nrecords;
+    uint64_t data_size;  // bytes of the data file covered by the index
+  };
+
+  struct PtxDB::Slot {
+    uint64_t hash;       // 0 marks an empty slot
+    uint64_t offset;
+  };
+
+
+  namespace {
+    const uint64_t db_magic   = 0x4244585450504451ULL;  // "QDPPTXDB"
+    const uint64_t idx_magic  = 0x5844495850504451ULL;  // "QDPPXIDX"
+    const uint32_t rec_magic  = 0x58545051;             // "QPTX"
+    const uint32_t db_version = 2;
+
+    const uint64_t idx_min_slots = 1024;
+    const uint32_t max_blob      = 1u << 30;
+
+    bool pread_full( int fd , void* buf , size_t n , uint64_t off )
+    {
+      char* p = static_cast<char*>(buf);
+      while (n > 0) {
+	ssize_t r = ::pread( fd , p , n , off );
+	if (r < 0 && errno == EINTR)
+	  continue;
+	if (r <= 0)
+	  return false;
+	p += r; n -= r; off += r;
+      }
+      return true;
+    }
+
+    bool pwrite_full( int fd , const void* buf , size_t n , uint64_t off )
+    {
+      const char* p = static_cast<const char*>(buf);
+      while (n > 0) {
+	ssize_t r = ::pwrite( fd , p , n , off );
+	if (r < 0 && errno == EINTR)
+	  continue;
+	if (r <= 0)
+	  return false;
+	p += r; n -= r; off += r;
+      }
+      return true;
+    }
+
+    uint64_t file_size( int fd )
+    {
+      struct stat st;
+      if (::fstat( fd , &st ))
+	QDP_error_exit("PTX DB: fstat failed: %s", strerror(errno));
+      return st.st_size;
+    }
+
+    uint32_t record_crc( const std::string& key , const std::string& ptx )
+    {
+      n_uint32_t crc = QDPUtil::crc32( 0 , key.data() , key.size() );
+      return QDPUtil::crc32( crc , ptx.data() , ptx.size() );
+    }
+  }
+
+
+
+  PtxDB::PtxDB(): fd_data(-1), fd_index(-1), index(NULL), index_bytes(0) {}
+
+  PtxDB::~PtxDB()
+  {
+    close();
+  }
+
+
+  uint64_t PtxDB::hash( const char* buf , size_t len )
+  {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for ( size_t i = 0 ; i < len ; ++i ) {
+      h ^= static_cast<unsigned char>(buf[i]);
+      h *= 0x100000001b3ULL;
+    }
+    return h ? h : 1;
+  }
+
+
+  size_t PtxDB::size() const
+  {
+    if (!index)
+      return 0;
+    return static_cast<const IndexHeader*>(index)->nrecords;
+  }
+
+
+  void PtxDB::lock()
+  {
+    while ( ::flock( fd_data , LOCK_EX ) )
+      if (errno != EINTR)
+	QDP_error_exit("PTX DB %s: flock failed: %s", fname_data.c_str(), strerror(errno));
+  }
+
+  void PtxDB::unlock()
+  {
+    ::flock( fd_data , LOCK_UN );
+  }
+
+
+
+  void PtxDB::open( const std::string& fname )
+  {
+    close();
+
+    fname_data  = fname;
+    fname_index = fname + ".idx";
+
+    fd_data = ::open( fname_data.c_str() , O_RDWR | O_CREAT , 0644 );
+    if (fd_data < 0)
+      QDP_error_exit("PTX DB %s: open failed: %s", fname_data.c_str(), strerror(errno));
+
+    lock();
+
+    FileHeader fh;
+    if ( file_size( fd_data ) == 0 ) {
+      fh.magic   = db_magic;
+      fh.version = db_version;
+      fh.pad     = 0;
+      if ( !pwrite_full( fd_data , &fh , sizeof(fh) , 0 ) || ::fsync( fd_data ) )
+	QDP_error_exit("PTX DB %s: write failed: %s", fname_data.c_str(), strerror(errno));
+    }
+
+    if ( !pread_full( fd_data , &fh , sizeof(fh) , 0 ) || fh.magic != db_magic || fh.version != db_version )
+      QDP_error_exit("PTX DB %s: not a PTX DB file of version %u (files written by older versions need to be removed)",
+		     fname_data.c_str(), db_version);
+
+    if ( map_index() )
+      {
+	sync_tail();
+      }
+    else
+      {
+	QDPIO::cout << "PTX DB: rebuilding index " << fname_index << "\n";
+	build_index( idx_min_slots , file_size( fd_data ) , true );
+      }
+
+    unlock();
+  }
+
+
+
+  void PtxDB::close()
+  {
+    unmap_index();
+    if (fd_data >= 0) {
+      ::close( fd_data );
+      fd_data = -1;
+    }
+  }
+
+
+
+  bool PtxDB::read_record( uint64_t offset , std::string* key , std::string* ptx , PtxIrHash* ir_hash , uint64_t* next )
+  {
+    RecordHeader rh;
+    if ( !pread_full( fd_data , &rh , sizeof(rh) , offset ) )
+      return false;
+
+    if ( rh.magic != rec_magic || rh.key_len > max_blob || rh.ptx_len > max_blob )
+      return false;
+
+    uint64_t end = offset + sizeof(rh) + rh.key_len + rh.ptx_len;
+    if ( end > file_size( fd_data ) )
+      return false;
+
+    if (key) {
+      key->resize( rh.key_len );
+      if ( !pread_full( fd_data , &(*key)[0] , rh.key_len , offset + sizeof(rh) ) )
+	return false;
+    }
+
+    if (ptx) {
+      ptx->resize( rh.ptx_len );
+      if ( !pread_full( fd_data , &(*ptx)[0] , rh.ptx_len , offset + sizeof(rh) + rh.key_len ) )
+	return false;
+
+      // Verify the checksum whenever the whole record was read
+      if ( key && record_crc( *key , *ptx ) != rh.crc )
+	return false;
+    }
+
+    if (ir_hash) {
+      ir_hash->hash  = rh.ir_hash;
+      ir_hash->check = rh.ir_check;
+    }
+    if (next)
+      *next = end;
+
+    return true;
+  }
+
+
+
+  bool PtxDB::map_index()
+  {
+    fd_index = ::open( fname_index.c_str() , O_RDWR );
+    if (fd_index < 0)
+      return false;
+
+    uint64_t bytes = file_size( fd_index );
+
+    if ( bytes >= sizeof(IndexHeader) ) {
+      index = ::mmap( NULL , bytes , PROT_READ | PROT_WRITE , MAP_SHARED , fd_index , 0 );
+      if ( index == MAP_FAILED )
+	index = NULL;
+      index_bytes = bytes;
+    }
+
+    if (index) {
+      const IndexHeader* ih = static_cast<const IndexHeader*>(index);
+
+      bool valid =
+	ih->magic == idx_magic &&
+	ih->version == db_version &&
+	ih->nslots >= idx_min_slots &&
+	( ih->nslots & (ih->nslots - 1) ) == 0 &&
+	bytes == sizeof(IndexHeader) + 2 * ih->nslots * sizeof(Slot) &&
+	ih->data_size >= sizeof(FileHeader) &&
+	ih->data_size <= file_size( fd_data );
+
+      if (valid)
+	return true;
+    }
+
+    unmap_index();
+    return false;
+  }
+
+
+
+  void PtxDB::unmap_index()
+  {
+    if (index) {
+      ::munmap( index , index_bytes );
+      index = NULL;
+      index_bytes = 0;
+    }
+    if (fd_index >= 0) {
+      ::close( fd_index );
+      fd_index = -1;
+    }
+  }
+
+
+
+  //
+  // Writes a fresh index covering the data file up to 'end' into a temporary
+  // file and moves it into place. With 'verify' every record is checksummed
+  // and a torn tail gets truncated, otherwise only record headers and keys
+  // are read.
+  //
+  void PtxDB::build_index( uint64_t nslots , uint64_t end , bool verify )
+  {
+    // Size the tables for at most half occupancy
+    uint64_t nrec = 0;
+    for ( uint64_t offset = sizeof(FileHeader) ; offset < end && read_record( offset , NULL , NULL , NULL , &offset ) ; )
+      ++nrec;
+    while ( 2 * ( nrec + 1 ) > nslots )
+      nslots *= 2;
+
+    std::ostringstream oss;
+    oss << fname_index << ".tmp." << ::getpid();
+    std::string fname_tmp = oss.str();
+
+    size_t bytes = sizeof(IndexHeader) + 2 * nslots * sizeof(Slot);
+
+    int fd = ::open( fname_tmp.c_str() , O_RDWR | O_CREAT | O_TRUNC , 0644 );
+    if ( fd < 0 || ::ftruncate( fd , bytes ) )
+      QDP_error_exit("PTX DB %s: can't create index: %s", fname_tmp.c_str(), strerror(errno));
+
+    void* mem = ::mmap( NULL , bytes , PROT_READ | PROT_WRITE , MAP_SHARED , fd , 0 );
+    if ( mem == MAP_FAILED )
+      QDP_error_exit("PTX DB %s: mmap failed: %s", fname_tmp.c_str(), strerror(errno));
+
+    IndexHeader* ih = static_cast<IndexHeader*>(mem);
+    ih->magic     = idx_magic;
+    ih->version   = db_version;
+    ih->pad       = 0;
+    ih->nslots    = nslots;
+    ih->nrecords  = 0;
+
+    Slot* key_table = reinterpret_cast<Slot*>( ih + 1 );
+    Slot* ir_table  = key_table + nslots;
+
+    uint64_t offset = sizeof(FileHeader);
+    std::string key;
+    std::string ptx;
+    PtxIrHash ir_hash;
+    uint64_t next;
+
+    while ( offset < end && read_record( offset , &key , verify ? &ptx : NULL , &ir_hash , &next ) )
+      {
+	table_add( key_table , nslots , hash( key.data() , key.size() ) , offset );
+	if (ir_hash.hash)
+	  table_add( ir_table , nslots , ir_hash.hash , offset );
+	ih->nrecords++;
+	offset = next;
+      }
+
+    if ( verify && offset < end ) {
+      QDPIO::cout << "PTX DB: truncating " << end - offset << " bytes of incomplete data at the end of " << fname_data << "\n";
+      if ( ::ftruncate( fd_data , offset ) )
+	QDP_error_exit("PTX DB %s: truncate failed: %s", fname_data.c_str(), strerror(errno));
+    }
+
+    ih->data_size = offset;
+
+    if ( ::msync( mem , bytes , MS_SYNC ) || ::rename( fname_tmp.c_str() , fname_index.c_str() ) )
+      QDP_error_exit("PTX DB %s: can't install index: %s", fname_index.c_str(), strerror(errno));
+
+    unmap_index();
+    fd_index    = fd;
+    index       = mem;
+    index_bytes = bytes;
+  }
+
+
+
+  //
+  // Picks up records appended by other jobs since the index was last
+  // updated (or left behind by a job that died before updating it).
+  // Must be called with the lock held.
+  //
+  void PtxDB::sync_tail()
+  {
+    // Another job may have grown the index in the meantime
+    struct stat st_path;
+    struct stat st_fd;
+    if ( ::stat( fname_index.c_str() , &st_path ) || ::fstat( fd_index , &st_fd ) || st_path.st_ino != st_fd.st_ino ) {
+      unmap_index();
+      if (!map_index()) {
+	build_index( idx_min_slots , file_size( fd_data ) , true );
+	return;
+      }
+    }
+
+    IndexHeader* ih = static_cast<IndexHeader*>(index);
+
+    uint64_t offset = ih->data_size;
+    uint64_t fsize  = file_size( fd_data );
+    std::string key;
+    std::string ptx;
+    PtxIrHash ir_hash;
+    uint64_t next;
+
+    while ( offset < fsize && read_record( offset , &key , &ptx , &ir_hash , &next ) )
+      {
+	if ( 2 * ( ih->nrecords + 1 ) > ih->nslots ) {
+	  build_index( 2 * ih->nslots , offset , false );
+	  ih = static_cast<IndexHeader*>(index);
+	}
+	index_add( hash( key.data() , key.size() ) , ir_hash.hash , offset );
+	offset = next;
+	ih->data_size = offset;
+      }
+
+    if ( offset < fsize ) {
+      QDPIO::cout << "PTX DB: truncating " << fsize - offset << " bytes of incomplete data at the end of " << fname_data << "\n";
+      if ( ::ftruncate( fd_data , offset ) )
+	QDP_error_exit("PTX DB %s: truncate failed: %s", fname_data.c_str(), strerror(errno));
+    }
+  }
+
+
+
+  void PtxDB::table_add( Slot* table , uint64_t nslots , uint64_t hash , uint64_t offset )
+  {
+    uint64_t mask = nslots - 1;
+    uint64_t i = hash & mask;
+    while ( table[i].hash )
+      i = ( i + 1 ) & mask;
+
+    // Offset first, the hash marks the slot as used
+    table[i].offset = offset;
+    table[i].hash   = hash;
+  }
+
+
+
+  void PtxDB::index_add( uint64_t key_hash , uint64_t ir_hash , uint64_t offset )
+  {
+    IndexHeader* ih = static_cast<IndexHeader*>(index);
+    Slot* key_table = reinterpret_cast<Slot*>( ih + 1 );
+    Slot* ir_table  = key_table + ih->nslots;
+
+    table_add( key_table , ih->nslots , key_hash , offset );
+    if (ir_hash)
+      table_add( ir_table , ih->nslots , ir_hash , offset );
+    ih->nrecords++;
+  }
+
+
+
+  bool PtxDB::find( const std::string& key , std::string& ptx )
+  {
+    if (!index)
+      return false;
+
+    const IndexHeader* ih = static_cast<const IndexHeader*>(index);
+    const Slot* key_table = reinterpret_cast<const Slot*>( ih + 1 );
+
+    uint64_t h    = hash( key.data() , key.size() );
+    uint64_t mask = ih->nslots - 1;
+    std::string rec_key;
+
+    for ( uint64_t i = h & mask ; key_table[i].hash ; i = ( i + 1 ) & mask )
+      {
+	if ( key_table[i].hash != h )
+	  continue;
+	if ( read_record( key_table[i].offset , &rec_key , &ptx , NULL , NULL ) && rec_key == key )
+	  return true;
+      }
+    return false;
+  }
+
+
+
+  bool PtxDB::find_ir( const PtxIrHash& ir_hash , std::string& ptx )
+  {
+    if ( !index || !ir_hash.hash )
+      return false;
+
+    const IndexHeader* ih = static_cast<const IndexHeader*>(index);
+    const Slot* ir_table  = reinterpret_cast<const Slot*>( ih + 1 ) + ih->nslots;
+
+    uint64_t mask = ih->nslots - 1;
+    std::string rec_key;
+    PtxIrHash rec_ir_hash;
+
+    for ( uint64_t i = ir_hash.hash & mask ; ir_table[i].hash ; i = ( i + 1 ) & mask )
+      {
+	if ( ir_table[i].hash != ir_hash.hash )
+	  continue;
+	if ( read_record( ir_table[i].offset , &rec_key , &ptx , &rec_ir_hash , NULL ) && rec_ir_hash == ir_hash )
+	  return true;
+      }
+    return false;
+  }
+
+
+
+  void PtxDB::insert( const std::string& key , const PtxIrHash& ir_hash , const std::string& ptx )
+  {
+    if (!index)
+      return;
+
+    lock();
+    sync_tail();
+
+    // Some other job might have added it
+    std::string tmp;
+    if ( find( key , tmp ) ) {
+      unlock();
+      return;
+    }
+
+    if ( 2 * ( size() + 1 ) > static_cast<IndexHeader*>(index)->nslots )
+      build_index( 2 * static_cast<IndexHeader*>(index)->nslots , static_cast<IndexHeader*>(index)->data_size , false );
+
+    IndexHeader* ih = static_cast<IndexHeader*>(index);
+    uint64_t offset = ih->data_size;
+
+    RecordHeader rh;
+    rh.magic   = rec_magic;
+    rh.key_len = key.size();
+    rh.ptx_len = ptx.size();
+    rh.crc     = record_crc( key , ptx );
+    rh.ir_hash  = ir_hash.hash;
+    rh.ir_check = ir_hash.check;
+    rh.pad      = 0;
+
+    std::string buf( reinterpret_cast<const char*>(&rh) , sizeof(rh) );
+    buf += key;
+    buf += ptx;
+
+    // The record must be on disk before the index points to it
+    if ( !pwrite_full( fd_data , buf.data() , buf.size() , offset ) || ::fdatasync( fd_data ) )
+      QDP_error_exit("PTX DB %s: write failed: %s", fname_data.c_str(), strerror(errno));
+
+    index_add( hash( key.data() , key.size() ) , ir_hash.hash , offset );
+    ih->data_size = offset + buf.size();
+
+    unlock();
+  }
+
+}
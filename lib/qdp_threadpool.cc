@@ -0,0 +1,47 @@
+#include "qdp.h"
+
+namespace QDP {
+
+  void ThreadPool::start( int nthreads )
+  {
+    stop();
+
+    stopping = false;
+    for ( int i = 0 ; i < nthreads ; ++i )
+      workers.push_back( std::thread( &ThreadPool::run , this ) );
+  }
+
+
+  // Finishes the queued tasks, then joins the workers
+  void ThreadPool::stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cond.notify_all();
+
+    for ( std::thread& t : workers )
+      t.join();
+    workers.clear();
+  }
+
+
+  void ThreadPool::run()
+  {
+    while (true)
+      {
+	std::function<void()> task;
+	{
+	  std::unique_lock<std::mutex> lock(mutex);
+	  cond.wait( lock , [this]() { return stopping || !queue.empty(); } );
+	  if (queue.empty())
+	    return;
+	  task = std::move( queue.front() );
+	  queue.pop_front();
+	}
+	task();
+      }
+  }
+
+}